@@ -0,0 +1,138 @@
+#pragma once
+/**
+ * Host build: the part of the Arduino core the sketch uses. Time is virtual,
+ * it advances with delay(), with every call of millis() and micros() and with
+ * every access to an I/O register (see hostio.cpp)
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+#define LED_BUILTIN   13
+#define A0            14
+#define A1            15
+#define A2            16
+#define A3            17
+#define A4            18
+#define A5            19
+#define DEC           10
+#define HEX           16
+#define OCT           8
+#define BIN           2
+#define NOT_A_PORT    0
+#define PB            2
+#define PC            3
+#define PD            4
+
+#define F(s)                (s)
+#define bit(b)              (1UL << (b))
+#define bitRead(v, b)       (((v) >> (b)) & 1)
+#define bitSet(v, b)        ((v) |= (1UL << (b)))
+#define bitClear(v, b)      ((v) &= ~(1UL << (b)))
+#define lowByte(w)          ((uint8_t)((w) & 0xFF))
+#define highByte(w)         ((uint8_t)((w) >> 8))
+#define constrain(a, l, h)  ((a) < (l) ? (l) : ((a) > (h) ? (h) : (a)))
+#define noInterrupts()      cli()
+#define interrupts()        sei()
+
+template <class T, class U> inline auto min(T a, U b) -> decltype(a < b ? a : b) { return a < b ? a : b; }
+template <class T, class U> inline auto max(T a, U b) -> decltype(a > b ? a : b) { return a > b ? a : b; }
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+// Virtual time
+extern uint64_t hostCycles;                 // CPU cycles since reset
+extern double   hostSpeed;                  // virtual time / wall time, 0 = as fast as possible
+void hostAdvance(uint64_t cycles);          // run the peripherals and interrupts for cycles
+void hostPace();                            // hold the virtual time at hostSpeed
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Pins 0 .. 7 on port D, 8 .. 13 on port B, 14 .. 19 (A0 .. A5) on port C
+void     pinMode(uint8_t pin, uint8_t mode);
+void     digitalWrite(uint8_t pin, uint8_t value);
+int      digitalRead(uint8_t pin);
+int      analogRead(uint8_t pin);
+uint8_t  digitalPinToPort(uint8_t pin);
+uint8_t  digitalPinToBitMask(uint8_t pin);
+IoReg8  *portInputRegister(uint8_t port);
+IoReg8  *portOutputRegister(uint8_t port);
+IoReg8  *portModeRegister(uint8_t port);
+
+// Buffers of HardwareSerial, as in the core for the ATmega328P
+constexpr uint8_t SERIAL_RX_BUFFER_SIZE = 64;
+constexpr uint8_t SERIAL_TX_BUFFER_SIZE = 64;
+
+/**
+ * Print and Stream of the Arduino core, reduced to what the sketch uses
+ */
+class HostSerial
+{
+public:
+  void   begin(unsigned long baud);
+  void   end();
+  int    available();
+  int    read();
+  int    peek();
+  void   flush();
+  int    availableForWrite();
+  void   setTimeout(unsigned long ms) { timeout = ms; }
+  long   parseInt();
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buf, size_t n);
+  size_t print(const char *s);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC)  { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC)            { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC)   { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double d, int digits = 2);
+  size_t println()                               { return print("\r\n"); }
+  template <class T> size_t println(T v)         { size_t n = print(v); return n + println(); }
+  template <class T> size_t println(T v, int b)  { size_t n = print(v, b); return n + println(); }
+
+  explicit operator bool() { return true; }
+
+  // Host side: where the bytes come from and go to
+  int    fdIn  = -1;
+  int    fdOut = 1;
+  unsigned long baud = 0;
+  uint32_t rxDropped = 0;                   // characters lost, receive buffer full
+  void   hostReceive(uint8_t c);            // the receive interrupt
+
+private:
+  int    timedPeek();
+  unsigned long timeout = 1000;
+  uint8_t  rxBuf[SERIAL_RX_BUFFER_SIZE];
+  uint8_t  rxHead = 0;
+  uint8_t  rxTail = 0;
+  uint64_t txEnd  = 0;                      // cycle the last character queued is sent
+};
+
+extern HostSerial Serial;
+
+void setup();
+void loop();
@@ -0,0 +1,144 @@
+/**
+ * Program      adcsim.cpp
+ *
+ * Purpose      Host build: the ADC of the ATmega328P, single conversions and free
+ *              running mode, ADIF and the ADC interrupt. The inputs A0 .. A5 are set
+ *              in mV, channel 8 is the temperature sensor
+ *
+ * Formulas     conversion = 13 ADC clocks (25 for the first after ADEN) * prescaler
+ *              prescaler  = 2, 2, 4, 8, 16, 32, 64, 128 for ADPS = 0 .. 7
+ *              result     = mV * 1024 / 5000 (AVcc) or mV * 1024 / 1100 (1.1 V)
+ *              sensor     = 314 + (T - 25 degC) * 1.1 counts at 1.1 V, the values
+ *                           tempcomp.cpp converts back
+ *
+ * Remarks      Auto trigger sources other than free running are not modelled.
+ *              While PRADC is set in PRR the ADC has no clock: writes to its
+ *              registers are ignored and a running conversion stops.
+ */
+#include "adcsim.h"
+
+AdcSim adc;
+
+constexpr uint8_t ADDR_ADCL   = 0x78;
+constexpr uint8_t ADDR_ADCH   = 0x79;
+constexpr uint8_t ADDR_ADCSRA = 0x7A;
+constexpr uint8_t ADDR_ADCSRB = 0x7B;
+constexpr uint8_t ADDR_ADMUX  = 0x7C;
+constexpr uint8_t ADDR_PRR    = 0x64;
+constexpr uint8_t VECT_ADC    = 21;
+
+void AdcSim::reset()
+{
+  admux  = adcsra = adcsrb = 0;
+  result = 0;
+  clocked = true;
+  done   = HOST_NEVER;
+}
+
+void AdcSim::start(bool first)
+{
+  uint8_t pre = adcsra & 7 ? 1 << (adcsra & 7) : 2;
+  done = hostCycles + (first ? 25 : 13) * pre;
+}
+
+uint16_t AdcSim::convert()
+{
+  uint8_t  ch   = admux & 0x0F;
+  bool     int11 = (admux >> REFS0 & 3) == 3;
+  uint32_t ref  = int11 ? 1100 : 5000;
+  int32_t  v;
+
+  if (ch == 8)       v = 314 + (temperature - 250) * 11 / 100;
+  else if (ch < 6)   v = (uint32_t)mV[ch] * 1024 / ref;
+  else if (ch == 14) v = 1100UL * 1024 / ref;          // 1.1 V bandgap
+  else               v = 0;
+  return constrain(v, 0, 1023);
+}
+
+void AdcSim::run(uint64_t until)
+{
+  while (done <= until)
+  {
+    uint64_t end = done;
+    result  = convert();
+    adcsra |= 1 << ADIF;
+    if ((adcsra & (1 << ADATE)) && (adcsrb & 7) == 0)
+    {
+      uint8_t pre = adcsra & 7 ? 1 << (adcsra & 7) : 2;
+      done = end + 13 * pre;                            // free running
+    }
+    else
+    {
+      adcsra &= ~(1 << ADSC);
+      done    = HOST_NEVER;
+    }
+  }
+}
+
+bool AdcSim::read(uint8_t addr, uint8_t &v)
+{
+  run(hostCycles);
+  uint16_t r = (admux & (1 << ADLAR)) ? result << 6 : result;
+  switch (addr)
+  {
+    case ADDR_ADCL:   v = r;      return true;
+    case ADDR_ADCH:   v = r >> 8; return true;
+    case ADDR_ADCSRA: v = adcsra; return true;
+    case ADDR_ADCSRB: v = adcsrb; return true;
+    case ADDR_ADMUX:  v = admux;  return true;
+  }
+  return false;
+}
+
+bool AdcSim::write(uint8_t addr, uint8_t v)
+{
+  run(hostCycles);
+  if (addr == ADDR_PRR)
+  {
+    clocked = !(v & (1 << PRADC));
+    if (!clocked) done = HOST_NEVER;
+    return false;                                           // PRR itself is kept by hostio
+  }
+  if (!clocked && (addr == ADDR_ADMUX || addr == ADDR_ADCSRB || addr == ADDR_ADCSRA)) return true;
+  switch (addr)
+  {
+    case ADDR_ADMUX:  admux  = v; return true;
+    case ADDR_ADCSRB: adcsrb = v; return true;
+    case ADDR_ADCSRA:
+    {
+      bool wasOn   = adcsra & (1 << ADEN);
+      bool running = adcsra & (1 << ADSC);
+      uint8_t flag = (adcsra & ~v) & (1 << ADIF);          // a one clears ADIF
+      adcsra = (v & ~(1 << ADIF)) | flag;
+      if (!(adcsra & (1 << ADEN)))
+      {
+        adcsra &= ~(1 << ADSC);
+        done    = HOST_NEVER;
+      }
+      else if ((adcsra & (1 << ADSC)) && !running)
+      {
+        start(!wasOn);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AdcSim::read16(uint8_t addr, uint16_t &v)
+{
+  if (addr != ADDR_ADCL) return false;
+  run(hostCycles);
+  v = (admux & (1 << ADLAR)) ? result << 6 : result;
+  return true;
+}
+
+uint8_t AdcSim::pending()
+{
+  return (adcsra & (1 << ADIF)) && (adcsra & (1 << ADIE)) ? VECT_ADC : 0;
+}
+
+void AdcSim::acknowledge(uint8_t vector)
+{
+  adcsra &= ~(1 << ADIF);
+}
@@ -0,0 +1,33 @@
+#pragma once
+/**
+ * Host build: model of the ADC with the analog inputs A0 .. A5
+ * and the temperature sensor
+ */
+#include "hostio.h"
+
+class AdcSim : public HostDevice
+{
+public:
+  void     reset();
+  uint64_t nextEvent() override  { return done; }
+  void     run(uint64_t until) override;
+  bool     read(uint8_t addr, uint8_t &v) override;
+  bool     write(uint8_t addr, uint8_t v) override;
+  bool     read16(uint8_t addr, uint16_t &v) override;
+  uint8_t  pending() override;
+  void     acknowledge(uint8_t vector) override;
+
+  uint16_t mV[6]       = { 0, 0, 0, 0, 0, 0 };   // levels on A0 .. A5
+  int16_t  temperature = 250;                    // chip temperature in 0.1 degC
+
+private:
+  void     start(bool first);
+  uint16_t convert();
+
+  uint8_t  admux = 0, adcsra = 0, adcsrb = 0;
+  bool     clocked = true;                       // PRADC clear
+  uint16_t result = 0;
+  uint64_t done   = HOST_NEVER;                  // CPU cycle the running conversion ends
+};
+
+extern AdcSim adc;
@@ -0,0 +1,13 @@
+#pragma once
+// Host build: EEMEM variables live in RAM, so the EEPROM keeps
+// its contents for the lifetime of the process
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+inline void    eeprom_read_block(void *dst, const void *src, size_t n)   { memcpy(dst, src, n); }
+inline void    eeprom_update_block(const void *src, void *dst, size_t n) { memcpy(dst, src, n); }
+inline uint8_t eeprom_read_byte(const uint8_t *p)                        { return *p; }
+inline void    eeprom_update_byte(uint8_t *p, uint8_t v)                 { *p = v; }
+inline bool    eeprom_is_ready()                                         { return true; }
@@ -0,0 +1,100 @@
+#pragma once
+/**
+ * Host build: the I/O registers of the ATmega328P. Every register is an object
+ * with the data space address of the real one, reads and writes go through
+ * hostRead/hostWrite to the simulated peripherals (see hostio.cpp)
+ */
+#include <stdint.h>
+
+uint8_t  hostRead8(uint8_t addr);
+void     hostWrite8(uint8_t addr, uint8_t value);
+uint16_t hostRead16(uint8_t addr);
+void     hostWrite16(uint8_t addr, uint16_t value);
+
+struct IoReg8
+{
+  uint8_t addr;
+
+  operator uint8_t() const            { return hostRead8(addr); }
+  IoReg8 &operator=(uint8_t v)        { hostWrite8(addr, v); return *this; }
+  IoReg8 &operator=(const IoReg8 &r)  { hostWrite8(addr, r); return *this; }
+  IoReg8 &operator|=(uint8_t v)       { hostWrite8(addr, hostRead8(addr) | v); return *this; }
+  IoReg8 &operator&=(uint8_t v)       { hostWrite8(addr, hostRead8(addr) & v); return *this; }
+  IoReg8 &operator^=(uint8_t v)       { hostWrite8(addr, hostRead8(addr) ^ v); return *this; }
+};
+
+struct IoReg16
+{
+  uint8_t addr;                       // address of the low byte
+
+  operator uint16_t() const           { return hostRead16(addr); }
+  IoReg16 &operator=(uint16_t v)      { hostWrite16(addr, v); return *this; }
+  IoReg16 &operator=(const IoReg16 &r){ hostWrite16(addr, r); return *this; }
+  IoReg16 &operator|=(uint16_t v)     { hostWrite16(addr, hostRead16(addr) | v); return *this; }
+  IoReg16 &operator&=(uint16_t v)     { hostWrite16(addr, hostRead16(addr) & v); return *this; }
+};
+
+#define HOST_REG8(name, addr)   inline IoReg8  name{addr};
+#define HOST_REG16(name, addr)  inline IoReg16 name{addr};
+
+HOST_REG8(PINB,   0x23)  HOST_REG8(DDRB,   0x24)  HOST_REG8(PORTB,  0x25)
+HOST_REG8(PINC,   0x26)  HOST_REG8(DDRC,   0x27)  HOST_REG8(PORTC,  0x28)
+HOST_REG8(PIND,   0x29)  HOST_REG8(DDRD,   0x2A)  HOST_REG8(PORTD,  0x2B)
+HOST_REG8(TIFR0,  0x35)  HOST_REG8(TIFR1,  0x36)  HOST_REG8(TIFR2,  0x37)
+HOST_REG8(PCIFR,  0x3B)  HOST_REG8(EIFR,   0x3C)  HOST_REG8(EIMSK,  0x3D)
+HOST_REG8(GPIOR0, 0x3E)  HOST_REG8(GPIOR1, 0x4A)  HOST_REG8(GPIOR2, 0x4B)
+HOST_REG8(TCCR0A, 0x44)  HOST_REG8(TCCR0B, 0x45)  HOST_REG8(TCNT0,  0x46)
+HOST_REG8(OCR0A,  0x47)  HOST_REG8(OCR0B,  0x48)
+HOST_REG8(ACSR,   0x50)  HOST_REG8(SMCR,   0x53)  HOST_REG8(MCUSR,  0x54)
+HOST_REG8(MCUCR,  0x55)  HOST_REG8(SPL,    0x5D)  HOST_REG8(SPH,    0x5E)
+HOST_REG8(SREG,   0x5F)  HOST_REG8(WDTCSR, 0x60)  HOST_REG8(CLKPR,  0x61)
+HOST_REG8(PRR,    0x64)  HOST_REG8(PCICR,  0x68)  HOST_REG8(EICRA,  0x69)
+HOST_REG8(PCMSK0, 0x6B)  HOST_REG8(PCMSK1, 0x6C)  HOST_REG8(PCMSK2, 0x6D)
+HOST_REG8(TIMSK0, 0x6E)  HOST_REG8(TIMSK1, 0x6F)  HOST_REG8(TIMSK2, 0x70)
+HOST_REG8(ADCL,   0x78)  HOST_REG8(ADCH,   0x79)  HOST_REG8(ADCSRA, 0x7A)
+HOST_REG8(ADCSRB, 0x7B)  HOST_REG8(ADMUX,  0x7C)  HOST_REG8(DIDR0,  0x7E)
+HOST_REG8(TCCR1A, 0x80)  HOST_REG8(TCCR1B, 0x81)  HOST_REG8(TCCR1C, 0x82)
+HOST_REG8(TCCR2A, 0xB0)  HOST_REG8(TCCR2B, 0xB1)  HOST_REG8(TCNT2,  0xB2)
+HOST_REG8(OCR2A,  0xB3)  HOST_REG8(OCR2B,  0xB4)  HOST_REG8(ASSR,   0xB6)
+HOST_REG8(UCSR0A, 0xC0)  HOST_REG8(UCSR0B, 0xC1)  HOST_REG8(UCSR0C, 0xC2)
+HOST_REG8(UBRR0L, 0xC4)  HOST_REG8(UBRR0H, 0xC5)  HOST_REG8(UDR0,   0xC6)
+
+HOST_REG16(SP,    0x5D)
+HOST_REG16(ADC,   0x78)
+HOST_REG16(TCNT1, 0x84)  HOST_REG16(ICR1,  0x86)
+HOST_REG16(OCR1A, 0x88)  HOST_REG16(OCR1B, 0x8A)
+HOST_REG16(UBRR0, 0xC4)
+
+#define _BV(b)  (1 << (b))
+
+// Bits
+enum
+{
+  PB0 = 0, PB1, PB2, PB3, PB4, PB5, PB6, PB7,
+  PC0 = 0, PC1, PC2, PC3, PC4, PC5, PC6,
+  PD0 = 0, PD1, PD2, PD3, PD4, PD5, PD6, PD7,
+  TOV0 = 0, OCF0A, OCF0B, TOIE0 = 0, OCIE0A, OCIE0B,
+  TOV1 = 0, OCF1A, OCF1B, ICF1 = 5, TOIE1 = 0, OCIE1A, OCIE1B, ICIE1 = 5,
+  TOV2 = 0, OCF2A, OCF2B, TOIE2 = 0, OCIE2A, OCIE2B,
+  WGM10 = 0, WGM11, COM1B0 = 4, COM1B1, COM1A0, COM1A1,
+  CS10 = 0, CS11, CS12, WGM12, WGM13, ICES1 = 6, ICNC1,
+  FOC1B = 6, FOC1A,
+  WGM20 = 0, WGM21, COM2B0 = 4, COM2B1, COM2A0, COM2A1,
+  CS20 = 0, CS21, CS22, WGM22,
+  PCIE0 = 0, PCIE1, PCIE2, PCIF0 = 0, PCIF1, PCIF2,
+  PCINT0 = 0, PCINT1, PCINT2, PCINT3, PCINT4, PCINT5, PCINT6, PCINT7,
+  INT0 = 0, INT1, INTF0 = 0, INTF1, ISC00 = 0, ISC01, ISC10, ISC11,
+  MUX0 = 0, MUX1, MUX2, MUX3, ADLAR = 5, REFS0, REFS1,
+  ADPS0 = 0, ADPS1, ADPS2, ADIE, ADIF, ADATE, ADSC, ADEN,
+  ADTS0 = 0, ADTS1, ADTS2,
+  SE = 0, SM0, SM1, SM2,
+  PRADC = 0, PRUSART0, PRSPI, PRTIM1, PRTIM0 = 5, PRTIM2, PRTWI,
+  MPCM0 = 0, U2X0, UPE0, DOR0, FE0, UDRE0, TXC0, RXC0,
+  TXB80 = 0, RXB80, UCSZ02, TXEN0, RXEN0, UDRIE0, TXCIE0, RXCIE0,
+  UCPOL0 = 0, UCSZ00, UCSZ01,
+  ACD = 7,
+};
+
+#define RAMSTART  0x100
+#define RAMEND    0x8FF
+#define E2END     0x3FF
@@ -0,0 +1,18 @@
+#pragma once
+// Host build: flash and RAM are the same memory
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P               const char *
+#define PSTR(s)             (s)
+#define pgm_read_byte(a)    (*(const uint8_t *)(a))
+#define pgm_read_word(a)    (*(const uint16_t *)(a))
+#define pgm_read_dword(a)   (*(const uint32_t *)(a))
+#define pgm_read_ptr(a)     (*(void * const *)(a))
+#define strcmp_P            strcmp
+#define strncmp_P           strncmp
+#define strcasecmp_P        strcasecmp
+#define strlen_P            strlen
+#define memcpy_P            memcpy
+#define snprintf_P          snprintf
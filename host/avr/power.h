@@ -0,0 +1,13 @@
+#pragma once
+// Host build: the bits of PRR, the ADC model ignores its registers
+// while PRADC is set (see adcsim.cpp)
+#include <avr/io.h>
+
+#define power_adc_enable()      (PRR &= ~(1 << PRADC))
+#define power_adc_disable()     (PRR |=  (1 << PRADC))
+#define power_spi_enable()      (PRR &= ~(1 << PRSPI))
+#define power_spi_disable()     (PRR |=  (1 << PRSPI))
+#define power_twi_enable()      (PRR &= ~(1 << PRTWI))
+#define power_twi_disable()     (PRR |=  (1 << PRTWI))
+#define power_timer2_enable()   (PRR &= ~(1 << PRTIM2))
+#define power_timer2_disable()  (PRR |=  (1 << PRTIM2))
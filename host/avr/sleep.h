@@ -0,0 +1,19 @@
+#pragma once
+// Host build: sleep lets the virtual time run to the next millis() tick,
+// the interrupt that wakes the board at the latest
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE         0x00
+#define SLEEP_MODE_ADC          0x02
+#define SLEEP_MODE_PWR_DOWN     0x04
+#define SLEEP_MODE_PWR_SAVE     0x06
+#define SLEEP_MODE_STANDBY      0x0C
+#define SLEEP_MODE_EXT_STANDBY  0x0E
+
+void hostSleep();                       // core.cpp
+
+inline void set_sleep_mode(uint8_t mode) { SMCR = (SMCR & 0x01) | mode; }
+inline void sleep_enable()               { SMCR |= 0x01; }
+inline void sleep_disable()              { SMCR &= 0xFE; }
+inline void sleep_cpu()                  { if (SMCR & 0x01) hostSleep(); }
+inline void sleep_mode()                 { sleep_enable(); sleep_cpu(); sleep_disable(); }
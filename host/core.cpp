@@ -0,0 +1,391 @@
+/**
+ * Program      core.cpp
+ *
+ * Purpose      Host build: Arduino core functions on the virtual clock, the pin
+ *              functions through the simulated ports and Serial on file descriptors
+ *
+ * Formulas     millis() = cycles / 16'000, micros() = cycles / 64 * 4 (4 us steps
+ *              as on the board). Both cost HOST_CALL_CYCLES, so loops that wait for
+ *              the time to pass make progress
+ *
+ *              With hostSpeed > 0 delay() and hostPace() hold the virtual time at
+ *              hostSpeed times the wall time, with 0 it runs as fast as it can
+ *
+ *              Serial after begin(): one character = 10 bits = F_CPU * 10 / baud cycles.
+ *              The characters waiting on fdIn come in one per character time into the
+ *              receive buffer of 64 bytes, the ones that find it full are lost and
+ *              counted in rxDropped. print() waits while 64 characters are queued
+ *              for sending, as HardwareSerial does
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include "hostio.h"
+#include "timer1sim.h"
+#include "adcsim.h"
+
+constexpr uint64_t HOST_CALL_CYCLES = 32;
+constexpr int      HOST_WRITE_WAIT  = 100;    // ms to wait for a reader, then drop the output
+
+HostSerial Serial;
+double     hostSpeed = 0;
+
+/**
+ * The receive side of the USART: takes a character from fdIn every character time
+ */
+class SerialLine : public HostDevice
+{
+public:
+  uint64_t nextEvent() override
+  {
+    return Serial.fdIn >= 0 && Serial.baud ? next : HOST_NEVER;
+  }
+
+  void run(uint64_t until) override
+  {
+    if (until < next || Serial.fdIn < 0 || !Serial.baud) return;
+    uint64_t cycles = F_CPU * 10 / Serial.baud;
+    uint8_t  c;
+    if (::read(Serial.fdIn, &c, 1) == 1)
+    {
+      Serial.hostReceive(c);
+      received++;
+      next += cycles;
+      if (next <= until) next = until + 1;
+    }
+    else
+      next = until + cycles;                  // line idle, look again after a character
+  }
+
+  uint64_t next     = 0;
+  uint32_t received = 0;
+};
+
+static SerialLine serialLine;
+
+static double   paceWall   = -1;
+static uint64_t paceCycles = 0;
+
+static double wallTime()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Sleep while the virtual time is ahead of hostSpeed times the wall time
+ */
+void hostPace()
+{
+  if (hostSpeed <= 0) return;
+  if (paceWall < 0)
+  {
+    paceWall   = wallTime();
+    paceCycles = hostCycles;
+    return;
+  }
+  double ahead = (hostCycles - paceCycles) / (double)F_CPU / hostSpeed - (wallTime() - paceWall);
+  if (ahead > 0.001) usleep((useconds_t)(ahead * 1e6));
+}
+
+/**
+ * Register the peripherals and enable the interrupts, as init() of the core does
+ */
+void init()
+{
+  hostAddDevice(&timer1);
+  hostAddDevice(&adc);
+  hostAddDevice(&serialLine);
+  timer1.reset();
+  adc.reset();
+  sei();
+}
+
+unsigned long millis()
+{
+  hostAdvance(HOST_CALL_CYCLES);
+  return (unsigned long)(hostCycles / (F_CPU / 1000));
+}
+
+unsigned long micros()
+{
+  hostAdvance(HOST_CALL_CYCLES);
+  return (unsigned long)(hostCycles / 64 * 4);
+}
+
+void delay(unsigned long ms)
+{
+  hostAdvance((uint64_t)ms * (F_CPU / 1000));
+  hostPace();
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  hostAdvance((uint64_t)us * (F_CPU / 1000000));
+}
+
+void yield()
+{
+}
+
+/**
+ * sleep_cpu(): the interrupts of the simulated peripherals run, the CPU
+ * wakes at the next overflow of Timer0 (millis() tick, every 16'384 cycles)
+ * or when a character has been received
+ */
+void hostSleep()
+{
+  uint64_t end      = hostCycles + 16384 - hostCycles % 16384;
+  uint32_t received = serialLine.received;
+  while (hostCycles < end && serialLine.received == received)
+  {
+    uint64_t next = serialLine.nextEvent();
+    hostAdvance((next > hostCycles && next < end ? next : end) - hostCycles);
+  }
+}
+
+uint8_t digitalPinToPort(uint8_t pin)
+{
+  return pin < 8 ? PD : pin < 14 ? PB : PC;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin)
+{
+  return 1 << (pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14);
+}
+
+IoReg8 *portInputRegister(uint8_t port)
+{
+  return port == PB ? &PINB : port == PC ? &PINC : &PIND;
+}
+
+IoReg8 *portOutputRegister(uint8_t port)
+{
+  return port == PB ? &PORTB : port == PC ? &PORTC : &PORTD;
+}
+
+IoReg8 *portModeRegister(uint8_t port)
+{
+  return port == PB ? &DDRB : port == PC ? &DDRC : &DDRD;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  uint8_t port = digitalPinToPort(pin);
+  uint8_t mask = digitalPinToBitMask(pin);
+  if (mode == OUTPUT)
+  {
+    *portModeRegister(port) |= mask;
+  }
+  else
+  {
+    *portModeRegister(port) &= ~mask;
+    if (mode == INPUT_PULLUP) *portOutputRegister(port) |= mask;
+    else                      *portOutputRegister(port) &= ~mask;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  uint8_t port = digitalPinToPort(pin);
+  uint8_t mask = digitalPinToBitMask(pin);
+  if (value) *portOutputRegister(port) |= mask;
+  else       *portOutputRegister(port) &= ~mask;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return (*portInputRegister(digitalPinToPort(pin)) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+  if (pin >= 14) pin -= 14;
+  ADMUX  = (1 << REFS0) | (pin & 0x07);
+  ADCSRA = (1 << ADEN) | (1 << ADSC) | 0b111;
+  while (ADCSRA & (1 << ADSC));
+  return ADC;
+}
+
+void HostSerial::begin(unsigned long baud)
+{
+  // UBRR0 and U2X as the Arduino core sets them
+  uint16_t setting = (F_CPU / 4 / baud - 1) / 2;
+  UCSR0A = 1 << U2X0;
+  if ((F_CPU == 16000000UL && baud == 57600) || setting > 4095)
+  {
+    UCSR0A  = 0;
+    setting = (F_CPU / 8 / baud - 1) / 2;
+  }
+  UBRR0 = setting;
+
+  this->baud = baud;
+  rxHead = rxTail = 0;
+  serialLine.next = hostCycles;
+  if (fdIn >= 0) fcntl(fdIn, F_SETFL, fcntl(fdIn, F_GETFL) | O_NONBLOCK);
+}
+
+void HostSerial::end()
+{
+}
+
+/**
+ * Store a received character, lost if the buffer is full
+ */
+void HostSerial::hostReceive(uint8_t c)
+{
+  uint8_t head = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+  if (head == rxTail)
+  {
+    rxDropped++;
+    return;
+  }
+  rxBuf[rxHead] = c;
+  rxHead        = head;
+}
+
+int HostSerial::available()
+{
+  hostAdvance(HOST_CALL_CYCLES);
+  return (rxHead - rxTail + SERIAL_RX_BUFFER_SIZE) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HostSerial::peek()
+{
+  return available() ? rxBuf[rxTail] : -1;
+}
+
+int HostSerial::read()
+{
+  int c = peek();
+  if (c >= 0) rxTail = (rxTail + 1) % SERIAL_RX_BUFFER_SIZE;
+  return c;
+}
+
+/**
+ * Wait until the characters queued have been sent
+ */
+void HostSerial::flush()
+{
+  if (txEnd > hostCycles) hostAdvance(txEnd - hostCycles);
+}
+
+int HostSerial::availableForWrite()
+{
+  if (!baud || txEnd <= hostCycles) return SERIAL_TX_BUFFER_SIZE - 1;
+  uint64_t queued = (txEnd - hostCycles) / (F_CPU * 10 / baud);
+  return queued >= SERIAL_TX_BUFFER_SIZE - 1 ? 0 : SERIAL_TX_BUFFER_SIZE - 1 - (int)queued;
+}
+
+/**
+ * Wait up to the timeout for the next character, one ms of virtual time per try
+ */
+int HostSerial::timedPeek()
+{
+  unsigned long start = millis();
+  do
+  {
+    int c = peek();
+    if (c >= 0) return c;
+    delay(1);
+  } while (millis() - start < timeout);
+  return -1;
+}
+
+/**
+ * Stream::parseInt(): skip to the first digit or minus sign, then read the number
+ */
+long HostSerial::parseInt()
+{
+  int c;
+  while ((c = timedPeek()) >= 0 && c != '-' && (c < '0' || c > '9')) read();
+  if (c < 0) return 0;
+
+  bool neg   = false;
+  long value = 0;
+  do
+  {
+    if (c == '-') neg = true;
+    else          value = value * 10 + c - '0';
+    read();
+    c = timedPeek();
+  } while (c >= '0' && c <= '9');
+  return neg ? -value : value;
+}
+
+size_t HostSerial::write(const uint8_t *buf, size_t n)
+{
+  if (baud)
+  {
+    uint64_t cycles = F_CPU * 10 / baud;
+    for (size_t i = 0; i < n; i++)
+    {
+      if (txEnd < hostCycles) txEnd = hostCycles;
+      if (txEnd > hostCycles + SERIAL_TX_BUFFER_SIZE * cycles)
+        hostAdvance(txEnd - hostCycles - SERIAL_TX_BUFFER_SIZE * cycles);   // buffer full, wait
+      txEnd += cycles;
+    }
+  }
+
+  size_t done = 0;
+  while (fdOut >= 0 && done < n)
+  {
+    ssize_t w = ::write(fdOut, buf + done, n - done);
+    if (w > 0)
+    {
+      done += w;
+      continue;
+    }
+    if (w < 0 && errno == EINTR) continue;
+    if (w < 0 && errno != EAGAIN) break;
+    pollfd p = { fdOut, POLLOUT, 0 };
+    if (poll(&p, 1, HOST_WRITE_WAIT) <= 0) break;     // nobody reads
+  }
+  return n;
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HostSerial::print(const char *s)
+{
+  return write((const uint8_t *)s, strlen(s));
+}
+
+size_t HostSerial::print(char c)
+{
+  return write((uint8_t)c);
+}
+
+size_t HostSerial::print(long n, int base)
+{
+  if (n < 0 && base == DEC) return print('-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t HostSerial::print(unsigned long n, int base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *p = buf + sizeof(buf) - 1;
+  *p = 0;
+  if (base < 2) base = 10;
+  do
+  {
+    uint8_t d = n % base;
+    *--p = d < 10 ? '0' + d : 'A' + d - 10;
+    n /= base;
+  } while (n);
+  return print(p);
+}
+
+size_t HostSerial::print(double d, int digits)
+{
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, d);
+  return print(buf);
+}
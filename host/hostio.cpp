@@ -0,0 +1,346 @@
+/**
+ * Program      hostio.cpp
+ *
+ * Purpose      Host build: the register file, the ports B, C and D, the pin change
+ *              interrupts and the interrupt dispatch of the ATmega328P, plus the
+ *              virtual clock that runs the simulated peripherals
+ *
+ * Formulas     Every register access takes 1 CPU cycle (2 for 16-bit registers),
+ *              so busy waits on a flag or on SREG make progress
+ *
+ *              pin level = DDR ? (peripheral ? OC : PORT) : (driven ? input : PORT)
+ *
+ *              An input that is neither driven nor pulled up floats (z in the VCD)
+ *              and reads as 0.
+ *
+ * Remarks      Interrupts are taken after the register access or the clock step
+ *              that raises them, in the order of the vector table, with the I bit
+ *              cleared while the vector runs.
+ *
+ *              Of Timer0 only TCNT0 is modelled, counting with fcpu / 64 as set up by
+ *              the core. millis() and micros() come from the clock (see core.cpp).
+ */
+#include "hostio.h"
+#include "vcd.h"
+
+extern "C"
+{
+#define HOST_VECTOR(n) void __vector_##n(void) __attribute__((weak));
+  HOST_VECTOR(1)  HOST_VECTOR(2)  HOST_VECTOR(3)  HOST_VECTOR(4)  HOST_VECTOR(5)
+  HOST_VECTOR(6)  HOST_VECTOR(7)  HOST_VECTOR(8)  HOST_VECTOR(9)  HOST_VECTOR(10)
+  HOST_VECTOR(11) HOST_VECTOR(12) HOST_VECTOR(13) HOST_VECTOR(14) HOST_VECTOR(15)
+  HOST_VECTOR(16) HOST_VECTOR(17) HOST_VECTOR(18) HOST_VECTOR(19) HOST_VECTOR(20)
+  HOST_VECTOR(21) HOST_VECTOR(22) HOST_VECTOR(23) HOST_VECTOR(24) HOST_VECTOR(25)
+}
+
+static void (* const vectors[26])(void) =
+{
+  nullptr,     __vector_1,  __vector_2,  __vector_3,  __vector_4,  __vector_5,
+  __vector_6,  __vector_7,  __vector_8,  __vector_9,  __vector_10, __vector_11,
+  __vector_12, __vector_13, __vector_14, __vector_15, __vector_16, __vector_17,
+  __vector_18, __vector_19, __vector_20, __vector_21, __vector_22, __vector_23,
+  __vector_24, __vector_25,
+};
+
+constexpr uint8_t ADDR_PINB   = 0x23;
+constexpr uint8_t ADDR_PORTD  = 0x2B;
+constexpr uint8_t ADDR_PCIFR  = 0x3B;
+constexpr uint8_t ADDR_TCNT0  = 0x46;
+constexpr uint8_t ADDR_SREG   = 0x5F;
+constexpr uint8_t ADDR_PCICR  = 0x68;
+constexpr uint8_t ADDR_PCMSK0 = 0x6B;
+
+constexpr uint8_t VECT_PCINT0 = 3;
+constexpr uint8_t PORTS       = 3;            // B, C, D
+
+typedef struct
+{
+  uint8_t port, ddr;
+  uint8_t driven, input;                      // levels from outside
+  uint8_t ovrMask, ovrLevel;                  // pins driven by a peripheral
+  uint8_t level, floating;                    // resulting pin levels
+} Port;
+
+uint64_t hostCycles = 0;
+
+static uint8_t     io[256];
+static Port        ports[PORTS] = { { 0, 0, 0, 0, 0, 0, 0, 0xFF }, { 0, 0, 0, 0, 0, 0, 0, 0xFF }, { 0, 0, 0, 0, 0, 0, 0, 0xFF } };
+static HostDevice *devices[8];
+static uint8_t     nbrDevices = 0;
+
+void hostAddDevice(HostDevice *device)
+{
+  devices[nbrDevices++] = device;
+}
+
+/**
+ * Port index and bit of an Arduino pin
+ */
+static void pinToPort(uint8_t pin, uint8_t &p, uint8_t &bit)
+{
+  if (pin < 8)       { p = 2; bit = pin; }
+  else if (pin < 14) { p = 0; bit = pin - 8; }
+  else               { p = 1; bit = pin - 14; }
+}
+
+static uint8_t portToPin(uint8_t p, uint8_t bit)
+{
+  static const uint8_t first[PORTS] = { 8, 14, 0 };
+  return first[p] + bit;
+}
+
+/**
+ * Compute the levels of a port, record and signal the changes
+ */
+static void updatePort(uint8_t p)
+{
+  Port   &r   = ports[p];
+  uint8_t out = (r.ovrMask & r.ovrLevel) | (~r.ovrMask & r.port);
+  uint8_t lvl = (r.ddr & out) | (~r.ddr & r.driven & r.input) | (~r.ddr & ~r.driven & r.port);
+  uint8_t flt = ~r.ddr & ~r.driven & ~r.port;
+  uint8_t chg = (lvl ^ r.level) | (flt ^ r.floating);
+  if (!chg) return;
+
+  uint8_t edges = lvl ^ r.level;
+  r.level    = lvl;
+  r.floating = flt;
+  for (uint8_t bit = 0; bit < 8; bit++)
+  {
+    if (!(chg & (1 << bit))) continue;
+    uint8_t pin = portToPin(p, bit);
+    vcdPin(pin, (flt & (1 << bit)) ? -1 : (lvl >> bit) & 1);
+    if (edges & (1 << bit))
+    {
+      for (uint8_t i = 0; i < nbrDevices; i++) devices[i]->pinChanged(pin, (lvl >> bit) & 1);
+    }
+  }
+  if (edges & io[ADDR_PCMSK0 + p]) io[ADDR_PCIFR] |= 1 << p;   // PCMSK0, 1, 2 in this order
+}
+
+void hostSetPinOverride(uint8_t pin, bool on, bool level)
+{
+  uint8_t p, bit;
+  pinToPort(pin, p, bit);
+  uint8_t m = 1 << bit;
+  ports[p].ovrMask  = on ? ports[p].ovrMask | m : ports[p].ovrMask & ~m;
+  ports[p].ovrLevel = level ? ports[p].ovrLevel | m : ports[p].ovrLevel & ~m;
+  updatePort(p);
+}
+
+void hostSetInput(uint8_t pin, bool level)
+{
+  uint8_t p, bit;
+  pinToPort(pin, p, bit);
+  ports[p].driven |= 1 << bit;
+  ports[p].input   = level ? ports[p].input | 1 << bit : ports[p].input & ~(1 << bit);
+  updatePort(p);
+  hostDispatch();
+}
+
+void hostReleaseInput(uint8_t pin)
+{
+  uint8_t p, bit;
+  pinToPort(pin, p, bit);
+  ports[p].driven &= ~(1 << bit);
+  updatePort(p);
+}
+
+int hostPinLevel(uint8_t pin)
+{
+  uint8_t p, bit;
+  pinToPort(pin, p, bit);
+  if (ports[p].floating & (1 << bit)) return -1;
+  return (ports[p].level >> bit) & 1;
+}
+
+/**
+ * Take the pending interrupts while the I bit is set
+ */
+void hostDispatch()
+{
+  while (io[ADDR_SREG] & 0x80)
+  {
+    uint8_t     vector = 0xFF;
+    HostDevice *source = nullptr;
+
+    uint8_t pc = io[ADDR_PCIFR] & io[ADDR_PCICR] & 0x07;
+    if (pc) vector = VECT_PCINT0 + __builtin_ctz(pc);
+    for (uint8_t i = 0; i < nbrDevices; i++)
+    {
+      uint8_t v = devices[i]->pending();
+      if (v && v < vector)
+      {
+        vector = v;
+        source = devices[i];
+      }
+    }
+    if (vector == 0xFF) return;
+
+    if (source) source->acknowledge(vector);
+    else        io[ADDR_PCIFR] &= ~(1 << (vector - VECT_PCINT0));
+    io[ADDR_SREG] &= 0x7F;
+    if (vectors[vector]) vectors[vector]();
+    io[ADDR_SREG] |= 0x80;                                      // reti
+  }
+}
+
+/**
+ * Run the peripherals event by event for cycles CPU cycles
+ */
+void hostAdvance(uint64_t cycles)
+{
+  uint64_t target = hostCycles + cycles;
+  hostDispatch();
+  while (hostCycles < target)
+  {
+    uint64_t next = target;
+    for (uint8_t i = 0; i < nbrDevices; i++)
+    {
+      uint64_t e = devices[i]->nextEvent();
+      if (e < next) next = e;
+    }
+    if (next <= hostCycles) next = hostCycles + 1;
+    hostCycles = next;
+    for (uint8_t i = 0; i < nbrDevices; i++) devices[i]->run(next);
+    hostDispatch();
+  }
+}
+
+uint8_t hostRead8(uint8_t addr)
+{
+  hostAdvance(1);
+  uint8_t v;
+  for (uint8_t i = 0; i < nbrDevices; i++)
+  {
+    if (devices[i]->read(addr, v)) return v;
+  }
+  if (addr >= ADDR_PINB && addr <= ADDR_PORTD)
+  {
+    Port &r = ports[(addr - ADDR_PINB) / 3];
+    switch ((addr - ADDR_PINB) % 3)
+    {
+      case 0:  return r.level;
+      case 1:  return r.ddr;
+      default: return r.port;
+    }
+  }
+  if (addr == ADDR_TCNT0) return (uint8_t)(hostCycles / 64);
+  return io[addr];
+}
+
+void hostWrite8(uint8_t addr, uint8_t v)
+{
+  hostAdvance(1);
+  bool handled = false;
+  for (uint8_t i = 0; i < nbrDevices && !handled; i++)
+  {
+    handled = devices[i]->write(addr, v);
+  }
+  if (!handled)
+  {
+    if (addr >= ADDR_PINB && addr <= ADDR_PORTD)
+    {
+      uint8_t p = (addr - ADDR_PINB) / 3;
+      switch ((addr - ADDR_PINB) % 3)
+      {
+        case 0:  ports[p].port ^= v; break;                     // a one toggles PORTx
+        case 1:  ports[p].ddr   = v; break;
+        default: ports[p].port  = v; break;
+      }
+      updatePort(p);
+    }
+    else if (addr == ADDR_PCIFR)
+    {
+      io[addr] &= ~v;                                           // a one clears the flag
+    }
+    else
+    {
+      io[addr] = v;
+    }
+  }
+  hostDispatch();
+}
+
+uint16_t hostRead16(uint8_t addr)
+{
+  hostAdvance(2);
+  uint16_t v;
+  for (uint8_t i = 0; i < nbrDevices; i++)
+  {
+    if (devices[i]->read16(addr, v)) return v;
+  }
+  return io[addr] | io[(uint8_t)(addr + 1)] << 8;
+}
+
+void hostWrite16(uint8_t addr, uint16_t v)
+{
+  hostAdvance(2);
+  bool handled = false;
+  for (uint8_t i = 0; i < nbrDevices && !handled; i++)
+  {
+    handled = devices[i]->write16(addr, v);
+  }
+  if (!handled)
+  {
+    io[addr] = v;
+    io[(uint8_t)(addr + 1)] = v >> 8;
+  }
+  hostDispatch();
+}
+
+/**
+ * Square wave of hz on an input pin, e.g. a reference for the PLL or
+ * the PPS on pin 8. The half period is kept in 1/256 CPU cycles
+ */
+class SquareSource : public HostDevice
+{
+public:
+  uint8_t  pin   = 0;
+  uint64_t half  = 0;                         // half period, 8 fractional bits
+  uint64_t edge  = HOST_NEVER;                // next edge, 8 fractional bits
+  bool     level = false;
+
+  uint64_t nextEvent() override { return edge == HOST_NEVER ? HOST_NEVER : (edge + 255) >> 8; }
+  void run(uint64_t until) override
+  {
+    while (edge != HOST_NEVER && (edge + 255) >> 8 <= until)
+    {
+      level = !level;
+      edge += half;
+      hostSetInput(pin, level);
+    }
+  }
+};
+
+static SquareSource sources[4];
+
+void hostDriveInput(uint8_t pin, double hz)
+{
+  SquareSource *s = nullptr;
+  for (SquareSource &q : sources)
+  {
+    if (q.pin == pin && q.edge != HOST_NEVER) s = &q;
+  }
+  if (!s)
+  {
+    for (SquareSource &q : sources)
+    {
+      if (q.edge == HOST_NEVER && !s) s = &q;
+    }
+    if (!s) return;
+    bool known = false;
+    for (uint8_t i = 0; i < nbrDevices; i++) known |= devices[i] == s;
+    if (!known) hostAddDevice(s);
+  }
+  if (hz <= 0)
+  {
+    s->edge = HOST_NEVER;
+    hostReleaseInput(pin);
+    return;
+  }
+  s->pin   = pin;
+  s->half  = (uint64_t)(F_CPU * 128.0 / hz + 0.5);
+  s->edge  = ((hostCycles + 1) << 8) + s->half;
+  s->level = false;
+  hostSetInput(pin, false);
+}
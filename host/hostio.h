@@ -0,0 +1,35 @@
+#pragma once
+/**
+ * Host build: simulated peripherals, pins and interrupts of the ATmega328P
+ */
+#include <Arduino.h>
+
+/**
+ * A simulated peripheral. It keeps its own time and is run up to the
+ * CPU cycle of its next event, or further when nothing happens before
+ */
+class HostDevice
+{
+public:
+  virtual ~HostDevice() {}
+  virtual uint64_t nextEvent() = 0;                             // CPU cycle of the next event
+  virtual void     run(uint64_t until) = 0;                     // simulate up to and including until
+  virtual bool     read(uint8_t addr, uint8_t &v)     { return false; }
+  virtual bool     write(uint8_t addr, uint8_t v)     { return false; }
+  virtual bool     read16(uint8_t addr, uint16_t &v)  { return false; }
+  virtual bool     write16(uint8_t addr, uint16_t v)  { return false; }
+  virtual uint8_t  pending()                          { return 0; } // lowest vector with a pending interrupt
+  virtual void     acknowledge(uint8_t vector)        {}            // vector taken, clear its flag
+  virtual void     pinChanged(uint8_t pin, bool level) {}
+};
+
+constexpr uint64_t HOST_NEVER = ~0ULL;
+
+void init();                                           // register the peripherals, sei()
+void hostAddDevice(HostDevice *device);
+void hostDispatch();                                    // take the pending interrupts
+void hostSetPinOverride(uint8_t pin, bool on, bool level);
+void hostSetInput(uint8_t pin, bool level);            // level driven from outside
+void hostReleaseInput(uint8_t pin);
+int  hostPinLevel(uint8_t pin);                         // 0, 1 or -1 when floating
+void hostDriveInput(uint8_t pin, double hz);            // square wave on an input pin, 0 = off
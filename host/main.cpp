@@ -0,0 +1,125 @@
+/**
+ * Program      main.cpp
+ *
+ * Purpose      Host build: runs the whole sketch, setup() and loop(), as a Linux
+ *              process. Serial is bound to a pseudo terminal, so a terminal program
+ *              or a test script talks to the menu as to the board
+ *
+ *              uno [-l link] [-s speed] [-n ms] [-o file.vcd] [-a pin=mV] [-t degC]
+ *
+ *              -l link     symbolic link to the pty, e.g. /tmp/ttyUNO
+ *              -s speed    virtual time / wall time, 0 = as fast as possible (default)
+ *              -n ms       stop after ms of virtual time
+ *              -o file     write the pin edges as VCD
+ *              -a pin=mV   level on A0 .. A5, e.g. -a 0=2500
+ *              -t degC     chip temperature for the temperature sensor
+ *
+ * Remarks      The slave side of the pty is raw (no echo, no line editing). Send a
+ *              menu key and its values in one write, e.g. "e1000\n": the sketch reads
+ *              them after delay(2000), which takes no wall time at speed 0.
+ *
+ *              Timer1, the ports, the pin change interrupts and the ADC are simulated
+ *              (see hostio.cpp), Timer2 is not.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include "hostio.h"
+#include "adcsim.h"
+#include "vcd.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void onSignal(int)
+{
+  stop = 1;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: uno [-l link] [-s speed] [-n ms] [-o file.vcd] [-a pin=mV] [-t degC]\n");
+  exit(2);
+}
+
+/**
+ * Open a pty with a raw slave side, return the master
+ */
+static int openPty(const char *link)
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) return -1;
+
+  const char *name  = ptsname(master);
+  int         slave = open(name, O_RDWR | O_NOCTTY);     // kept open, so the master
+  if (slave < 0) return -1;                              // survives a client closing
+  termios t;
+  tcgetattr(slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+
+  if (link)
+  {
+    unlink(link);
+    if (symlink(name, link)) perror(link);
+  }
+  fprintf(stderr, "uno: serial on %s%s%s\n", name, link ? " -> " : "", link ? link : "");
+  return master;
+}
+
+int main(int argc, char *argv[])
+{
+  const char   *link  = nullptr;
+  const char   *vcd   = nullptr;
+  unsigned long limit = 0;
+  int           opt;
+
+  while ((opt = getopt(argc, argv, "l:s:n:o:a:t:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'l': link      = optarg;                  break;
+      case 's': hostSpeed = atof(optarg);            break;
+      case 'n': limit     = strtoul(optarg, nullptr, 0); break;
+      case 'o': vcd       = optarg;                  break;
+      case 't': adc.temperature = (int16_t)(atof(optarg) * 10); break;
+      case 'a':
+      {
+        unsigned pin, mV;
+        if (sscanf(optarg, "%u=%u", &pin, &mV) != 2 || pin > 5) usage();
+        adc.mV[pin] = mV;
+        break;
+      }
+      default: usage();
+    }
+  }
+
+  int pty = openPty(link);
+  if (pty < 0)
+  {
+    perror("uno: pty");
+    return 1;
+  }
+  signal(SIGINT,  onSignal);
+  signal(SIGTERM, onSignal);
+
+  init();
+  Serial.fdIn  = pty;
+  Serial.fdOut = pty;
+  if (vcd && !vcdOpen(vcd))
+  {
+    perror(vcd);
+    return 1;
+  }
+
+  setup();
+  while (!stop && (!limit || hostCycles / (F_CPU / 1000) < limit))
+  {
+    loop();
+    hostPace();
+  }
+
+  vcdClose();
+  if (link) unlink(link);
+  return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * Program      t1sim.cpp
+ *
+ * Purpose      Host build: runs the register writes of the generator functions on
+ *              the Timer1 model and writes the pin edges as VCD for GTKWave
+ *
+ *              t1sim [-o file.vcd] [-q] command ...
+ *
+ *              f <Hz>     setFrequency()        p <us>    setPeriod()
+ *              o          toggleOutputPin()     d <mHz>   ddsStart()
+ *              ref <Hz>   square wave on pin 8  l <N> <M> pllStart()
+ *              s          printRegisterSettings()
+ *              run <ms>   simulate ms
+ *
+ *              e.g. t1sim -o out.vcd f 1000 run 5 o run 5 f 20000 run 1
+ *
+ * Remarks      At the end the number of timer clocks simulated per second of wall
+ *              time is printed to stderr.
+ */
+#include <time.h>
+#include "hostio.h"
+#include "timer1sim.h"
+#include "vcd.h"
+#include "generator.h"
+#include "dds.h"
+#include "pll.h"
+
+extern uint8_t pinOut;
+
+static double wallTime()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: t1sim [-o file.vcd] [-q] {f Hz | p us | o | d mHz | ref Hz | l N M | s | run ms} ...\n");
+  exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+  int i = 1;
+  init();
+  Serial.begin(115200);
+  pinMode(LED_BUILTIN, OUTPUT);
+  pinMode(9, OUTPUT);
+  pinMode(10, OUTPUT);
+
+  for (; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (!strcmp(argv[i], "-q"))
+    {
+      Serial.fdOut = -1;
+    }
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+    {
+      if (!vcdOpen(argv[++i]))
+      {
+        perror(argv[i]);
+        return 1;
+      }
+    }
+    else usage();
+  }
+
+  double start = wallTime();
+  for (; i < argc; i++)
+  {
+    const char *cmd = argv[i];
+    bool        arg = i + 1 < argc;
+
+    if      (!strcmp(cmd, "f") && arg)   setFrequency(strtoul(argv[++i], nullptr, 0), pinOut);
+    else if (!strcmp(cmd, "p") && arg)   setPeriod(strtoul(argv[++i], nullptr, 0), pinOut);
+    else if (!strcmp(cmd, "o"))          toggleOutputPin();
+    else if (!strcmp(cmd, "d") && arg)   ddsStart(strtoul(argv[++i], nullptr, 0), pinOut);
+    else if (!strcmp(cmd, "ref") && arg) hostDriveInput(8, atof(argv[++i]));
+    else if (!strcmp(cmd, "l") && i + 2 < argc)
+    {
+      uint16_t n = strtoul(argv[++i], nullptr, 0);
+      pllStart(n, strtoul(argv[++i], nullptr, 0), pinOut);
+    }
+    else if (!strcmp(cmd, "s"))          printRegisterSettings();
+    else if (!strcmp(cmd, "run") && arg) delay(strtoul(argv[++i], nullptr, 0));
+    else usage();
+    Serial.println();
+  }
+  double wall = wallTime() - start;
+  vcdClose();
+
+  fprintf(stderr, "t1sim: %.3f ms simulated, %llu timer clocks in %.3f s, %.1f M clocks/s\n",
+          hostCycles * 1000.0 / F_CPU, (unsigned long long)timer1.ticks, wall,
+          wall > 0 ? timer1.ticks / wall / 1e6 : 0.0);
+  return 0;
+}
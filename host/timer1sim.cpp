@@ -0,0 +1,418 @@
+/**
+ * Program      timer1sim.cpp
+ *
+ * Purpose      Host build: cycle accurate model of Timer1 of the ATmega328P in all
+ *              waveform generation modes (normal, CTC, fast PWM, phase correct,
+ *              phase and frequency correct), with prescaler, compare outputs OC1A
+ *              (pin 9) and OC1B (pin 10), input capture on ICP1 (pin 8) and the
+ *              flags and interrupts TOV1, OCF1A, OCF1B, ICF1
+ *
+ * Formulas     The prescaler runs free from reset, the timer clocks at every CPU
+ *              cycle that is a multiple of 1, 8, 64, 256 or 1024.
+ *
+ *              Matches, TOP, BOTTOM and MAX act at the timer clock that leaves the
+ *              value, as in the timing diagrams of the datasheet: in CTC mode with
+ *              OCR1A = 3 the counter shows 0 1 2 3 and OCF1A is set and OC1A toggles
+ *              with the step from 3 to 0.
+ *
+ *              Between events the counter is advanced in one step, so a run costs
+ *              time per event, not per timer clock: a 1 kHz square wave at prescaler
+ *              1 has 2 events per 8'000 clocks.
+ *
+ * Remarks      Modelled quirks of the datasheet
+ *              - OCR1A/B are double buffered in the PWM modes, updated at BOTTOM
+ *                (fast PWM, phase and frequency correct) or at TOP (phase correct).
+ *                In normal and CTC mode a write is effective at once
+ *              - CTC with OCR1A written below TCNT1: the counter runs to MAX (0xFFFF),
+ *                sets TOV1 and wraps, the glitch setFrequency() avoids with
+ *                timer1WriteOCR1AAtMatch()
+ *              - a write to TCNT1 blocks the compare matches of the next timer clock
+ *              - COM1A = 1 toggles OC1A in the PWM modes only with TOP = OCR1A or ICR1
+ *                (modes 9, 11, 14, 15), else OC1A and OC1B are disconnected
+ *              - fast PWM with OCR1x = TOP gives a constant level, OCR1x = BOTTOM a
+ *                spike of one timer clock, phase correct with OCR1x = 0 or TOP a
+ *                constant low or high output
+ *              - FOC1A/B force a compare match in the non-PWM modes
+ *              - ICR1 as TOP (modes 8, 10, 12, 14) disables the input capture
+ *
+ *              Simplifications: the firmware runs in zero time between register
+ *              accesses, interrupts are taken without latency, the dual slope modes
+ *              turn at TOP also when TCNT1 has been set above it, and the noise
+ *              canceler is not modelled.
+ */
+#include "timer1sim.h"
+
+Timer1Sim timer1;
+
+constexpr uint8_t ADDR_TIFR1  = 0x36;
+constexpr uint8_t ADDR_TIMSK1 = 0x6F;
+constexpr uint8_t ADDR_TCCR1A = 0x80;
+constexpr uint8_t ADDR_TCCR1B = 0x81;
+constexpr uint8_t ADDR_TCCR1C = 0x82;
+constexpr uint8_t ADDR_TCNT1  = 0x84;
+constexpr uint8_t ADDR_ICR1   = 0x86;
+constexpr uint8_t ADDR_OCR1A  = 0x88;
+constexpr uint8_t ADDR_OCR1B  = 0x8A;
+
+constexpr uint8_t VECT_CAPT   = 10;
+constexpr uint8_t VECT_COMPA  = 11;
+constexpr uint8_t VECT_COMPB  = 12;
+constexpr uint8_t VECT_OVF    = 13;
+
+void Timer1Sim::reset()
+{
+  *this = Timer1Sim();
+  time  = hostCycles;
+}
+
+Timer1Sim::Kind Timer1Sim::kind() const
+{
+  switch (wgm())
+  {
+    case 4: case 12:                          return CTC;
+    case 5: case 6: case 7: case 14: case 15: return FAST;
+    case 1: case 2: case 3: case 10: case 11: return PHASE;
+    case 8: case 9:                           return PHASE_FREQ;
+    default:                                  return NORMAL;
+  }
+}
+
+uint16_t Timer1Sim::top() const
+{
+  switch (wgm())
+  {
+    case 1: case 5:                 return 0x00FF;
+    case 2: case 6:                 return 0x01FF;
+    case 3: case 7:                 return 0x03FF;
+    case 4: case 9: case 11: case 15: return ocr[0];
+    case 8: case 10: case 12: case 14: return icr;
+    default:                        return 0xFFFF;
+  }
+}
+
+uint16_t Timer1Sim::prescaler() const
+{
+  static const uint16_t pre[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };  // 6, 7: external clock on T1, not modelled
+  return pre[tccr1b & 7];
+}
+
+/**
+ * Compare output in use: COM1x = 1 only toggles OC1A in the
+ * non-PWM modes and the PWM modes with a variable TOP
+ */
+bool Timer1Sim::connected(uint8_t ch) const
+{
+  uint8_t c = com(ch);
+  if (c == 0) return false;
+  if (c == 1 && kind() != NORMAL && kind() != CTC)
+  {
+    uint8_t m = wgm();
+    return ch == 0 && (m == 9 || m == 11 || m == 14 || m == 15);
+  }
+  return true;
+}
+
+/**
+ * Timer clocks until the next one that leaves a value with an event
+ */
+uint32_t Timer1Sim::ticksToEvent() const
+{
+  if (block) return 1;
+  uint16_t t = top();
+  uint32_t k = 0x10000;
+
+  if (kind() == PHASE || kind() == PHASE_FREQ)
+  {
+    if (!down)
+    {
+      if (tcnt >= t) return 1;
+      uint16_t c[] = { ocr[0], ocr[1], (uint16_t)(t - 1), t };
+      for (uint16_t v : c) if (v >= tcnt && (uint32_t)(v - tcnt) < k) k = v - tcnt;
+    }
+    else
+    {
+      uint16_t c[] = { ocr[0], ocr[1], 1, 0 };
+      for (uint16_t v : c) if (v <= tcnt && (uint32_t)(tcnt - v) < k) k = tcnt - v;
+    }
+  }
+  else
+  {
+    uint16_t c[] = { ocr[0], ocr[1], t, 0xFFFF };
+    for (uint16_t v : c) if (v >= tcnt && (uint32_t)(v - tcnt) < k) k = v - tcnt;
+  }
+  return k + 1;
+}
+
+/**
+ * Count n clocks without an event
+ */
+void Timer1Sim::skip(uint32_t n)
+{
+  tcnt   = down ? tcnt - n : tcnt + n;
+  ticks += n;
+}
+
+/**
+ * Compare match of channel ch while counting up or down
+ */
+void Timer1Sim::match(uint8_t ch, bool up)
+{
+  tifr |= ch ? 1 << OCF1B : 1 << OCF1A;
+  if (!connected(ch)) return;
+
+  uint8_t c = com(ch);
+  if (c == 1)                                     setOc(ch, !oc[ch]);
+  else if (kind() == PHASE || kind() == PHASE_FREQ) setOc(ch, (c == 2) != up);
+  else                                            setOc(ch, c == 3);
+}
+
+/**
+ * Fast PWM at BOTTOM: update the compare registers, set (clear) the outputs
+ */
+void Timer1Sim::bottom()
+{
+  ocr[0] = ocrBuf[0];
+  ocr[1] = ocrBuf[1];
+  for (uint8_t ch = 0; ch < 2; ch++)
+  {
+    if (connected(ch) && com(ch) >= 2) setOc(ch, com(ch) == 2);
+  }
+}
+
+/**
+ * One timer clock
+ */
+void Timer1Sim::tick()
+{
+  uint16_t t       = top();
+  uint16_t v       = tcnt;
+  bool     blocked = block;
+  Kind     k       = kind();
+
+  block = false;
+  ticks++;
+
+  if (k == PHASE || k == PHASE_FREQ)
+  {
+    bool up = !down;
+    for (uint8_t ch = 0; ch < 2 && !blocked; ch++)
+    {
+      if (v != ocr[ch]) continue;
+      if (v == t)      match(ch, false);           // OCR1x = TOP: constant high
+      else if (v == 0) match(ch, true);            // OCR1x = BOTTOM: constant low
+      else             match(ch, up);
+    }
+    if (up)
+    {
+      if (v >= t)
+      {
+        down = true;
+        tcnt = v - 1;
+      }
+      else
+      {
+        tcnt = v + 1;
+        if (tcnt == t)
+        {
+          if (k == PHASE) { ocr[0] = ocrBuf[0]; ocr[1] = ocrBuf[1]; }
+          if (wgm() == 8 || wgm() == 10) tifr |= 1 << ICF1;
+        }
+      }
+    }
+    else
+    {
+      if (v == 0)
+      {
+        down = false;
+        tcnt = 1;
+      }
+      else
+      {
+        tcnt = v - 1;
+        if (tcnt == 0)
+        {
+          tifr |= 1 << TOV1;
+          if (k == PHASE_FREQ) { ocr[0] = ocrBuf[0]; ocr[1] = ocrBuf[1]; }
+        }
+      }
+    }
+    return;
+  }
+
+  for (uint8_t ch = 0; ch < 2 && !blocked; ch++)
+  {
+    if (v == ocr[ch]) match(ch, true);
+  }
+  if (v == t && k != NORMAL)
+  {
+    tcnt = 0;
+    if (wgm() == 12 || wgm() == 14) tifr |= 1 << ICF1;
+    if (k == FAST)
+    {
+      tifr |= 1 << TOV1;
+      bottom();
+    }
+  }
+  else if (v == 0xFFFF)
+  {
+    tcnt  = 0;
+    tifr |= 1 << TOV1;
+    if (k == FAST) bottom();
+  }
+  else
+  {
+    tcnt = v + 1;
+  }
+}
+
+void Timer1Sim::setOc(uint8_t ch, bool level)
+{
+  if (oc[ch] == level) return;
+  oc[ch] = level;
+  hostSetPinOverride(ch ? 10 : 9, connected(ch), level);
+}
+
+void Timer1Sim::updatePins()
+{
+  hostSetPinOverride(9,  connected(0), oc[0]);
+  hostSetPinOverride(10, connected(1), oc[1]);
+}
+
+uint64_t Timer1Sim::nextEvent()
+{
+  uint16_t p = prescaler();
+  if (!p) return HOST_NEVER;
+  uint64_t first = (time / p + 1) * p;
+  return first + (uint64_t)(ticksToEvent() - 1) * p;
+}
+
+void Timer1Sim::run(uint64_t until)
+{
+  while (time < until)
+  {
+    uint16_t p = prescaler();
+    if (!p) break;
+    uint64_t first = (time / p + 1) * p;
+    if (first > until) break;
+    uint32_t k  = ticksToEvent();
+    uint64_t ev = first + (uint64_t)(k - 1) * p;
+    if (ev > until)
+    {
+      skip((until - first) / p + 1);
+      break;
+    }
+    skip(k - 1);
+    time = ev;
+    tick();
+  }
+  time = until;
+}
+
+bool Timer1Sim::read(uint8_t addr, uint8_t &v)
+{
+  switch (addr)
+  {
+    case ADDR_TCCR1A: v = tccr1a; return true;
+    case ADDR_TCCR1B: v = tccr1b; return true;
+    case ADDR_TCCR1C: v = 0;      return true;
+    case ADDR_TIMSK1: v = timsk;  return true;
+    case ADDR_TIFR1:  v = tifr;   return true;
+  }
+  uint16_t w;
+  if (!read16(addr & ~1, w)) return false;
+  v = (addr & 1) ? w >> 8 : w;
+  return true;
+}
+
+bool Timer1Sim::write(uint8_t addr, uint8_t v)
+{
+  run(hostCycles);
+  switch (addr)
+  {
+    case ADDR_TCCR1A: tccr1a = v; updatePins(); return true;
+    case ADDR_TCCR1B: tccr1b = v; updatePins(); return true;
+    case ADDR_TIMSK1: timsk  = v & 0x27;        return true;
+    case ADDR_TIFR1:  tifr  &= ~v;              return true;     // a one clears the flag
+    case ADDR_TCCR1C:
+      if (kind() == NORMAL || kind() == CTC)
+      {
+        uint8_t f = tifr;
+        if (v & (1 << FOC1A)) match(0, true);
+        if (v & (1 << FOC1B)) match(1, true);
+        tifr = f;                                                // no flags, no clear
+      }
+      return true;
+  }
+  return false;
+}
+
+bool Timer1Sim::read16(uint8_t addr, uint16_t &v)
+{
+  run(hostCycles);
+  switch (addr)
+  {
+    case ADDR_TCNT1: v = tcnt;      return true;
+    case ADDR_ICR1:  v = icr;       return true;
+    case ADDR_OCR1A: v = ocrBuf[0]; return true;
+    case ADDR_OCR1B: v = ocrBuf[1]; return true;
+  }
+  return false;
+}
+
+bool Timer1Sim::write16(uint8_t addr, uint16_t v)
+{
+  run(hostCycles);
+  switch (addr)
+  {
+    case ADDR_TCNT1:
+      tcnt  = v;
+      block = true;
+      return true;
+    case ADDR_ICR1:
+      icr = v;
+      return true;
+    case ADDR_OCR1A:
+    case ADDR_OCR1B:
+    {
+      uint8_t ch = addr == ADDR_OCR1B;
+      ocrBuf[ch] = v;
+      if (kind() == NORMAL || kind() == CTC) ocr[ch] = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t Timer1Sim::pending()
+{
+  uint8_t p = tifr & timsk;
+  if (p & (1 << ICF1))  return VECT_CAPT;
+  if (p & (1 << OCF1A)) return VECT_COMPA;
+  if (p & (1 << OCF1B)) return VECT_COMPB;
+  if (p & (1 << TOV1))  return VECT_OVF;
+  return 0;
+}
+
+void Timer1Sim::acknowledge(uint8_t vector)
+{
+  switch (vector)
+  {
+    case VECT_CAPT:  tifr &= ~(1 << ICF1);  break;
+    case VECT_COMPA: tifr &= ~(1 << OCF1A); break;
+    case VECT_COMPB: tifr &= ~(1 << OCF1B); break;
+    case VECT_OVF:   tifr &= ~(1 << TOV1);  break;
+  }
+}
+
+/**
+ * Input capture on ICP1 (pin 8) with the edge selected by ICES1
+ */
+void Timer1Sim::pinChanged(uint8_t pin, bool level)
+{
+  if (pin != 8 || level != !!(tccr1b & (1 << ICES1))) return;
+  uint8_t m = wgm();
+  if (m == 8 || m == 10 || m == 12 || m == 14) return;  // ICR1 is TOP
+  run(hostCycles);
+  icr   = tcnt;
+  tifr |= 1 << ICF1;
+}
@@ -0,0 +1,50 @@
+#pragma once
+/**
+ * Host build: cycle accurate model of Timer1
+ */
+#include "hostio.h"
+
+class Timer1Sim : public HostDevice
+{
+public:
+  void     reset();
+  uint64_t nextEvent() override;
+  void     run(uint64_t until) override;
+  bool     read(uint8_t addr, uint8_t &v) override;
+  bool     write(uint8_t addr, uint8_t v) override;
+  bool     read16(uint8_t addr, uint16_t &v) override;
+  bool     write16(uint8_t addr, uint16_t v) override;
+  uint8_t  pending() override;
+  void     acknowledge(uint8_t vector) override;
+  void     pinChanged(uint8_t pin, bool level) override;
+
+  uint64_t ticks = 0;                 // timer clocks simulated so far
+
+private:
+  enum Kind { NORMAL, CTC, FAST, PHASE, PHASE_FREQ };
+
+  uint8_t  wgm() const   { return ((tccr1b >> 1) & 0x0C) | (tccr1a & 0x03); }
+  Kind     kind() const;
+  uint16_t top() const;
+  uint16_t prescaler() const;
+  uint8_t  com(uint8_t ch) const  { return (tccr1a >> (ch ? 4 : 6)) & 3; }
+  bool     connected(uint8_t ch) const;
+  uint32_t ticksToEvent() const;
+  void     skip(uint32_t n);
+  void     tick();
+  void     match(uint8_t ch, bool up);
+  void     bottom();
+  void     setOc(uint8_t ch, bool level);
+  void     updatePins();
+
+  uint8_t  tccr1a = 0, tccr1b = 0, timsk = 0, tifr = 0;
+  uint16_t tcnt = 0, icr = 0;
+  uint16_t ocr[2]    = { 0, 0 };      // compare registers in use
+  uint16_t ocrBuf[2] = { 0, 0 };      // double buffer of the PWM modes
+  bool     oc[2]     = { false, false };
+  bool     down  = false;             // dual slope modes: counting down
+  bool     block = false;             // TCNT1 written: no compare match on the next clock
+  uint64_t time  = 0;                 // CPU cycle simulated up to
+};
+
+extern Timer1Sim timer1;
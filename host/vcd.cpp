@@ -0,0 +1,71 @@
+/**
+ * Program      vcd.cpp
+ *
+ * Purpose      Host build: writes the level changes of the pins 0 .. 19 as VCD file,
+ *              one wire per pin, D0 .. D13 and A0 .. A5
+ *
+ * Formulas     time in ps = CPU cycle * 10^12 / F_CPU = cycle * 62'500
+ */
+#include <Arduino.h>
+#include "hostio.h"
+#include "vcd.h"
+
+constexpr uint8_t  VCD_PINS = 20;
+constexpr uint64_t VCD_PS   = 1000000000000ULL / F_CPU;
+
+static FILE    *vcdFile = nullptr;
+static uint64_t vcdTime = HOST_NEVER;
+
+static char levelChar(int level)
+{
+  return level < 0 ? 'z' : level ? '1' : '0';
+}
+
+/**
+ * Create the file, declare the wires and dump the current levels
+ */
+bool vcdOpen(const char *path)
+{
+  vcdClose();
+  vcdFile = fopen(path, "w");
+  if (!vcdFile) return false;
+  setvbuf(vcdFile, nullptr, _IOFBF, 1 << 16);
+
+  fprintf(vcdFile, "$timescale 1 ps $end\n$scope module uno $end\n");
+  for (uint8_t pin = 0; pin < VCD_PINS; pin++)
+  {
+    if (pin < 14) fprintf(vcdFile, "$var wire 1 %c D%u $end\n", '!' + pin, pin);
+    else          fprintf(vcdFile, "$var wire 1 %c A%u $end\n", '!' + pin, pin - 14);
+  }
+  fprintf(vcdFile, "$upscope $end\n$enddefinitions $end\n#%llu\n$dumpvars\n",
+          (unsigned long long)(hostCycles * VCD_PS));
+  for (uint8_t pin = 0; pin < VCD_PINS; pin++)
+  {
+    fprintf(vcdFile, "%c%c\n", levelChar(hostPinLevel(pin)), '!' + pin);
+  }
+  fprintf(vcdFile, "$end\n");
+  vcdTime = hostCycles;
+  return true;
+}
+
+void vcdClose()
+{
+  if (!vcdFile) return;
+  fprintf(vcdFile, "#%llu\n", (unsigned long long)(hostCycles * VCD_PS));
+  fclose(vcdFile);
+  vcdFile = nullptr;
+}
+
+/**
+ * Record the new level of a pin
+ */
+void vcdPin(uint8_t pin, int level)
+{
+  if (!vcdFile || pin >= VCD_PINS) return;
+  if (hostCycles != vcdTime)
+  {
+    fprintf(vcdFile, "#%llu\n", (unsigned long long)(hostCycles * VCD_PS));
+    vcdTime = hostCycles;
+  }
+  fprintf(vcdFile, "%c%c\n", levelChar(level), '!' + pin);
+}
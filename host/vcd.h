@@ -0,0 +1,9 @@
+#pragma once
+/**
+ * Host build: pin edges as Value Change Dump for GTKWave
+ */
+#include <stdint.h>
+
+bool vcdOpen(const char *path);
+void vcdClose();
+void vcdPin(uint8_t pin, int level);    // 0, 1 or -1 (z), at hostCycles
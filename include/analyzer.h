@@ -0,0 +1,12 @@
+#pragma once
+#include <Arduino.h>
+
+// Sample rates: 16 MHz / (8 + 4 * d), d = 0 .. 255
+constexpr uint32_t LA_MAX_KSPS  = 2000;
+constexpr uint32_t LA_MIN_KSPS  = 16;
+
+constexpr uint16_t LA_MAX_SAMPLES = 1024;
+
+enum class LA_PORT { D = 0, B };
+
+void laCapture(LA_PORT port, uint32_t kSps, uint8_t mask, uint8_t level);
@@ -0,0 +1,6 @@
+#pragma once
+#include <Arduino.h>
+#include "benchcases.h"
+
+void benchSim();
+void benchRun();
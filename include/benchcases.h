@@ -0,0 +1,23 @@
+#pragma once
+// Cases of the cycle count benchmark, shared by the firmware (bench.cpp)
+// and the simulator runner (sim/simbench.c), so plain C
+
+// The firmware writes the id of a case to GPIOR1 before it and 0 after it
+#define BENCH_MARKER_ADDR 0x4A          // GPIOR1 in data space
+#define BENCH_END         0x00
+#define BENCH_DONE        0xFF          // all cases run
+
+// id, name, function in bench.cpp
+#define BENCH_CASES(X)                                  \
+  X(1,  "overhead",                   benchOverhead)    \
+  X(2,  "setFrequency_1Hz",           benchFreq1Hz)     \
+  X(3,  "setFrequency_1kHz",          benchFreq1kHz)    \
+  X(4,  "setFrequency_8MHz",          benchFreq8MHz)    \
+  X(5,  "setPeriod_1us",              benchPer1us)      \
+  X(6,  "setPeriod_1s",               benchPer1s)       \
+  X(7,  "getFrequencyFromRegisters",  benchGetFreq)     \
+  X(8,  "printRegisterSettings",      benchPrint)       \
+  X(9,  "doMenu",                     benchMenu)        \
+  X(10, "heartbeat",                  benchHeartbeat)   \
+  X(11, "loop",                       benchLoop)        \
+  X(12, "scpiParse",                  benchScpi)
@@ -0,0 +1,9 @@
+#pragma once
+#include <Arduino.h>
+
+// Range of the sweep in Hz and steps per decade
+constexpr uint32_t BODE_MIN_HZ    = 1;
+constexpr uint32_t BODE_MAX_HZ    = 100000;
+constexpr uint8_t  BODE_MAX_STEPS = 20;
+
+void bodeSweep(uint32_t f1, uint32_t f2, uint8_t stepsPerDecade, uint8_t adcPin, uint8_t pin);
@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+// PWM carrier: fast PWM with TOP = ICR1 = 1023 and prescaler 1, 16 MHz / 1024
+constexpr uint16_t BREATHE_TOP        = 1023;
+constexpr uint32_t BREATHE_PWM_FREQ   = 15625;
+constexpr uint16_t BREATHE_ISR_CYCLES = 80;     // overflow ISR: 32-bit add and table read
+
+// Range of the envelope period in ms
+constexpr uint32_t BREATHE_MIN_MS     = 100;
+constexpr uint32_t BREATHE_MAX_MS     = 60000;
+
+enum class ENVELOPE : uint8_t { SINE = 1, TRIANGLE, EXP };
+
+void breatheStart(ENVELOPE env, uint32_t periodMs, uint8_t pin);
+void breatheSetPin(uint8_t pin);
+void breathePrintSettings();
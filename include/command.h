@@ -0,0 +1,92 @@
+#pragma once
+#include <Arduino.h>
+
+// Command registry: every command declares its key, name, help text, arguments
+// with their ranges and the handler. The table lives in flash, the lookup from
+// the key to the command is built by the compiler (see command.cpp)
+
+constexpr uint8_t  CMD_MAX_ARGS = 4;
+constexpr uint8_t  CMD_KEYS     = 128;  // keys are ASCII
+constexpr uint16_t CMD_ARG_WAIT = 2000; // ms to type the arguments after the key
+
+enum class ARG : uint8_t { INT, INT_OR_OFF };   // INT_OR_OFF: the range or 0
+
+// Result of cmdParseLine()
+enum class CMD_PARSE : uint8_t { OK, UNKNOWN, RANGE };
+
+typedef struct
+{
+  char    name[6];                      // also the unit, e.g. "mHz"
+  ARG     type;
+  int32_t min;
+  int32_t max;
+} ArgSpec;
+
+typedef struct
+{
+  char    key;
+  char    name[10];                     // lower case, calls the command in a line
+  char    help[44];                     // the arguments are added by cmdPrintHelp()
+  uint8_t nArgs;
+  ArgSpec args[CMD_MAX_ARGS];
+  void  (*handler)(const int32_t *arg); // arguments parsed and checked
+} Command;
+
+// Index of the command for every key, -1 if none
+typedef struct { int8_t at[CMD_KEYS]; } CmdIndex;
+
+/**
+ * Index of key in the table, evaluated by the compiler
+ */
+constexpr int8_t cmdFind(const Command *table, uint8_t n, char key, uint8_t i = 0)
+{
+  return i == n ? -1 : table[i].key == key ? (int8_t)i : cmdFind(table, n, key, i + 1);
+}
+
+/**
+ * Number of commands with key, to check that the keys are unique
+ */
+constexpr uint8_t cmdCount(const Command *table, uint8_t n, char key, uint8_t i = 0)
+{
+  return i == n ? 0 : (table[i].key == key) + cmdCount(table, n, key, i + 1);
+}
+
+constexpr bool cmdKeysUnique(const Command *table, uint8_t n, uint8_t i = 0)
+{
+  return i == n || (cmdCount(table, n, table[i].key) == 1 && cmdKeysUnique(table, n, i + 1));
+}
+
+// 0, 1, .. N - 1 as template arguments, to build the index for all keys
+template <uint8_t... K> struct CmdSeq { };
+template <uint8_t N, uint8_t... K> struct CmdMakeSeq : CmdMakeSeq<N - 1, N - 1, K...> { };
+template <uint8_t... K> struct CmdMakeSeq<0, K...> { typedef CmdSeq<K...> type; };
+
+template <uint8_t N, uint8_t... K>
+constexpr CmdIndex cmdMakeIndex(const Command (&table)[N], CmdSeq<K...>)
+{
+  return { { cmdFind(table, N, (char)K)... } };
+}
+
+/**
+ * Lookup table from key to command, built at compile time
+ */
+template <uint8_t N>
+constexpr CmdIndex cmdMakeIndex(const Command (&table)[N])
+{
+  return cmdMakeIndex(table, typename CmdMakeSeq<CMD_KEYS>::type());
+}
+
+uint8_t  cmdArgCount(const Command *table, const CmdIndex *index, int key);
+void     cmdDispatch(const Command *table, const CmdIndex *index, int key);
+CMD_PARSE cmdParseLine(const Command *table, uint8_t nCommands, const CmdIndex *index,
+                       const char *line, const Command **cmd, int32_t *arg);
+void     cmdRun(const Command *c, const int32_t *arg);
+void     cmdPrintError(const Command *c);
+void     cmdPrintHelp(const Command *table, uint8_t n);
+uint16_t cmdErrorCount();
+
+// The lines of an output of several lines, joined into one in the pipeline
+void     cmdJoinLines(bool join);
+bool     cmdLinesJoined();
+void     cmdBeginLine();
+void     cmdEndLine();
@@ -0,0 +1,18 @@
+#pragma once
+#include <Arduino.h>
+
+// Sample rate of the DDS interrupt: 16 MHz / (255 + 1) with prescaler 1
+constexpr uint32_t DDS_FS       = 62500;
+constexpr uint8_t  DDS_OCR1A    = 255;
+
+// Cycles of the ISR with interrupt response and reti, counted in dds.cpp
+constexpr uint16_t DDS_ISR_CYCLES = 66;
+
+// Range of the DDS frequency in milli-Hertz: 0.001 .. 1000 Hz
+constexpr uint32_t DDS_MIN_MHZ  = 1;
+constexpr uint32_t DDS_MAX_MHZ  = 1000000;
+
+void     ddsStart(uint32_t mHz, uint8_t pin);
+void     ddsSetPin(uint8_t pin);
+uint32_t ddsGetFrequency_mHz();
+void     ddsPrintSettings();
@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+#include "sched.h"
+
+// Square wave generator of the main sketch, used by the other modules
+
+// Prescaler and OCR1A of the square wave and the values derived from them.
+// Derived again only when the registers or fo have changed
+typedef struct
+{
+  uint8_t  preBits;
+  uint16_t ocr;
+  uint32_t fo;             // Hz, estimate of the timebase
+  uint16_t pre;
+  double   frequency;      // Hz
+  double   period;         // us
+  char     text[64];       // as shown by printRegisterSettings()
+} SquareStatus;
+
+extern const uint16_t preValues[8];
+
+const SquareStatus &squareStatus();
+uint16_t ocrForFrequency(uint32_t freq, uint32_t pre);
+uint16_t ocrForPeriod(uint32_t period, uint32_t pre);
+void     setFrequency(uint32_t freq, uint8_t pin);
+void     setPeriod(uint32_t period, uint8_t pin);
+double   getFrequencyFromRegisters();
+double   getPeriodFromRegisters();
+void     printRegisterSettings();
+void     toggleOutputPin(const int32_t *arg = nullptr);
+void     doMenu();
+int16_t  scpiParseLine(const char *line, int32_t *value);
+uint8_t  heartbeatTask(Pt *pt);
+uint8_t  generatorMode();
+const char *generatorModeName();
+uint64_t generatorFrequency_mHz();
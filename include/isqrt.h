@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Integer square root
+ */
+inline uint32_t isqrt(uint64_t x)
+{
+  uint64_t r = 0;
+  uint64_t b = 1ULL << 62;
+  while (b > x) b >>= 2;
+  while (b)
+  {
+    if (x >= r + b)
+    {
+      x -= r + b;
+      r  = (r >> 1) + b;
+    }
+    else
+    {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+  return (uint32_t)r;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+// Plain C, sim/simbench.c scans for the paint as well
+
+#define MEM_PAINT 0xC5                  // free RAM at boot
+
+#ifdef __cplusplus
+uint16_t memFree();
+uint16_t memStackMax();
+void     memRepaint();
+void     memPrintSettings();
+#endif
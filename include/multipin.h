@@ -0,0 +1,21 @@
+#pragma once
+#include <Arduino.h>
+
+// Timer1 ticks with prescaler 64: 4 us, 250'000 per second
+constexpr uint32_t MP_TICKS_PER_SEC = 250000;
+constexpr uint8_t  MP_MAX_CHANNELS  = 8;
+
+// Range of the frequencies in milli-Hertz: 0.01 .. 1000 Hz
+constexpr uint32_t MP_MIN_MHZ       = 10;
+constexpr uint32_t MP_MAX_MHZ       = 1000000;
+
+// Cycles of the ISR with all channels due, estimated in multipin.cpp
+constexpr uint16_t MP_ISR_CYCLES    = 1730;
+
+// Pins usable for the square waves, 0 and 1 belong to the serial port
+constexpr uint8_t  MP_MIN_PIN       = 2;
+constexpr uint8_t  MP_MAX_PIN       = 19;
+
+void mpStart();
+bool mpSetChannel(uint8_t pin, uint32_t mHz);
+void mpPrintSettings();
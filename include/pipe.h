@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+#include "command.h"
+#include "scpi.h"
+
+// Pipeline of tagged commands: "#17 e1000" or "#18 FREQ?" are queued and
+// executed in order, every one is answered with its tag (see pipe.cpp)
+
+// Bytes of the queued lines, one length byte each, up to 256
+constexpr uint16_t PIPE_QUEUE = 128;
+
+bool pipeQueue();
+void pipeReject();
+bool pipePending();
+void pipeExecute(const Command *table, uint8_t nCommands, const CmdIndex *index,
+                 const ScpiCommand *scpiTable, uint8_t nScpi);
+void pipePrintSettings();
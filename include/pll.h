@@ -0,0 +1,18 @@
+#pragma once
+#include <Arduino.h>
+
+// Range of the ratio N/M, output = N/M * reference
+constexpr uint16_t PLL_MAX_N = 1000;
+constexpr uint16_t PLL_MAX_M = 1000;
+
+// Cycles with interrupts disabled: compare A through the hook, or the
+// capture ISR up to its sei()
+constexpr uint16_t PLL_ISR_CYCLES = 200;
+
+enum class PLL_STATE : uint8_t { ACQUIRE, TRACK, LOCKED, NO_REF, OUT_OF_RANGE };
+
+void      pllStart(uint16_t n, uint16_t m, uint8_t pin);
+void      pllSetPin(uint8_t pin);
+PLL_STATE pllGetState();
+uint32_t  pllGetFrequency_mHz();
+void      pllPrintSettings();
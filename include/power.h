@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+// Typical supply current of the ATmega328P at 5 V, 16 MHz (datasheet curves),
+// the base of the estimate per mode. The board (USB chip, regulator, LEDs) draws more
+constexpr uint32_t PWR_ACTIVE_UA = 9000;
+constexpr uint32_t PWR_IDLE_UA   = 2500;
+
+// Modes counted separately, the sketch passes its generator mode
+constexpr uint8_t  PWR_MODES     = 8;
+
+void     powerBegin();
+void     powerAdc(bool on);
+void     powerTimer2(bool on);
+uint32_t powerSleep();
+void     powerAccount(uint8_t mode);
+void     powerPrintSettings(const char *const *names, uint8_t n);
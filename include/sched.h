@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+
+// Cooperative scheduler: the tasks are declared in a table of the sketch with
+// their period and budget, loop() runs the due ones and sleeps when none of
+// them has work (see sched.cpp)
+
+// Protothread: the line to continue at and a time for PT_SLEEP
+typedef struct
+{
+  uint16_t lc;
+  uint32_t t;
+} Pt;
+
+// Timer0 ticks of the spin loop that measures the ISR load: 1 ms
+constexpr uint8_t SCHED_SPIN_TICKS = 250;
+
+// Return values of a task
+constexpr uint8_t PT_WAITING = 0;       // blocked on a condition, no work done
+constexpr uint8_t PT_YIELDED = 1;
+constexpr uint8_t PT_ENDED   = 2;
+
+// Protothread macros. A task keeps its state in static variables, the locals
+// are lost at every wait. Only one wait per line
+#define PT_BEGIN(pt)          switch ((pt)->lc) { case 0:
+#define PT_WAIT_UNTIL(pt, c)  (pt)->lc = __LINE__; /* fall through */ case __LINE__: \
+                              if (!(c)) return PT_WAITING
+#define PT_YIELD(pt)          (pt)->lc = __LINE__; return PT_YIELDED; case __LINE__:
+#define PT_SLEEP(pt, ms)      (pt)->t = millis(); \
+                              PT_WAIT_UNTIL(pt, millis() - (pt)->t >= (ms))
+#define PT_END(pt)            } (pt)->lc = 0; return PT_ENDED
+
+typedef struct
+{
+  char      name[10];
+  uint16_t  period;                     // ms, 0: every pass
+  uint16_t  budget;                     // us a run may take
+  uint8_t (*fn)(Pt *pt);
+} Task;
+
+// Runtime state and statistics of a task
+typedef struct
+{
+  Pt       pt;
+  uint32_t due;                         // millis() of the next run
+  uint32_t runs;
+  uint32_t maxUs;                       // longest run
+  uint16_t overruns;                    // runs longer than the budget
+  uint16_t late;                        // periods missed
+} TaskState;
+
+void schedBegin(const Task *table, TaskState *state, uint8_t n);
+bool schedRun();
+void schedIdle();
+void schedMeasure();
+void schedLoad(uint16_t *loop, uint16_t *isr);
+void schedErrors(uint16_t *overruns, uint16_t *late);
+void schedPrintSettings();
@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+
+// SCPI subset for test executives, next to the single-key menu: a line of
+// ASCII such as "FREQ 1000" or "OUTP:STAT?", ended by '\n' (see scpi.cpp)
+
+constexpr uint8_t  SCPI_LINE       = 64;    // characters of a line without '\n'
+constexpr uint8_t  SCPI_MAX_PARAMS = 2;
+constexpr uint8_t  SCPI_ERRORS     = 8;     // depth of the error queue
+constexpr uint16_t SCPI_WAIT       = 10;    // ms for the second letter of a header
+
+// Error codes of SCPI-99, SYST:ERR? adds the text
+constexpr int16_t SCPI_NO_ERROR          = 0;
+constexpr int16_t SCPI_SYNTAX            = -102;
+constexpr int16_t SCPI_PARAM_NOT_ALLOWED = -108;
+constexpr int16_t SCPI_MISSING_PARAM     = -109;
+constexpr int16_t SCPI_UNDEFINED_HEADER  = -113;
+constexpr int16_t SCPI_SETTINGS_CONFLICT = -221;
+constexpr int16_t SCPI_OUT_OF_RANGE      = -222;
+constexpr int16_t SCPI_ILLEGAL_VALUE     = -224;
+constexpr int16_t SCPI_QUEUE_OVERFLOW    = -350;
+
+// Parameter: points into the line, nothing is copied
+typedef struct
+{
+  const char *s;
+  uint8_t     len;
+} ScpiParam;
+
+typedef struct
+{
+  char    header[20];                   // long form, the short form in capitals: "OUTPut:STATe?"
+  uint8_t nParams;
+  int32_t min;                          // range of a number, 0 .. 0: not checked
+  int32_t max;
+  char    choices[12];                  // or the keywords allowed: "ON|OFF|1|0"
+  void  (*handler)(const ScpiParam *param);   // parameters checked
+} ScpiCommand;
+
+bool     scpiStart(int key, int next);
+void     scpiBegin(char key);
+bool     scpiRead();
+bool     scpiPending();
+uint8_t  scpiTake(const char **line, bool *tooLong);
+void     scpiExecute(const ScpiCommand *table, uint8_t n);
+bool     scpiExecuteLine(const ScpiCommand *table, uint8_t n, const char *line, uint8_t len);
+int16_t  scpiCheck(const ScpiCommand *table, uint8_t n, const char *line, uint8_t len);
+int16_t  scpiParse(const ScpiCommand *table, uint8_t n, const char *s, uint8_t len,
+                   ScpiParam *param, uint8_t *nParams);
+int32_t  scpiInt(const ScpiParam *param);
+bool     scpiIs(const ScpiParam *param, const char *word);
+void     scpiAnswer(const char *text);
+void     scpiError(int16_t code);
+void     scpiClearErrors();
+void     scpiPrintError();
+void     scpiPrintErrorText(int16_t code);
@@ -0,0 +1,12 @@
+#pragma once
+#include <Arduino.h>
+
+// Range of the divider for pin 10
+constexpr uint16_t SUB_MIN_N = 2;
+constexpr uint16_t SUB_MAX_N = 65535;
+
+// Cycles of the compare B ISR with prologue and epilogue
+constexpr uint16_t SUB_ISR_CYCLES = 90;
+
+void subStart(uint16_t n);
+void subPrintSettings();
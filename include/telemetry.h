@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include "sched.h"
+
+// Frame rate of the status stream
+constexpr uint8_t  TM_MIN_RATE = 1;       // Hz
+constexpr uint8_t  TM_MAX_RATE = 100;
+
+// Transmit buffer of the frames, a power of 2 up to 256
+constexpr uint16_t TM_BUFFER   = 256;
+
+// Binary frame: TM_SYNC1, TM_SYNC2, length, TelemetryFrame, CRC-16/XMODEM of the frame
+constexpr uint8_t  TM_SYNC1    = 0xA5;
+constexpr uint8_t  TM_SYNC2    = 0x5A;
+
+enum class TM_FORMAT : uint8_t { BINARY = 1, JSON };
+
+// Content of a frame, little endian
+typedef struct __attribute__((packed))
+{
+  uint32_t ms;                            // millis()
+  uint8_t  mode;                          // generator mode, 0 = SQUARE
+  uint8_t  tccr1a;
+  uint8_t  tccr1b;
+  uint8_t  timsk1;
+  uint16_t ocr1a;
+  uint16_t ocr1b;
+  uint16_t icr1;
+  uint64_t mHz;                           // output frequency, 0 if the mode has none
+  uint16_t loopLoad;                      // 0.1 %
+  uint16_t isrLoad;                       // 0.1 %
+  uint16_t overruns;                      // tasks over budget
+  uint16_t late;                          // task periods missed
+  uint16_t cmdErrors;                     // commands rejected
+  uint16_t drops;                         // frames dropped, buffer full
+} TelemetryFrame;
+
+void    telemetryStart(uint8_t rate, TM_FORMAT format);
+bool    telemetryPause();
+void    telemetryResume();
+uint8_t telemetryTask(Pt *pt);
+void    telemetryPrintSettings();
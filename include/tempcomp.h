@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include "sched.h"
+
+// Compensation curve: one point every 5 degC from -10 to 70 degC
+constexpr int16_t  TC_T_MIN      = -100;   // 0.1 degC
+constexpr int16_t  TC_T_STEP     = 50;     // 0.1 degC
+constexpr uint8_t  TC_POINTS     = 17;
+
+// Interval of the temperature measurement
+constexpr uint32_t TC_INTERVAL   = 10000;  // ms
+
+void    tempcompBegin();
+void    tempcompUpdate();
+uint8_t tempcompSaveTask(Pt *pt);
+void    tempcompLearn(int32_t ppb);
+bool    tempcompPpb(int32_t *ppb);
+int16_t tempcompTemperature();
+void    tempcompClear();
+void    tempcompPrintCurve();
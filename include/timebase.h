@@ -0,0 +1,21 @@
+#pragma once
+#include <Arduino.h>
+
+// Nominal fo = fcpu / 2, the base of all frequency formulas
+constexpr uint32_t TB_FO_NOMINAL = 8000000;
+
+// Seconds kept for the estimate and the stability
+constexpr uint8_t  TB_WINDOW     = 32;
+
+// Handler for the pin change interrupt of port B instead of the PPS
+extern void (* volatile pcint0Handler)();
+
+enum class TB_STATE : uint8_t { NOMINAL, ACQUIRE, LOCKED, HOLDOVER, TEMPCOMP };
+
+void     timebaseBegin();
+void     timebaseEnable(bool enable);
+void     timebaseUpdate();
+uint32_t timebaseFo();
+uint32_t timebaseScale(uint32_t nominal);
+TB_STATE timebaseGetState();
+void     timebasePrintSettings();
@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+
+// Bit in GPIOR0 that routes the compare A interrupt to the DDS fast path.
+// GPIOR0 is in the lower I/O space, so sbi, cbi and sbis work on it
+constexpr uint8_t T1_DDS_FLAG = 0;
+
+// Handler for the compare A interrupt when the DDS fast path is not active
+extern void (* volatile timer1CompAHandler)();
+
+/**
+ * Route the compare A interrupt to handler instead of the DDS
+ */
+inline void timer1AttachCompA(void (*handler)())
+{
+  GPIOR0 &= ~(1 << T1_DDS_FLAG);
+  timer1CompAHandler = handler;
+}
+
+// Complete configuration of Timer1. A mode fills it in outside of the
+// critical section, timer1Commit() writes it with interrupts disabled
+typedef struct
+{
+  uint8_t  tccr1a;
+  uint8_t  tccr1b;
+  uint16_t ocr1a;
+  uint16_t ocr1b;
+  uint16_t icr1;
+  uint8_t  timsk1;
+} Timer1Config;
+
+void timer1Commit(const Timer1Config &c, bool clearCounter = false);
+void timer1Read(Timer1Config &c);
+
+/**
+ * Write OCR1A without an interrupt between the two bytes: a Timer1
+ * interrupt that accesses a 16-bit register would overwrite TEMP
+ */
+inline void timer1WriteOCR1A(uint16_t ocr)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  OCR1A = ocr;
+  SREG = oldSREG;
+}
+
+// Synchronous write of OCR1A: timer clocks the write may take after the
+// TCNT1 check, and compare matches it waits at most
+constexpr uint8_t T1_SYNC_MARGIN = 4;
+constexpr uint8_t T1_SYNC_TRIES  = 4;
+
+// Cycles of the compare A ISR through the hook, e.g. the deferred write
+constexpr uint16_t T1_ISR_CYCLES = 120;
+
+void timer1WriteOCR1AAtMatch(uint16_t ocr);
+void timer1WriteOCR1ASync(uint16_t ocr);
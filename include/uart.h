@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+
+// Rate after reset and after a failed switch, that of the serial monitor
+constexpr uint32_t UART_BOOT_BAUD   = 115200;
+
+// Rates that can be switched to, exact with U2X at 16 MHz above 115'200
+constexpr uint32_t UART_MIN_BAUD    = 115200;
+constexpr uint32_t UART_MAX_BAUD    = 2000000;
+
+// Time the host has to confirm the new rate with UART_CONFIRM_KEY
+constexpr uint16_t UART_CONFIRM_MS  = 2000;
+constexpr char     UART_CONFIRM_KEY = 'U';    // 0x55, alternating bits
+
+// Cycles the receive interrupt may be held off: two characters of 10 bits
+constexpr uint32_t uartWindowCycles(uint32_t baud) { return 20 * F_CPU / baud; }
+
+void     uartBegin();
+bool     uartSwitch(uint32_t baud, uint16_t isrCycles);
+bool     uartKeepsUp(uint16_t isrCycles);
+uint32_t uartBaud();
+void     uartPrintSettings();
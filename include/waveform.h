@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+// Sample rate of the wavetable interrupt: 16 MHz / 8 / (63 + 1) by Timer2
+constexpr uint32_t WAV_FS          = 31250;
+constexpr uint8_t  WAV_OCR2A       = 63;
+constexpr uint16_t WAV_ISR_BUDGET  = 512;  // cycles between two interrupts
+constexpr uint16_t WAV_ISR_CYCLES  = 100;  // cycles of the ISR with epilogue, see wavIsrMax
+
+// Range of the waveform frequency in milli-Hertz: 0.001 .. 2000 Hz
+constexpr uint32_t WAV_MIN_MHZ     = 1;
+constexpr uint32_t WAV_MAX_MHZ     = 2000000;
+
+enum class WAVE_SHAPE : uint8_t { SINE = 1, TRIANGLE, SAW };
+
+void     wavStart(WAVE_SHAPE shape, uint32_t mHz, uint8_t pin);
+void     wavStop();
+void     wavSetPin(uint8_t pin);
+uint32_t wavGetFrequency_mHz();
+void     wavPrintSettings();
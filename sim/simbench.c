@@ -0,0 +1,283 @@
+/**
+ * Program      simbench.c
+ *
+ * Purpose      Runs the firmware built with -D SIM_BENCH (environment simbench) in
+ *              simavr, takes the exact cycle count of every case of benchcases.h
+ *              and prints them as JSON. With a baseline it fails when a case has
+ *              become slower than the tolerance allows. It also fails when less RAM
+ *              than the reserve between the end of .bss and the deepest stack of the
+ *              run has never been written
+ *
+ * Usage        simbench [-b baseline.json | -c | -w baseline.json] [-t percent]
+ *                       [-r bytes] [-v] firmware.elf
+ *
+ *              -b  compare with the baseline, exit code 1 on a regression
+ *              -c  CI: compare with sim/baseline.json (or -b). Exit code 2 when the
+ *                  baseline is missing, 1 when a case has no count in it
+ *              -w  record the counts as new baseline
+ *              -t  allowed increase in percent, default 1
+ *              -r  RAM reserve never written, in bytes, default 128
+ *              -v  echo the serial output of the firmware to stderr
+ *
+ * Build        cc -O2 -Iinclude sim/simbench.c -lsimavr -lelf -o simbench
+ *
+ * Remarks      The counts are those of the ATmega328P at 16 MHz with the compiler
+ *              and libraries of the build. The overhead of a case (marker writes and
+ *              the indirect call) is subtracted from the others. A case that has not
+ *              ended after 10 s of simulated time counts as a failure.
+ *
+ *              A baseline is only written with -w, never as a side effect of a
+ *              comparison, so a CI run without the committed baseline fails instead
+ *              of passing with nothing compared.
+ *
+ *              The firmware paints the free RAM at boot (see mem.cpp). After the run
+ *              the RAM is scanned upward from the end of .bss to the first byte the
+ *              heap or the stack has written: the bytes below it are the reserve.
+ *              Only the paths that the bench cases run are measured, a deeper call
+ *              of the firmware elsewhere is not seen.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_uart.h>
+#include "benchcases.h"
+#include "mem.h"
+
+#define F_CPU      16000000UL
+#define MAX_CYCLES (F_CPU * 10)
+#define RAMSTART   0x100
+#define RAMEND     0x8FF
+#define RAM_RESERVE 128                     // bytes never written, default of -r
+#define CI_BASELINE "sim/baseline.json"
+#define USAGE      "usage: simbench [-b baseline.json | -c | -w baseline.json] [-t percent] [-r bytes] [-v] firmware.elf\n"
+
+typedef struct { uint8_t id; const char *name; } Case;
+
+#define CASE_ENTRY(id, name, fn) { id, name },
+static const Case cases[] = { BENCH_CASES(CASE_ENTRY) };
+#define NBR_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static avr_cycle_count_t start[256];
+static avr_cycle_count_t cycles[256];
+static uint8_t           ended[256];
+static uint8_t           current = 0;
+static int               done    = 0;
+static int               verbose = 0;
+static FILE             *record  = NULL;    // -w
+
+/**
+ * Print the JSON to stdout and to the baseline being recorded
+ */
+static void out(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  if (!record) return;
+  va_start(ap, fmt);
+  vfprintf(record, fmt, ap);
+  va_end(ap);
+}
+
+/**
+ * Write to GPIOR1: start or end of a case, or the end of the run
+ */
+static void markerWrite(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  avr->data[addr] = v;
+  if (v == BENCH_DONE)
+  {
+    done = 1;
+  }
+  else if (v == BENCH_END)
+  {
+    if (current)
+    {
+      cycles[current] = avr->cycle - start[current];
+      ended[current]  = 1;
+    }
+    current = 0;
+  }
+  else
+  {
+    current   = v;
+    start[v]  = avr->cycle;
+  }
+}
+
+/**
+ * Byte sent by the UART of the firmware
+ */
+static void uartOut(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  if (verbose) fputc((int)value, stderr);
+}
+
+/**
+ * Contents of a file, NULL if it can't be read
+ */
+static char *readFile(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  long  n   = ftell(f);
+  char *buf = malloc(n + 1);
+  fseek(f, 0, SEEK_SET);
+  if (!buf || fread(buf, 1, n, f) != (size_t)n)
+  {
+    free(buf);
+    fclose(f);
+    return NULL;
+  }
+  buf[n] = 0;
+  fclose(f);
+  return buf;
+}
+
+/**
+ * Count of a case in the baseline, -1 if it has none
+ */
+static long baselineOf(const char *json, const char *name)
+{
+  char key[64];
+  snprintf(key, sizeof(key), "\"%s\":", name);
+  const char *p = strstr(json, key);
+  if (!p) return -1;
+  p += strlen(key);
+  while (*p == ' ') p++;
+  return *p >= '0' && *p <= '9' ? strtol(p, NULL, 10) : -1;     // null: not ended when recorded
+}
+
+int main(int argc, char *argv[])
+{
+  const char    *baseline  = NULL;
+  const char    *recording = NULL;
+  int            ci        = 0;
+  double         tolerance = 1.0;
+  unsigned       reserve   = RAM_RESERVE;
+  elf_firmware_t fw;
+  int            opt;
+
+  while ((opt = getopt(argc, argv, "b:cw:t:r:v")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b': baseline  = optarg;       break;
+      case 'c': ci        = 1;            break;
+      case 'w': recording = optarg;       break;
+      case 't': tolerance = atof(optarg); break;
+      case 'r': reserve   = atoi(optarg); break;
+      case 'v': verbose   = 1;            break;
+      default:
+        fputs(USAGE, stderr);
+        return 2;
+    }
+  }
+  if (optind != argc - 1 || (recording && (baseline || ci)))
+  {
+    fputs(USAGE, stderr);
+    return 2;
+  }
+  if (ci && !baseline) baseline = CI_BASELINE;
+
+  memset(&fw, 0, sizeof(fw));
+  if (elf_read_firmware(argv[optind], &fw) != 0)
+  {
+    fprintf(stderr, "simbench: can't read %s\n", argv[optind]);
+    return 2;
+  }
+  if (!fw.mmcu[0]) strcpy(fw.mmcu, "atmega328p");   // the Arduino build has no .mmcu section
+  if (!fw.frequency) fw.frequency = F_CPU;
+
+  avr_t *avr = avr_make_mcu_by_name(fw.mmcu);
+  if (!avr)
+  {
+    fprintf(stderr, "simbench: unknown MCU %s\n", fw.mmcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &fw);
+  avr_register_io_write(avr, BENCH_MARKER_ADDR, markerWrite, NULL);
+
+  uint32_t flags = 0;                               // no line output of simavr on stdout
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uartOut, NULL);
+
+  int state = cpu_Running;
+  while (!done && state != cpu_Done && state != cpu_Crashed && avr->cycle < MAX_CYCLES)
+  {
+    state = avr_run(avr);
+  }
+
+  char *json = NULL;
+  if (baseline && !(json = readFile(baseline)))
+  {
+    fprintf(stderr, "simbench: can't read %s%s\n", baseline,
+            ci ? ", record it with -w and commit it" : "");
+    return 2;
+  }
+  if (recording && !(record = fopen(recording, "w")))
+  {
+    fprintf(stderr, "simbench: can't write %s\n", recording);
+    return 2;
+  }
+
+  // stack maximum: the first byte above .bss that is no longer painted
+  unsigned bssEnd    = RAMSTART + fw.datasize + fw.bsssize;
+  unsigned a         = bssEnd;
+  while (a <= RAMEND && avr->data[a] == MEM_PAINT) a++;
+  unsigned stackMax  = RAMEND - a + 1;
+  unsigned untouched = a - bssEnd;
+
+  avr_cycle_count_t overhead = ended[cases[0].id] ? cycles[cases[0].id] : 0;
+  int failed = 0;
+
+  out("{\n  \"mcu\": \"%s\",\n  \"f_cpu\": %u,\n  \"cycles\": {\n", fw.mmcu, (unsigned)fw.frequency);
+  for (size_t i = 0; i < NBR_CASES; i++)
+  {
+    const Case *c     = &cases[i];
+    const char *comma = i + 1 < NBR_CASES ? "," : "";
+    if (!ended[c->id])
+    {
+      out("    \"%s\": null%s\n", c->name, comma);
+      fprintf(stderr, "MISSING %s: the case has not ended\n", c->name);
+      failed = 1;
+      continue;
+    }
+    unsigned long n = (unsigned long)(i ? cycles[c->id] - overhead : cycles[c->id]);
+    out("    \"%s\": %lu%s\n", c->name, n, comma);
+    if (!json || i == 0) continue;
+
+    long base = baselineOf(json, c->name);
+    if (base < 0)
+    {
+      fprintf(stderr, "%s %s: %lu, no count in the baseline\n", ci ? "UNRECORDED" : "NEW", c->name, n);
+      if (ci) failed = 1;
+    }
+    else if (n > base * (1.0 + tolerance / 100.0))
+    {
+      fprintf(stderr, "REGRESSION %s: %ld -> %lu cycles (+%.1f %%)\n", c->name, base, n, (n - base) * 100.0 / base);
+      failed = 1;
+    }
+  }
+  out("  },\n  \"ram\": {\n    \"data\": %u,\n    \"bss\": %u,\n    \"stack_max\": %u,\n    \"never_written\": %u\n  }\n}\n",
+         (unsigned)fw.datasize, (unsigned)fw.bsssize, stackMax, untouched);
+  if (untouched < reserve)
+  {
+    fprintf(stderr, "RAM RESERVE: data %u + bss %u + stack %u bytes leave %u never written < %u\n",
+            (unsigned)fw.datasize, (unsigned)fw.bsssize, stackMax, untouched, reserve);
+    failed = 1;
+  }
+
+  if (record) fclose(record);
+  free(json);
+  return failed;
+}
@@ -0,0 +1,166 @@
+/**
+ * Program      analyzer.cpp
+ *
+ * Purpose      Logic analyzer: samples port D (pins 0 .. 7) or port B (pins 8 .. 13)
+ *              into a RAM buffer and dumps it run length encoded. So the board can
+ *              look at what the DUT does in response to the square wave it drives.
+ *              Pins 9 and 10 are on port B, their output is captured as well
+ *
+ * Formulas     The sampling loop in assembler takes 8 + 4 * d CPU cycles per sample
+ *
+ *                d = 0        ld, st, sbiw, brne                    8 cycles
+ *                d > 0        plus mov and d x (nop, dec, brne)     4 * d cycles
+ *
+ *              rate = 16 MHz / (8 + 4 * d), 2 MS/s (d = 0) .. 15.6 kS/s (d = 255)
+ *
+ *              e.g. 2000, 1000, 500, 250, 100 kS/s for d = 0, 2, 6, 14, 38
+ *
+ * Remarks      Trigger: mask selects the bits of the port, level their values. The
+ *              capture starts when the masked port changes to level, e.g. mask 0x04
+ *              level 0x04 is the rising edge of PD2, mask 0x0C level 0x08 the pattern
+ *              PD3 high, PD2 low. Mask 0 starts at once. The trigger is polled with
+ *              interrupts disabled, the first sample follows within about 1 us.
+ *
+ *              Interrupts stay disabled while sampling. The outputs made by Timer1
+ *              hardware (square, PWM) go on, the modes driven by interrupts (DDS,
+ *              waveform, multi-pin, PLL) stand still and millis() loses the capture
+ *              time, at most 66 ms.
+ *
+ *              The buffer is taken from the heap for the capture only: 1024 samples,
+ *              or less when the free RAM is short (see mem.cpp).
+ *
+ *              Dump: "LA:" header, then value*count pairs in hex, 8 per line,
+ *              the counts in samples. "LA: end" closes the dump.
+ */
+#include <Arduino.h>
+#include "analyzer.h"
+#include "mem.h"
+#include "command.h"
+
+constexpr uint32_t LA_TIMEOUT     = 5000;   // ms to wait for the trigger
+constexpr uint16_t LA_STACK_SPARE = 256;    // RAM left for the stack
+
+/**
+ * Sample n bytes from the port into buf, 8 + 4 * d cycles per sample
+ */
+static void sample(decltype(&PINB) port, uint8_t *buf, uint16_t n, uint8_t d)
+{
+#ifdef __AVR__
+  uint8_t tmp, cnt;
+  asm volatile(
+    "tst  %[d]              \n\t"
+    "breq 3f                \n\t"
+    "1:                     \n\t"
+    "ld   %[tmp], Z         \n\t"   // 2
+    "st   X+, %[tmp]        \n\t"   // 2
+    "mov  %[cnt], %[d]      \n\t"   // 1
+    "2:                     \n\t"
+    "nop                    \n\t"   // d x 4, the last brne 1 cycle short
+    "dec  %[cnt]            \n\t"
+    "brne 2b                \n\t"
+    "sbiw %[n], 1           \n\t"   // 2
+    "brne 1b                \n\t"   // 2
+    "rjmp 4f                \n\t"
+    "3:                     \n\t"
+    "ld   %[tmp], Z         \n\t"   // 2
+    "st   X+, %[tmp]        \n\t"   // 2
+    "sbiw %[n], 1           \n\t"   // 2
+    "brne 3b                \n\t"   // 2
+    "4:                     \n\t"
+    : [tmp] "=&r" (tmp), [cnt] "=&r" (cnt), [n] "+w" (n), "+x" (buf)
+    : [d] "r" (d), "z" (port)
+    : "memory"
+  );
+#else
+  while (n--)                                 // host build: same timing on the virtual clock
+  {
+    *buf++ = *port;
+    hostAdvance(8 + 4 * d - 1);
+  }
+#endif
+}
+
+/**
+ * Print the samples run length encoded
+ */
+static void dump(const uint8_t *buf, uint16_t n)
+{
+  char    buf2[16];
+  uint8_t pairs = 0;
+
+  for (uint16_t i = 0; i < n; )
+  {
+    uint16_t run = 1;
+    while (i + run < n && buf[i + run] == buf[i]) run++;
+    if (pairs % 8 == 0) cmdBeginLine();
+    snprintf(buf2, sizeof(buf2), pairs % 8 == 7 ? "%02X*%u" : "%02X*%u ", buf[i], run);
+    Serial.print(buf2);
+    if (++pairs % 8 == 0) cmdEndLine();
+    i += run;
+  }
+  if (pairs % 8) cmdEndLine();
+  cmdBeginLine();
+  Serial.print("LA: end");
+  cmdEndLine();
+}
+
+/**
+ * Wait for the trigger, sample port at kSps and dump the samples
+ */
+void laCapture(LA_PORT port, uint32_t kSps, uint8_t mask, uint8_t level)
+{
+  char     buf[96];
+  decltype(&PINB) pin = (port == LA_PORT::B) ? &PINB : &PIND;
+  uint32_t cycles = F_CPU / 1000 / kSps;
+  uint32_t d      = cycles <= 8 ? 0 : (cycles - 8 + 2) / 4;
+  uint16_t n      = LA_MAX_SAMPLES;
+  uint16_t ram    = memFree();
+
+  if (d > 255) d = 255;
+  level &= mask;
+  if (ram < n + LA_STACK_SPARE) n = ram > LA_STACK_SPARE + 64 ? ram - LA_STACK_SPARE : 0;
+  uint8_t *samples = n ? (uint8_t *)malloc(n) : nullptr;
+  if (!samples)
+  {
+    cmdBeginLine();
+    Serial.print("LA: not enough RAM");
+    cmdEndLine();
+    return;
+  }
+
+  uint32_t rate = F_CPU / 100 / (8 + 4 * d);   // in units of 100 S/s
+  snprintf(buf, sizeof(buf), "LA: port %c, %lu.%lu kS/s, %u samples, trigger mask 0x%02X level 0x%02X",
+           port == LA_PORT::B ? 'B' : 'D', (unsigned long)(rate / 10), (unsigned long)(rate % 10),
+           n, mask, level);
+  cmdBeginLine();
+  Serial.print(buf);
+  cmdEndLine();
+  Serial.flush();
+
+  // wait until the masked port leaves level, then until it reaches it
+  bool     armed = (mask == 0);
+  uint32_t start = millis();
+  for (;;)
+  {
+    cli();
+    uint8_t v = *pin & mask;
+    if (armed && v == level) break;   // interrupts stay disabled
+    if (v != level) armed = true;
+    sei();
+    if (millis() - start > LA_TIMEOUT || Serial.available())
+    {
+      cmdBeginLine();
+      Serial.print("LA: no trigger");
+      cmdEndLine();
+      free(samples);
+      memRepaint();
+      return;
+    }
+  }
+  sample(pin, samples, n, d);
+  sei();
+
+  dump(samples, n);
+  free(samples);
+  memRepaint();                              // the buffer has overwritten the paint
+}
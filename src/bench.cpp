@@ -0,0 +1,201 @@
+/**
+ * Program      bench.cpp
+ *
+ * Purpose      Cycle counts of the hot paths.
+ *
+ *              In the simulator simavr (benchSim): built with
+ *              -D SIM_BENCH (environment simbench), setup() runs every case of
+ *              benchcases.h once and sim/simbench.c reads the cycle counter of the
+ *              simulator at the markers
+ *
+ * Remarks      A case is framed by two writes to GPIOR1: its id before, 0 after.
+ *              The case "overhead" is empty, the runner subtracts it from the others.
+ *
+ *              The millis() interrupt is off during a case, so its phase does not
+ *              move the counts when the code in front changes. The serial output of
+ *              the previous case is flushed first. A case that prints more than the
+ *              63 bytes of the transmit buffer includes the wait for the UART
+ *              (doMenu: the 82 bytes of CLR_LINE).
+ *
+ *              doMenu() runs without input: Serial.read() returns -1, which has no
+ *              command. The case "loop" is one pass of the scheduler without the idle
+ *              sleep, the millis() interrupt that ends the sleep is off. loop() is run
+ *              once before the cases, so the first temperature reading is not counted.
+ *
+ *              On the board (benchRun, menu): Timer1 counts CPU cycles with prescaler
+ *              1 while the solver (ocrForFrequency, ocrForPeriod) runs for a spread of
+ *              inputs, and the formatter printRegisterSettings() and the dispatch
+ *              doMenu() run as above. Each case runs BENCH_RUNS times, the report
+ *              gives min, median and max. The interrupts stay on, so max includes the
+ *              millis() and serial interrupts that hit a run, min is the pure code.
+ *              A run of 65536 cycles or more is shown as 65535. The output stops
+ *              during the benchmark, the caller sets it again.
+ */
+#include <Arduino.h>
+#include "bench.h"
+#include "generator.h"
+#include "command.h"
+
+typedef struct { uint8_t id; void (*fn)(); } BenchCase;
+
+volatile double benchSink;             // keeps the results of functions without side effects
+
+static void benchOverhead()  { }
+static void benchFreq1Hz()   { setFrequency(1, 9); }
+static void benchFreq1kHz()  { setFrequency(1000, 9); }
+static void benchFreq8MHz()  { setFrequency(8000000, 9); }
+static void benchPer1us()    { setPeriod(1, 9); }
+static void benchPer1s()     { setPeriod(1000000, 9); }
+static void benchGetFreq()   { benchSink = getFrequencyFromRegisters(); }
+static void benchPrint()     { printRegisterSettings(); }
+static void benchMenu()      { doMenu(); }
+static Pt   benchPt;
+static void benchHeartbeat() { heartbeatTask(&benchPt); }
+static void benchLoop()      { schedRun(); }
+static void benchScpi()      { int32_t v; benchSink = scpiParseLine("FREQuency 1.5E6", &v); }
+
+#define BENCH_ENTRY(id, name, fn) { id, fn },
+const BenchCase benchCases[] = { BENCH_CASES(BENCH_ENTRY) };
+
+/**
+ * Run one case between the markers
+ */
+static void benchCase(const BenchCase &c)
+{
+  Serial.flush();
+  uint8_t timsk0 = TIMSK0;
+  TIMSK0 = 0;
+  GPIOR1 = c.id;
+  c.fn();
+  GPIOR1 = BENCH_END;
+  TIMSK0 = timsk0;
+}
+
+/**
+ * Run all cases once, then signal the runner to stop
+ */
+void benchSim()
+{
+  loop();
+  for (const BenchCase &c : benchCases) benchCase(c);
+  Serial.flush();
+  GPIOR1 = BENCH_DONE;
+}
+
+constexpr uint8_t BENCH_RUNS = 15;
+
+typedef struct { const char *name; void (*fn)(uint32_t); uint32_t arg; } DeviceCase;
+
+/**
+ * Prescaler setFrequency() and setPeriod() choose for the input
+ */
+static uint32_t preForFrequency(uint32_t f)
+{
+  return f < 2 ? 256 : f < 16 ? 64 : f < 123 ? 8 : 1;
+}
+
+static uint32_t preForPeriod(uint32_t us)
+{
+  return us > 2097152 ? 1024 : us > 524288 ? 256 : us > 65536 ? 64 : 8;
+}
+
+static void runNothing(uint32_t)         { }
+static void runSolveFreq(uint32_t f)     { benchSink = ocrForFrequency(f, preForFrequency(f)); }
+static void runSolvePeriod(uint32_t us)  { benchSink = ocrForPeriod(us, preForPeriod(us)); }
+static void runFormat(uint32_t)          { printRegisterSettings(); }
+static void runDispatch(uint32_t)        { doMenu(); }
+static void runScpiFreq(uint32_t)        { int32_t v; benchSink = scpiParseLine("FREQ 1000", &v); }
+static void runScpiFunc(uint32_t)        { int32_t v; benchSink = scpiParseLine("SOUR:FUNC SQU", &v); }
+static void runScpiError(uint32_t)       { int32_t v; benchSink = scpiParseLine("SYSTem:ERRor?", &v); }
+
+const DeviceCase deviceCases[] =
+{
+  { "ocrForFrequency 1 Hz",       runSolveFreq,   1 },
+  { "ocrForFrequency 100 Hz",     runSolveFreq,   100 },
+  { "ocrForFrequency 10 kHz",     runSolveFreq,   10000 },
+  { "ocrForFrequency 8 MHz",      runSolveFreq,   8000000 },
+  { "ocrForPeriod 1 us",          runSolvePeriod, 1 },
+  { "ocrForPeriod 10 ms",         runSolvePeriod, 10000 },
+  { "ocrForPeriod 8 s",           runSolvePeriod, 8000000 },
+  { "printRegisterSettings",      runFormat,      0 },
+  { "doMenu without key",         runDispatch,    0 },
+  { "scpiParse FREQ 1000",        runScpiFreq,    0 },
+  { "scpiParse SOUR:FUNC SQU",    runScpiFunc,    0 },
+  { "scpiParse SYSTem:ERRor?",    runScpiError,   0 },
+};
+
+/**
+ * Cycles of one run, with the empty run not subtracted
+ */
+static uint16_t timeRun(void (*fn)(uint32_t), uint32_t arg)
+{
+  Serial.flush();                       // output of the last run out of the way
+  TCNT1 = 0;
+  TIFR1 = 1 << TOV1;
+  fn(arg);
+  uint16_t t = TCNT1;
+  return (TIFR1 & (1 << TOV1)) ? 0xFFFF : t;
+}
+
+/**
+ * Runs of a case sorted by insertion, the median in the middle
+ */
+static void timeCase(void (*fn)(uint32_t), uint32_t arg, uint16_t t[BENCH_RUNS])
+{
+  for (uint8_t i = 0; i < BENCH_RUNS; i++)
+  {
+    uint16_t v = timeRun(fn, arg);
+    uint8_t  j = i;
+    for (; j > 0 && t[j - 1] > v; j--) t[j] = t[j - 1];
+    t[j] = v;
+  }
+}
+
+/**
+ * Time all cases and report min, median and max in CPU cycles.
+ * Timer1 is left counting, the caller sets the output again
+ */
+void benchRun()
+{
+  char     buf[80];
+  uint16_t t[BENCH_RUNS];
+  uint16_t empty;
+  uint16_t results[sizeof(deviceCases) / sizeof(deviceCases[0])][3];
+
+  TIMSK1 = 0;
+  TCCR1A = 0;                           // pins 9 and 10 disconnected
+  TCCR1B = 0b001;                       // normal mode, prescaler 1: TCNT1 counts CPU cycles
+
+  timeCase(runNothing, 0, t);
+  empty = t[0];
+  cmdBeginLine();                       // what the cases print
+
+  // the formatter and the dispatch print, so report after all cases
+  for (uint8_t i = 0; i < sizeof(deviceCases) / sizeof(deviceCases[0]); i++)
+  {
+    timeCase(deviceCases[i].fn, deviceCases[i].arg, t);
+    results[i][0] = t[0];
+    results[i][1] = t[BENCH_RUNS / 2];
+    results[i][2] = t[BENCH_RUNS - 1];
+  }
+
+  cmdEndLine();
+  for (uint8_t i = 0; i < sizeof(deviceCases) / sizeof(deviceCases[0]); i++)
+  {
+    uint16_t r[3];
+    for (uint8_t k = 0; k < 3; k++)
+    {
+      uint16_t v = results[i][k];
+      r[k] = (v == 0xFFFF) ? v : (v > empty ? v - empty : 0);
+    }
+    snprintf(buf, sizeof(buf), "BENCH: %-24s min %5u  median %5u  max %5u cycles",
+             deviceCases[i].name, r[0], r[1], r[2]);
+    cmdBeginLine();
+    Serial.print(buf);
+    cmdEndLine();
+  }
+  snprintf(buf, sizeof(buf), "BENCH: %u runs per case, %u MHz, empty run of %u cycles subtracted ",
+           BENCH_RUNS, (unsigned)(F_CPU / 1000000), empty);
+  cmdBeginLine();
+  Serial.print(buf);
+}
@@ -0,0 +1,138 @@
+/**
+ * Program      bode.cpp
+ *
+ * Purpose      Frequency response of a filter: the square wave on pin 9 or 10 drives
+ *              the DUT, its output is sampled on an analog pin A0 .. A5. The sweep
+ *              steps through log spaced frequencies and prints one line per step with
+ *              frequency, RMS and peak amplitude and the gain relative to the first step
+ *
+ * Wiring       Pin 9 (10) --> DUT input, DUT output --> A0 .. A5 (0 .. 5 V)
+ *
+ * Formulas     f(k) = f1 * 10^(k / steps)       k = 0, 1, .. while f(k) <= f2
+ *
+ *              The ADC runs free with prescaler 64, an interrupt adds up every sample
+ *
+ *              fs   = 16 MHz / 64 / 13 = 19'231 S/s
+ *              n    = k periods of f, k as large as fits into 4'000 samples
+ *              rms  = sqrt(n * sum(x^2) - sum(x)^2) / n      AC part, in counts
+ *              peak = (max - min) / 2
+ *              mV   = counts * 5000 / 1024
+ *
+ * Remarks      After every frequency change the DUT gets BODE_SETTLE_MS plus two periods
+ *              to settle. Measuring over whole periods keeps the RMS exact at low
+ *              frequencies. Above fs / 2 the samples still cover all phases of the
+ *              signal, so RMS and peak remain valid, except near multiples of fs / 2
+ *              where the samples keep hitting the same phase.
+ *
+ *              The response is that to a square wave: the RMS includes the harmonics
+ *              that pass the filter. 
+ */
+#include <Arduino.h>
+#include "bode.h"
+#include "generator.h"
+#include "isqrt.h"
+#include "power.h"
+#include "command.h"
+
+constexpr uint32_t BODE_FS        = F_CPU / 64 / 13;   // ADC samples per second
+constexpr uint16_t BODE_SAMPLES   = 4000;              // n max, sum(x^2) fits 32 bits
+constexpr uint32_t BODE_SETTLE_MS = 50;
+
+volatile uint16_t bdCount = 0;       // samples still to take
+volatile uint32_t bdSum   = 0;
+volatile uint32_t bdSumSq = 0;
+volatile uint16_t bdMin   = 0;
+volatile uint16_t bdMax   = 0;
+
+/**
+ * ADC conversion complete: add the sample, stop after the last one
+ */
+ISR(ADC_vect)
+{
+  uint16_t x = ADC;
+  if (bdCount == 0) return;
+  bdSum   += x;
+  bdSumSq += (uint32_t)x * x;
+  if (x < bdMin) bdMin = x;
+  if (x > bdMax) bdMax = x;
+  if (--bdCount == 0) ADCSRA &= ~((1 << ADATE) | (1 << ADIE));
+}
+
+/**
+ * Sample n values and return the AC RMS and the peak in mV
+ */
+static void measure(uint16_t n, uint32_t &rms, uint32_t &peak)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  bdSum   = 0;
+  bdSumSq = 0;
+  bdMin   = 0xFFFF;
+  bdMax   = 0;
+  bdCount = n;
+  ADCSRB  = 0;                                                           // free running
+  ADCSRA  = (1 << ADEN) | (1 << ADSC) | (1 << ADATE) | (1 << ADIF) | (1 << ADIE) | 0b110;  // prescaler 64
+  SREG = oldSREG;
+
+  uint16_t left;
+  do
+  {
+    cli();
+    left = bdCount;
+    sei();
+  } while (left);
+
+  uint64_t sum = bdSum;
+  uint64_t var = (uint64_t)n * bdSumSq - sum * sum;                      // n^2 * variance
+  rms  = (isqrt(var) * 5000UL + 512UL * n) / (1024UL * n);
+  peak = ((uint32_t)(bdMax - bdMin) * 5000UL + 1024) / 2048;
+}
+
+/**
+ * Sweep from f1 to f2 Hz and print the response measured on adcPin.
+ * A key pressed stops the sweep
+ */
+void bodeSweep(uint32_t f1, uint32_t f2, uint8_t stepsPerDecade, uint8_t adcPin, uint8_t pin)
+{
+  char     buf[64];
+  uint8_t  admux  = ADMUX;
+  uint8_t  adcsra = ADCSRA;
+  uint32_t rms0   = 0;
+
+  powerAdc(true);
+  ADMUX = (1 << REFS0) | (adcPin & 0x07);                               // AVcc reference
+  cmdBeginLine();
+  Serial.print("BODE:      f/Hz  rms/mV  peak/mV   gain/dB");
+  cmdEndLine();
+
+  for (uint16_t k = 0; ; k++)
+  {
+    uint32_t f = (uint32_t)(f1 * pow(10.0, (double)k / stepsPerDecade) + 0.5);
+    if (f > f2 || Serial.available()) break;
+
+    setFrequency(f, pin);
+    double   fOut    = getFrequencyFromRegisters();
+    uint32_t periods = (uint32_t)(BODE_SAMPLES * fOut / BODE_FS);
+    if (periods == 0) periods = 1;
+    uint32_t n = (uint32_t)(periods * BODE_FS / fOut + 0.5);
+    if (n > BODE_SAMPLES) n = BODE_SAMPLES;
+    delay(BODE_SETTLE_MS + (uint32_t)(2000 / fOut));
+
+    uint32_t rms, peak;
+    measure(n, rms, peak);
+    if (k == 0) rms0 = rms;
+    double gain = (rms && rms0) ? 20 * log10((double)rms / rms0) : -99.99;
+
+    snprintf(buf, sizeof(buf), "BODE: %10.1f %7lu %8lu %9.2f",
+             fOut, (unsigned long)rms, (unsigned long)peak, gain);
+    cmdBeginLine();
+    Serial.print(buf);
+    cmdEndLine();
+  }
+  ADMUX  = admux;
+  ADCSRA = adcsra;
+  powerAdc(false);
+  cmdBeginLine();
+  Serial.print("BODE: end");
+  cmdEndLine();
+}
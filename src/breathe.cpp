@@ -0,0 +1,179 @@
+/**
+ * Program      breathe.cpp
+ *
+ * Purpose      Modulates the duty cycle of a PWM output with an envelope for
+ *              LED driver and dimmer tests: sine, triangle (linear ramp up and down)
+ *              and exponential "breathing"
+ *
+ *              Timer1 runs in fast PWM mode 14 with TOP = ICR1 = 1023 and prescaler 1,
+ *              that gives a PWM frequency of 15'625 Hz with 10-bit resolution on
+ *              pin 9 (OC1A) or pin 10 (OC1B).
+ *
+ * Formulas     The overflow interrupt steps a 32-bit phase accumulator, the upper
+ *              8 bits address one of 256 duty values in a flash table
+ *
+ *              tw = 2^32 / (periodMs * 15.625)
+ *                 = 274'877'907 / periodMs
+ *
+ * Remarks      The tables are computed in advance (see the formulas above each
+ *              table), so at runtime there is only integer arithmetic. OCR1A/B are
+ *              double buffered in fast PWM mode: the value written in the overflow
+ *              interrupt is taken over at BOTTOM and lasts for a complete PWM period.
+ */
+#include <Arduino.h>
+#include "breathe.h"
+#include "timebase.h"
+#include "timer1.h"
+
+// round(1023 / 2 * (1 - cos(2 * pi * i / 256)))
+const uint16_t breatheSineTable[256] PROGMEM =
+{
+     0,    0,    1,    1,    2,    4,    6,    8,   10,   12,   15,   19,   22,   26,   30,   34,
+    39,   44,   49,   55,   60,   66,   73,   79,   86,   93,  101,  108,  116,  124,  133,  141,
+   150,  159,  168,  177,  187,  197,  207,  217,  227,  238,  249,  259,  270,  282,  293,  304,
+   316,  327,  339,  351,  363,  375,  387,  399,  412,  424,  436,  449,  461,  474,  486,  499,
+   511,  524,  537,  549,  562,  574,  587,  599,  611,  624,  636,  648,  660,  672,  684,  696,
+   707,  719,  730,  741,  753,  764,  774,  785,  796,  806,  816,  826,  836,  846,  855,  864,
+   873,  882,  890,  899,  907,  915,  922,  930,  937,  944,  950,  957,  963,  968,  974,  979,
+   984,  989,  993,  997, 1001, 1004, 1008, 1011, 1013, 1015, 1017, 1019, 1021, 1022, 1022, 1023,
+  1023, 1023, 1022, 1022, 1021, 1019, 1017, 1015, 1013, 1011, 1008, 1004, 1001,  997,  993,  989,
+   984,  979,  974,  968,  963,  957,  950,  944,  937,  930,  922,  915,  907,  899,  890,  882,
+   873,  864,  855,  846,  836,  826,  816,  806,  796,  785,  774,  764,  753,  741,  730,  719,
+   707,  696,  684,  672,  660,  648,  636,  624,  611,  599,  587,  574,  562,  549,  537,  524,
+   512,  499,  486,  474,  461,  449,  436,  424,  412,  399,  387,  375,  363,  351,  339,  327,
+   316,  304,  293,  282,  270,  259,  249,  238,  227,  217,  207,  197,  187,  177,  168,  159,
+   150,  141,  133,  124,  116,  108,  101,   93,   86,   79,   73,   66,   60,   55,   49,   44,
+    39,   34,   30,   26,   22,   19,   15,   12,   10,    8,    6,    4,    2,    1,    1,    0
+};
+
+// round(1023 * i / 128) rising, round(1023 * (256 - i) / 128) falling
+const uint16_t breatheTriangleTable[256] PROGMEM =
+{
+     0,    8,   16,   24,   32,   40,   48,   56,   64,   72,   80,   88,   96,  104,  112,  120,
+   128,  136,  144,  152,  160,  168,  176,  184,  192,  200,  208,  216,  224,  232,  240,  248,
+   256,  264,  272,  280,  288,  296,  304,  312,  320,  328,  336,  344,  352,  360,  368,  376,
+   384,  392,  400,  408,  416,  424,  432,  440,  448,  456,  464,  472,  480,  488,  496,  504,
+   512,  519,  527,  535,  543,  551,  559,  567,  575,  583,  591,  599,  607,  615,  623,  631,
+   639,  647,  655,  663,  671,  679,  687,  695,  703,  711,  719,  727,  735,  743,  751,  759,
+   767,  775,  783,  791,  799,  807,  815,  823,  831,  839,  847,  855,  863,  871,  879,  887,
+   895,  903,  911,  919,  927,  935,  943,  951,  959,  967,  975,  983,  991,  999, 1007, 1015,
+  1023, 1015, 1007,  999,  991,  983,  975,  967,  959,  951,  943,  935,  927,  919,  911,  903,
+   895,  887,  879,  871,  863,  855,  847,  839,  831,  823,  815,  807,  799,  791,  783,  775,
+   767,  759,  751,  743,  735,  727,  719,  711,  703,  695,  687,  679,  671,  663,  655,  647,
+   639,  631,  623,  615,  607,  599,  591,  583,  575,  567,  559,  551,  543,  535,  527,  519,
+   512,  504,  496,  488,  480,  472,  464,  456,  448,  440,  432,  424,  416,  408,  400,  392,
+   384,  376,  368,  360,  352,  344,  336,  328,  320,  312,  304,  296,  288,  280,  272,  264,
+   256,  248,  240,  232,  224,  216,  208,  200,  192,  184,  176,  168,  160,  152,  144,  136,
+   128,  120,  112,  104,   96,   88,   80,   72,   64,   56,   48,   40,   32,   24,   16,    8
+};
+
+// round((exp(-cos(2 * pi * i / 256)) - 1/e) * 1023 / (e - 1/e))
+const uint16_t breatheExpTable[256] PROGMEM =
+{
+     0,    0,    0,    0,    1,    1,    2,    2,    3,    4,    5,    6,    7,    8,   10,   11,
+    13,   14,   16,   18,   20,   22,   24,   27,   29,   32,   35,   38,   41,   44,   47,   51,
+    54,   58,   62,   66,   71,   75,   80,   85,   90,   95,  100,  106,  112,  118,  124,  130,
+   137,  144,  151,  158,  165,  173,  181,  189,  198,  207,  216,  225,  234,  244,  254,  265,
+   275,  286,  297,  308,  320,  332,  344,  356,  369,  382,  395,  408,  422,  435,  449,  464,
+   478,  493,  507,  522,  537,  552,  568,  583,  598,  614,  630,  645,  661,  676,  692,  707,
+   723,  738,  753,  768,  783,  797,  812,  826,  840,  853,  866,  879,  891,  903,  915,  926,
+   936,  946,  956,  965,  973,  981,  988,  995, 1000, 1006, 1010, 1014, 1017, 1020, 1022, 1023,
+  1023, 1023, 1022, 1020, 1017, 1014, 1010, 1006, 1000,  995,  988,  981,  973,  965,  956,  946,
+   936,  926,  915,  903,  891,  879,  866,  853,  840,  826,  812,  797,  783,  768,  753,  738,
+   723,  707,  692,  676,  661,  645,  630,  614,  598,  583,  568,  552,  537,  522,  507,  493,
+   478,  464,  449,  435,  422,  408,  395,  382,  369,  356,  344,  332,  320,  308,  297,  286,
+   275,  265,  254,  244,  234,  225,  216,  207,  198,  189,  181,  173,  165,  158,  151,  144,
+   137,  130,  124,  118,  112,  106,  100,   95,   90,   85,   80,   75,   71,   66,   62,   58,
+    54,   51,   47,   44,   41,   38,   35,   32,   29,   27,   24,   22,   20,   18,   16,   14,
+    13,   11,   10,    8,    7,    6,    5,    4,    3,    2,    2,    1,    1,    0,    0,    0
+};
+
+volatile uint32_t  brPhase      = 0;                 // phase accumulator
+volatile uint32_t  brTuningWord = 0;                 // added to the phase on every overflow
+const uint16_t * volatile brTable = breatheSineTable; // envelope in flash
+decltype(&OCR1A) volatile brOcr = &OCR1A;         // compare register of the output pin
+ENVELOPE           brEnvelope   = ENVELOPE::SINE;
+uint32_t           brPeriodMs   = 0;
+
+/**
+ * Envelope table in flash
+ */
+static const uint16_t *envelopeTable(ENVELOPE env)
+{
+  switch (env)
+  {
+    case ENVELOPE::TRIANGLE: return breatheTriangleTable;
+    case ENVELOPE::EXP:      return breatheExpTable;
+    default:                 return breatheSineTable;
+  }
+}
+
+/**
+ * Start the envelope with a period between 100 .. 60'000 ms on pin 9 or 10
+ */
+void breatheStart(ENVELOPE env, uint32_t periodMs, uint8_t pin)
+{
+  TIMSK1 = 0;
+  brEnvelope   = env;
+  brPeriodMs   = periodMs;
+  brTable      = envelopeTable(env);
+  uint32_t tw1ms = (uint32_t)(274877907ULL * TB_FO_NOMINAL / timebaseFo());  // for 1 ms, corrected
+  brTuningWord = (tw1ms + periodMs / 2) / periodMs;
+  brPhase      = 0;
+
+  // fast PWM with TOP = ICR1 (WGM13..0 = 1110), prescaler 1
+  Timer1Config t1 = {};
+  t1.icr1   = BREATHE_TOP;
+  t1.tccr1a = (pin == 10) ? (1 << COM1B1) | (1 << WGM11) : (1 << COM1A1) | (1 << WGM11);
+  t1.tccr1b = 0b00011001;
+  //               ^^  ^--- prescaler 1
+  //               WGM13, WGM12, together with WGM11 in TCCR1A: fast PWM, TOP = ICR1
+  t1.timsk1 = 1 << TOIE1;
+  breatheSetPin(pin);         // brOcr for the pin
+  timer1Commit(t1, true);
+}
+
+/**
+ * Route the PWM output to pin 9 (OC1A) or pin 10 (OC1B)
+ */
+void breatheSetPin(uint8_t pin)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (pin == 10)
+  {
+    TCCR1A = (1 << COM1B1) | (1 << WGM11);
+    brOcr  = &OCR1B;
+  }
+  else
+  {
+    TCCR1A = (1 << COM1A1) | (1 << WGM11);
+    brOcr  = &OCR1A;
+  }
+  SREG = oldSREG;
+}
+
+/**
+ * Show envelope, period and PWM frequency
+ */
+void breathePrintSettings()
+{
+  const char *names[] = { "", "SINE", "TRIANGLE", "EXP" };
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), "BREATHE: %s %lu ms, PWM: %lu Hz, TOP: %u ",
+           names[(uint8_t)brEnvelope], (unsigned long)brPeriodMs,
+           (unsigned long)BREATHE_PWM_FREQ, BREATHE_TOP);
+  Serial.print(buf);
+}
+
+/**
+ * Step the envelope once per PWM period and load the next duty
+ * into the buffer of the compare register
+ */
+ISR(TIMER1_OVF_vect)
+{
+  uint32_t phase = brPhase + brTuningWord;
+  brPhase = phase;
+  *brOcr  = pgm_read_word(brTable + (uint8_t)(phase >> 24));
+}
@@ -0,0 +1,266 @@
+/**
+ * Program      command.cpp
+ *
+ * Purpose      Dispatch of the commands declared in a table of the sketch: lookup
+ *              of the key, parsing and range check of the arguments, help text
+ *
+ * Remarks      The table is constexpr and in flash. The compiler evaluates the search
+ *              for every key 0 .. 127 and stores the result as CmdIndex, also in flash,
+ *              so the dispatch is a single lookup instead of a scan of the table.
+ *              A duplicate key is caught with a static_assert on cmdKeysUnique().
+ *
+ *              Arguments are typed in after the key, e.g. "w1 500000", within 2 s
+ *              (CMD_ARG_WAIT). The caller waits, see cmdArgCount().
+ *              They are read with Serial.parseInt() and checked against the ranges of
+ *              the table before the handler is called. A missing argument counts as out
+ *              of range. Checks that depend on the state (square wave mode, f1 <= f2)
+ *              stay in the handlers.
+ *
+ *              A tagged command of the pipeline (see pipe.cpp) comes as a whole line,
+ *              cmdParseLine() takes its arguments from the line instead of Serial and
+ *              checks them before anything is printed.
+ *
+ *              In a line a command may also be called by its name: "value 1000" is
+ *              "e1000". A word of two or more letters is a name, case is ignored, a
+ *              single letter is a key. The names are searched linearly in flash, only
+ *              for whole lines, the single keys keep the lookup of CmdIndex.
+ *
+ *              A handler leaves its last line open, the caller ends it. An output of
+ *              several lines puts every line between cmdBeginLine() and cmdEndLine().
+ *              The pipeline joins them with " | ", so every answer is one line.
+ */
+#include <Arduino.h>
+#include <ctype.h>
+#include "command.h"
+
+uint16_t cmdErrors = 0;                 // commands rejected for their arguments
+bool     cmdJoin   = false;             // lines joined into one, in the pipeline
+bool     cmdJoined = false;             // a line has been printed since cmdJoinLines()
+
+/**
+ * Argument a of command c, from flash
+ */
+static void readArg(const Command *c, uint8_t a, ArgSpec &spec)
+{
+  memcpy_P(&spec, &c->args[a], sizeof(spec));
+}
+
+static bool inRange(const ArgSpec &spec, int32_t v)
+{
+  return (v >= spec.min && v <= spec.max) || (spec.type == ARG::INT_OR_OFF && v == 0);
+}
+
+/**
+ * Print the range of an argument, e.g. "mHz 10 .. 1000000 or 0"
+ */
+static void printRange(const ArgSpec &spec, const char *fmt)
+{
+  char buf[40];
+  snprintf(buf, sizeof(buf), fmt, spec.name, (long)spec.min, (long)spec.max,
+           spec.type == ARG::INT_OR_OFF ? " or 0" : "");
+  Serial.print(buf);
+}
+
+/**
+ * Command of key, nullptr if none
+ */
+static const Command *lookup(const Command *table, const CmdIndex *index, int key)
+{
+  if (key < 0 || key >= CMD_KEYS) return nullptr;
+  int8_t i = (int8_t)pgm_read_byte(&index->at[key]);
+  return i < 0 ? nullptr : &table[i];
+}
+
+/**
+ * Command named by the word s of len letters, nullptr if none
+ */
+static const Command *lookupName(const Command *table, uint8_t n, const char *s, uint8_t len)
+{
+  if (len >= sizeof(Command::name)) return nullptr;
+  for (uint8_t i = 0; i < n; i++)
+  {
+    const char *name = table[i].name;
+    uint8_t     k    = 0;
+    while (k < len && (char)pgm_read_byte(&name[k]) == tolower(s[k])) k++;
+    if (k == len && !pgm_read_byte(&name[k])) return &table[i];
+  }
+  return nullptr;
+}
+
+/**
+ * Number of arguments the command of key takes, the caller
+ * gives the user CMD_ARG_WAIT to type them
+ */
+uint8_t cmdArgCount(const Command *table, const CmdIndex *index, int key)
+{
+  const Command *c = lookup(table, index, key);
+  return c ? pgm_read_byte(&c->nArgs) : 0;
+}
+
+/**
+ * Next number of the line, the characters before it are skipped as by parseInt()
+ */
+static bool nextInt(const char *&p, int32_t &v)
+{
+  char *end;
+  while (*p && !isdigit(*p) && *p != '-') p++;
+  if (!*p) return false;
+  v = strtol(p, &end, 10);
+  p = end;
+  return true;
+}
+
+/**
+ * Execute the command of key: parse and check its arguments, then call the handler
+ */
+void cmdDispatch(const Command *table, const CmdIndex *index, int key)
+{
+  const Command *c = lookup(table, index, key);
+  if (!c) return;
+
+  uint8_t  n = pgm_read_byte(&c->nArgs);
+  int32_t  arg[CMD_MAX_ARGS];
+  ArgSpec  spec;
+  bool     ok = true;
+
+  for (uint8_t a = 0; a < n; a++)
+  {
+    readArg(c, a, spec);
+    bool present = Serial.available();
+    arg[a] = present ? Serial.parseInt() : 0;
+    ok = ok && present && inRange(spec, arg[a]);
+  }
+  while (Serial.peek() == '\r' || Serial.peek() == '\n' || Serial.peek() == ' ') Serial.read();
+
+  if (!ok)
+  {
+    cmdErrors++;
+    cmdPrintError(c);
+    return;
+  }
+  cmdRun(c, arg);
+}
+
+/**
+ * Find the command of the key or the name at the start of line and take its
+ * arguments from the rest, e.g. "w1 500000" or "waveform 1 500000".
+ * Nothing is printed and nothing is executed
+ */
+CMD_PARSE cmdParseLine(const Command *table, uint8_t nCommands, const CmdIndex *index,
+                       const char *line, const Command **cmd, int32_t *arg)
+{
+  uint8_t len = 0;
+  while (isalpha(line[len])) len++;
+
+  const Command *c = len > 1 ? lookupName(table, nCommands, line, len)
+                             : lookup(table, index, (uint8_t)line[0]);
+  *cmd = c;
+  if (!line[0] || !c) return CMD_PARSE::UNKNOWN;
+
+  const char *p = line + (len > 1 ? len : 1);
+  uint8_t     n = pgm_read_byte(&c->nArgs);
+  ArgSpec     spec;
+
+  for (uint8_t a = 0; a < n; a++)
+  {
+    readArg(c, a, spec);
+    if (!nextInt(p, arg[a]) || !inRange(spec, arg[a]))
+    {
+      cmdErrors++;
+      return CMD_PARSE::RANGE;
+    }
+  }
+  return CMD_PARSE::OK;
+}
+
+/**
+ * Call the handler of a command with its checked arguments
+ */
+void cmdRun(const Command *c, const int32_t *arg)
+{
+  void (*handler)(const int32_t *) = (void (*)(const int32_t *))pgm_read_ptr(&c->handler);
+  handler(arg);
+}
+
+/**
+ * The ranges of the arguments of a command that were not met
+ */
+void cmdPrintError(const Command *c)
+{
+  ArgSpec spec;
+
+  Serial.print("Value out of range, allowed: ");
+  for (uint8_t a = 0; a < pgm_read_byte(&c->nArgs); a++)
+  {
+    readArg(c, a, spec);
+    printRange(spec, a ? ", %s %ld .. %ld%s" : "%s %ld .. %ld%s");
+  }
+}
+
+/**
+ * Commands rejected since the start
+ */
+uint16_t cmdErrorCount()
+{
+  return cmdErrors;
+}
+
+/**
+ * One line per command: key, help text and the arguments with their ranges
+ */
+void cmdPrintHelp(const Command *table, uint8_t n)
+{
+  char    buf[sizeof(Command::help) + 6];
+  ArgSpec spec;
+
+  for (uint8_t i = 0; i < n; i++)
+  {
+    const Command *c = &table[i];
+    cmdBeginLine();
+    snprintf(buf, sizeof(buf), "[%c] ", (char)pgm_read_byte(&c->key));
+    Serial.print(buf);
+    memcpy_P(buf, c->name, sizeof(Command::name));
+    Serial.print(buf);
+    for (uint8_t k = strlen(buf); k < sizeof(Command::name); k++) Serial.print(' ');
+    memcpy_P(buf, c->help, sizeof(Command::help));
+    Serial.print(buf);
+    for (uint8_t a = 0; a < pgm_read_byte(&c->nArgs); a++)
+    {
+      readArg(c, a, spec);
+      printRange(spec, " <%s %ld..%ld%s>");
+    }
+    cmdEndLine();
+  }
+}
+
+/**
+ * Join the lines of the outputs into one, until turned off again
+ */
+void cmdJoinLines(bool join)
+{
+  cmdJoin   = join;
+  cmdJoined = false;
+}
+
+bool cmdLinesJoined()
+{
+  return cmdJoin;
+}
+
+/**
+ * Start a line of an output of several lines: joined, after
+ * the first one, a separator instead of the line end
+ */
+void cmdBeginLine()
+{
+  if (cmdJoin && cmdJoined) Serial.print(" | ");
+  cmdJoined = true;
+}
+
+/**
+ * End a line of an output of several lines, unless joined
+ */
+void cmdEndLine()
+{
+  if (!cmdJoin) Serial.println();
+}
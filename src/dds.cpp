@@ -0,0 +1,216 @@
+/**
+ * Program      dds.cpp
+ *
+ * Purpose      Direct digital synthesis of low frequency square waves with Timer1.
+ *              Timer1 runs in CTC mode at a fixed rate of DDS_FS = 62'500 Hz. On
+ *              every compare match the interrupt adds a 32-bit tuning word to a
+ *              phase accumulator and copies the MSB of the accumulator to the
+ *              output pin 9 or 10
+ *
+ * Formulas     f  = tw * fs / 2^32,  fs = 62'500 Hz
+ *              tw = f * 2^32 / fs
+ *                 = mHz * 2^32 / 62'500'000
+ *
+ *              resolution = fs / 2^32 = 14.55 uHz, independent of the frequency
+ *
+ *              fs is corrected with the PPS timebase (see timebase.cpp)
+ *
+ * Remarks      The ISR is written in assembler and only uses r24..r26. The instruction
+ *              timings from the datasheet give
+ *
+ *                interrupt response + jmp from the vector table     7 cycles
+ *                sbis skipping the jmp to timer1CompAHook           3 cycles
+ *                prologue (push r24..r26, save SREG)                9 cycles
+ *                32-bit add, 4 x (lds, lds, add/adc, sts)          29 cycles
+ *                MSB change detection and toggle via PINB           5 cycles
+ *                epilogue (restore SREG, pop r24..r26) and reti    13 cycles
+ *                ---------------------------------------------------------
+ *                total                                             66 cycles
+ *
+ *              Every 256 cycles an interrupt takes 66 cycles, the DDS mode costs
+ *              about 25 % of the CPU. The toggle is always executed 52 cycles after
+ *              the compare match (plus the 1..4 cycles the CPU needs to finish the
+ *              current instruction), so the ISR itself adds no jitter.
+ *
+ * Trade-off    CTC mode (setFrequency)      DDS mode (ddsStart)
+ *              ------------------------------------------------------------------
+ *              edges made by hardware       edges made by the ISR
+ *              no jitter                    edges snap to the 16 us sample grid:
+ *                                           jitter 16 us p-p, that is 1.6 % of
+ *                                           the period at 1 kHz, 0.16 % at 100 Hz
+ *                                           plus up to ~6 us when the millis()
+ *                                           interrupt delays the DDS interrupt
+ *              frequency steps depend on    steps of 14.55 uHz over the
+ *              prescaler and OCR1A, e.g.    whole range 0.001 .. 1000 Hz
+ *              1000 Hz -> 0.125 Hz steps
+ *              100 Hz  -> 0.01 Hz steps
+ *              no CPU load                  about 25 % CPU load
+ *
+ *              The DDS mode is the right choice when the average frequency must be
+ *              exact to a few uHz, the CTC mode when clean edges matter.
+ *
+ *              The compare A vector is shared with the other modes that need it: when
+ *              the DDS flag in GPIOR0 is cleared (see timer1.h), the ISR jumps to
+ *              timer1CompAHook, which calls timer1CompAHandler.
+ */
+#include <Arduino.h>
+#include "dds.h"
+#include "timer1.h"
+#include "timebase.h"
+
+volatile uint32_t ddsPhase      = 0;      // phase accumulator
+volatile uint32_t ddsTuningWord = 0;      // added to the phase on every interrupt
+volatile uint8_t  ddsPinMask    = 0;      // bit of PORTB toggled through PINB
+
+void (* volatile timer1CompAHandler)() = nullptr;
+
+/**
+ * Bit in port B for pin 9 or 10
+ */
+static uint8_t pinMask(uint8_t pin)
+{
+  return pin == 10 ? _BV(PB2) : _BV(PB1);
+}
+
+/**
+ * Start DDS with a frequency between 1 .. 1'000'000 mHz on pin 9 or 10
+ */
+void ddsStart(uint32_t mHz, uint8_t pin)
+{
+  uint32_t fs = timebaseScale(DDS_FS * 1000);   // in mHz
+  uint32_t tw = (uint32_t)((((uint64_t)mHz << 32) + fs / 2) / fs);
+
+  Timer1Config t1 = {};
+  t1.tccr1a = 0;              // OC1A and OC1B disconnected, pins driven by PORTB
+  t1.tccr1b = 0b00001001;     // CTC mode, prescaler 1
+  t1.ocr1a  = DDS_OCR1A;
+  t1.timsk1 = 1 << OCIE1A;    // compare match A interrupt
+
+  TIMSK1 = 0;                 // no interrupts while reconfiguring
+  ddsPhase      = 0;
+  ddsTuningWord = tw;
+  ddsPinMask    = pinMask(pin);
+  PORTB &= ~(_BV(PB1) | _BV(PB2)); // MSB of the phase is 0, so start low
+  GPIOR0 |= 1 << T1_DDS_FLAG; // compare A interrupt takes the DDS fast path
+  timer1Commit(t1, true);
+}
+
+/**
+ * Move the DDS output to pin 9 or 10
+ */
+void ddsSetPin(uint8_t pin)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  PORTB &= ~(_BV(PB1) | _BV(PB2));
+  if (ddsPhase & 0x80000000UL) PORTB |= pinMask(pin);
+  ddsPinMask = pinMask(pin);
+  SREG = oldSREG;
+}
+
+/**
+ * Effective DDS frequency in mHz computed from the tuning word
+ */
+uint32_t ddsGetFrequency_mHz()
+{
+  uint32_t tw;
+  uint8_t oldSREG = SREG;
+  cli();
+  tw = ddsTuningWord;
+  SREG = oldSREG;
+  return (uint32_t)(((uint64_t)tw * timebaseScale(DDS_FS * 1000) + 0x80000000ULL) >> 32);
+}
+
+/**
+ * Show effective frequency and tuning word
+ */
+void ddsPrintSettings()
+{
+  char     buf[64];
+  uint32_t mHz = ddsGetFrequency_mHz();
+
+  snprintf(buf, sizeof(buf), "DDS: %lu.%03lu Hz, TW: 0x%08lX, FS: %lu Hz ",
+           (unsigned long)(mHz / 1000), (unsigned long)(mHz % 1000),
+           (unsigned long)ddsTuningWord, (unsigned long)timebaseScale(DDS_FS));
+  Serial.print(buf);
+}
+
+/**
+ * Compare A interrupt of the other modes, entered by a jump from
+ * the vector. As a signal handler it saves what it uses and returns
+ * with reti
+ */
+extern "C" void timer1CompAHook() __attribute__((signal, used));
+void timer1CompAHook()
+{
+  if (timer1CompAHandler) timer1CompAHandler();
+}
+
+#ifdef __AVR__
+/**
+ * Add the tuning word to the phase and toggle the output pin
+ * whenever the MSB of the phase changes. Naked, because the
+ * compiler generated prologue would save r0, r1 and clear r1
+ */
+ISR(TIMER1_COMPA_vect, ISR_NAKED)
+{
+  asm volatile(
+    "sbis %[gpior0], %[flag]  \n\t"   // DDS active? skip the jump
+    "jmp  timer1CompAHook     \n\t"
+    "push r24                 \n\t"
+    "in   r24, __SREG__       \n\t"
+    "push r24                 \n\t"
+    "push r25                 \n\t"
+    "push r26                 \n\t"
+    "lds  r24, %[ph]+0        \n\t"   // byte 0
+    "lds  r25, %[tw]+0        \n\t"
+    "add  r24, r25            \n\t"
+    "sts  %[ph]+0, r24        \n\t"
+    "lds  r24, %[ph]+1        \n\t"   // byte 1, lds and sts keep the carry
+    "lds  r25, %[tw]+1        \n\t"
+    "adc  r24, r25            \n\t"
+    "sts  %[ph]+1, r24        \n\t"
+    "lds  r24, %[ph]+2        \n\t"   // byte 2
+    "lds  r25, %[tw]+2        \n\t"
+    "adc  r24, r25            \n\t"
+    "sts  %[ph]+2, r24        \n\t"
+    "lds  r26, %[ph]+3        \n\t"   // byte 3, keep old value in r26
+    "lds  r25, %[tw]+3        \n\t"
+    "mov  r24, r26            \n\t"
+    "adc  r24, r25            \n\t"
+    "sts  %[ph]+3, r24        \n\t"
+    "eor  r26, r24            \n\t"   // bit 7 set if the MSB has changed
+    "lds  r25, %[mask]        \n\t"
+    "sbrc r26, 7              \n\t"
+    "out  %[pinb], r25        \n\t"   // writing 1 to PINB toggles PORTB
+    "pop  r26                 \n\t"
+    "pop  r25                 \n\t"
+    "pop  r24                 \n\t"
+    "out  __SREG__, r24       \n\t"
+    "pop  r24                 \n\t"
+    "reti                     \n\t"
+    :
+    : [ph]   "i" (&ddsPhase),
+      [tw]   "i" (&ddsTuningWord),
+      [mask] "i" (&ddsPinMask),
+      [pinb] "I" (_SFR_IO_ADDR(PINB)),
+      [gpior0] "I" (_SFR_IO_ADDR(GPIOR0)),
+      [flag] "I" (T1_DDS_FLAG)
+  );
+}
+#else
+/**
+ * Host build: the same in C
+ */
+ISR(TIMER1_COMPA_vect)
+{
+  if (!(GPIOR0 & (1 << T1_DDS_FLAG)))
+  {
+    timer1CompAHook();
+    return;
+  }
+  uint32_t old = ddsPhase;
+  ddsPhase = old + ddsTuningWord;
+  if ((old ^ ddsPhase) & 0x80000000UL) PINB = ddsPinMask;
+}
+#endif
@@ -0,0 +1,110 @@
+/**
+ * Program      mem.cpp
+ *
+ * Purpose      RAM usage of the 2 KB SRAM: static data, heap, free RAM and the
+ *              deepest the stack has been since boot
+ *
+ * Formulas     0x100                                                 RAMEND 0x8FF
+ *              | .data | .bss | heap ->     free      <- stack |
+ *
+ *              static = __bss_end - __data_start
+ *              free   = SP - top of the heap
+ *
+ * Remarks      In .init1, before the C runtime initializes anything, the RAM from
+ *              the end of .bss to RAMEND is painted with MEM_PAINT. The stack maximum
+ *              is found by scanning upward from the top of the heap to the first byte
+ *              that has been written. A local array that is never written to the end
+ *              hides its unwritten bytes, so the value is a lower bound.
+ *
+ *              malloc() overwrites the paint. The logic analyzer paints its buffer
+ *              again after free(), the stack maximum starts over then.
+ */
+#include <Arduino.h>
+#include "mem.h"
+
+#ifdef __AVR__
+extern char __data_start, __data_end, __bss_start, __bss_end, __heap_start;
+extern char *__brkval;
+
+/**
+ * Paint the free RAM. Naked and in assembler, r1 is not yet zero
+ * and the stack pointer not yet set in .init1
+ */
+extern "C" void memPaintAtBoot() __attribute__((naked, used, section(".init1")));
+void memPaintAtBoot()
+{
+  asm volatile(
+    "ldi  r30, lo8(__bss_end)   \n\t"
+    "ldi  r31, hi8(__bss_end)   \n\t"
+    "ldi  r24, %[paint]         \n\t"
+    "ldi  r25, hi8(%[end])      \n\t"
+    "rjmp 2f                    \n\t"
+    "1: st Z+, r24              \n\t"
+    "2: cpi r30, lo8(%[end])    \n\t"
+    "cpc  r31, r25              \n\t"
+    "brlo 1b                    \n\t"
+    "breq 1b                    \n\t"
+    :
+    : [paint] "M" (MEM_PAINT),
+      [end]   "i" (RAMEND)
+  );
+}
+
+static char *heapTop()
+{
+  return __brkval ? __brkval : &__heap_start;
+}
+
+/**
+ * Bytes between the top of the heap and the stack
+ */
+uint16_t memFree()
+{
+  char top;
+  return &top - heapTop();
+}
+
+/**
+ * Deepest stack since boot in bytes
+ */
+uint16_t memStackMax()
+{
+  uint8_t *p = (uint8_t *)heapTop();
+  while (p <= (uint8_t *)RAMEND && *p == MEM_PAINT) p++;
+  return (uint8_t *)RAMEND - p + 1;
+}
+
+/**
+ * Paint the free RAM below the current stack frame again
+ */
+void memRepaint()
+{
+  uint8_t *p   = (uint8_t *)heapTop();
+  uint8_t *top = (uint8_t *)SP - 16;    // leave the frames of this call alone
+  while (p < top) *p++ = MEM_PAINT;
+}
+
+/**
+ * Show static data, heap, free RAM and the stack maximum
+ */
+void memPrintSettings()
+{
+  char buf[96];
+  snprintf(buf, sizeof(buf), "MEM: data: %u, bss: %u, heap: %u, free: %u, stack max: %u of %u bytes ",
+           (unsigned)(&__data_end - &__data_start), (unsigned)(&__bss_end - &__bss_start),
+           (unsigned)(heapTop() - &__heap_start), memFree(), memStackMax(), RAMEND - RAMSTART + 1);
+  Serial.print(buf);
+}
+#else
+/**
+ * Host build: no linker symbols and no painting, RAM is no limit
+ */
+uint16_t memFree()     { return RAMEND - RAMSTART + 1; }
+uint16_t memStackMax() { return 0; }
+void     memRepaint()  { }
+
+void memPrintSettings()
+{
+  Serial.print("MEM: not available in the host build ");
+}
+#endif
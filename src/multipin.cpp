@@ -0,0 +1,249 @@
+/**
+ * Program      multipin.cpp
+ *
+ * Purpose      Up to 8 independent low frequency square waves (0.01 .. 1000 Hz) on
+ *              arbitrary pins 2 .. 19, all made by Timer1
+ *
+ * Formulas     Timer1 runs in CTC mode with prescaler 64, one tick is 4 us
+ *
+ *              half = 250'000 / (2 * f)
+ *                   = 125'000'000 / mHz      half period in ticks
+ *
+ *              1000 Hz -> 125 ticks, 0.01 Hz -> 12'500'000 ticks
+ *
+ *              The ticks per second are corrected with the PPS timebase (see timebase.cpp)
+ *
+ * Remarks      Every channel has an absolute deadline for its next toggle. A binary
+ *              min-heap of channel indices keeps the earliest deadline on top. The
+ *              compare A interrupt toggles all channels that are due by writing their
+ *              bit to the PINx register, advances their deadlines by the half period
+ *              and programs OCR1A for the next deadline. Distances above 65'536 ticks
+ *              are split into chunks of 65'536 ticks. Because the deadlines are
+ *              absolute, the latency of the ISR does not accumulate.
+ *
+ *              In CTC mode the new OCR1A must be ahead of TCNT1, otherwise the timer
+ *              runs through 0xFFFF. The ISR therefore handles all deadlines that are
+ *              due within the ticks already elapsed plus MP_MIN_STEP = 2 ticks:
+ *
+ *                minimum spacing between events    2 ticks + ISR time, about 30 us.
+ *                                                  Closer events are toggled in the
+ *                                                  same pass, up to 8 us early
+ *
+ *              The time of one pass, estimated from the generated code:
+ *
+ *                dispatch from the vector and register save      ~ 70 cycles
+ *                per toggled channel (toggle, sift down 3 levels) ~ 200 cycles
+ *                next OCR1A and return                           ~ 60 cycles
+ *
+ *                one channel due     ~ 330 cycles =  21 us
+ *                all 8 channels due  ~ 1730 cycles = 108 us (worst case)
+ *
+ *              The ISR measures itself with TCNT1 (4 us resolution) and the maximum
+ *              is shown with the settings.
+ */
+#include <Arduino.h>
+#include "multipin.h"
+#include "timer1.h"
+#include "timebase.h"
+
+constexpr uint16_t MP_MIN_STEP = 2;
+
+typedef struct
+{
+  uint32_t deadline;            // tick of the next toggle
+  uint32_t half;                // half period in ticks, 0 = channel unused
+  decltype(&PINB)   pinReg;     // PINx register, writing the mask toggles the pin
+  uint8_t  mask;
+  uint8_t  pin;
+} Channel;
+
+Channel           mpChannels[MP_MAX_CHANNELS];
+uint8_t           mpHeap[MP_MAX_CHANNELS];  // channel indices, earliest deadline first
+volatile uint8_t  mpHeapSize = 0;
+volatile uint32_t mpNow      = 0;           // tick of the last compare match
+volatile uint32_t mpStep     = 1;           // ticks from the last to the next compare match
+volatile uint8_t  mpIsrMax   = 0;           // max ticks used by the ISR
+
+/**
+ * True if deadline of channel a is earlier than the one of channel b.
+ * The difference makes the comparison safe against the wrap of the ticks
+ */
+static inline bool earlier(uint8_t a, uint8_t b)
+{
+  return (int32_t)(mpChannels[a].deadline - mpChannels[b].deadline) < 0;
+}
+
+/**
+ * Move the entry at position i down to its place in the heap
+ */
+static void siftDown(uint8_t i)
+{
+  uint8_t n = mpHeapSize;
+  for (;;)
+  {
+    uint8_t l = 2 * i + 1;
+    uint8_t r = l + 1;
+    uint8_t m = i;
+    if (l < n && earlier(mpHeap[l], mpHeap[m])) m = l;
+    if (r < n && earlier(mpHeap[r], mpHeap[m])) m = r;
+    if (m == i) return;
+    uint8_t t = mpHeap[i]; mpHeap[i] = mpHeap[m]; mpHeap[m] = t;
+    i = m;
+  }
+}
+
+/**
+ * Rebuild the heap from all used channels
+ */
+static void buildHeap()
+{
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < MP_MAX_CHANNELS; i++)
+  {
+    if (mpChannels[i].half) mpHeap[n++] = i;
+  }
+  mpHeapSize = n;
+  for (int8_t i = n / 2 - 1; i >= 0; i--) siftDown(i);
+}
+
+/**
+ * Compare A interrupt: toggle what is due and program the next compare match
+ */
+static void mpIsr()
+{
+  uint32_t now  = mpNow + mpStep;
+  uint32_t step = 65536;
+  mpNow = now;
+
+  if (mpHeapSize)
+  {
+    for (;;)
+    {
+      Channel &ch = mpChannels[mpHeap[0]];
+      int32_t  d  = (int32_t)(ch.deadline - now);
+      if (d > (int32_t)TCNT1 + MP_MIN_STEP)
+      {
+        if (d < 65536) step = d;
+        break;
+      }
+      *ch.pinReg   = ch.mask;
+      ch.deadline += ch.half;
+      siftDown(0);
+    }
+  }
+  mpStep = step;
+  OCR1A  = step - 1;
+
+  uint8_t t = TCNT1;
+  if (t > mpIsrMax) mpIsrMax = t;
+}
+
+/**
+ * Let the ISR reschedule within MP_MIN_STEP ticks, in case a new deadline comes
+ * first. TCNT1 is read right before OCR1A is written, and the write is repeated
+ * if the counter has passed it meanwhile, else CTC runs through 0xFFFF and all
+ * channels stop for 262 ms. Called with the interrupts off
+ */
+static void rescheduleNow()
+{
+  uint32_t next = (uint32_t)TCNT1 + MP_MIN_STEP;
+  if (next >= OCR1A) return;                  // the next compare match comes first anyway
+
+  for (;;)
+  {
+    OCR1A  = next;
+    mpStep = next + 1;
+    uint16_t t = TCNT1;
+    if (t <= next) return;                    // still ahead, or matched and cleared
+    next = (uint32_t)t + MP_MIN_STEP;
+    if (next > 0xFFFF) next = 0xFFFF;
+  }
+}
+
+/**
+ * Timer1 in CTC mode with prescaler 64, no channels
+ */
+void mpStart()
+{
+  TIMSK1 = 0;
+  memset(mpChannels, 0, sizeof(mpChannels));
+  mpHeapSize = 0;
+  mpNow      = 0;
+  mpStep     = 65536;
+  mpIsrMax   = 0;
+  Timer1Config t1 = {};
+  t1.tccr1a = 0;              // OC1A and OC1B disconnected
+  t1.tccr1b = 0b00001011;     // CTC mode, prescaler 64
+  t1.ocr1a  = 0xFFFF;
+  t1.timsk1 = 1 << OCIE1A;
+  timer1AttachCompA(mpIsr);
+  timer1Commit(t1, true);
+}
+
+/**
+ * Set the frequency of the square wave on pin, 0 mHz removes the channel.
+ * Returns false if the pin is out of range or all channels are used
+ */
+bool mpSetChannel(uint8_t pin, uint32_t mHz)
+{
+  int8_t slot = -1;
+
+  if (pin < MP_MIN_PIN || pin > MP_MAX_PIN) return false;
+  for (uint8_t i = 0; i < MP_MAX_CHANNELS; i++)
+  {
+    if (mpChannels[i].half && mpChannels[i].pin == pin) { slot = i; break; }
+    if (slot < 0 && mpChannels[i].half == 0) slot = i;
+  }
+  if (slot < 0) return false;
+
+  // the divisions take a few hundred us, done before the interrupts are off
+  uint32_t half   = 0;
+  auto     pinReg = portInputRegister(digitalPinToPort(pin));
+  uint8_t  mask   = digitalPinToBitMask(pin);
+  if (mHz) 
+  {
+    half = (timebaseScale(125000000UL) + mHz / 2) / mHz;
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+  }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  Channel &ch = mpChannels[slot];
+  if (mHz)
+  {
+    ch.pin      = pin;
+    ch.pinReg   = pinReg;
+    ch.mask     = mask;
+    ch.half     = half;
+    ch.deadline = mpNow + TCNT1 + half;
+  }
+  else
+  {
+    ch.half = 0;
+  }
+  buildHeap();
+  if (mHz) rescheduleNow();
+  SREG = oldSREG;
+  return true;
+}
+
+/**
+ * Show the channels and the measured ISR time
+ */
+void mpPrintSettings()
+{
+  char buf[48];
+
+  Serial.print("MULTI:");
+  for (uint8_t i = 0; i < MP_MAX_CHANNELS; i++)
+  {
+    if (mpChannels[i].half == 0) continue;
+    uint32_t mHz = (timebaseScale(125000000UL) + mpChannels[i].half / 2) / mpChannels[i].half;
+    snprintf(buf, sizeof(buf), " pin %u: %lu.%03lu Hz,", mpChannels[i].pin,
+             (unsigned long)(mHz / 1000), (unsigned long)(mHz % 1000));
+    Serial.print(buf);
+  }
+  snprintf(buf, sizeof(buf), " ISR max: %u us ", mpIsrMax * 4);
+  Serial.print(buf);
+}
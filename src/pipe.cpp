@@ -0,0 +1,201 @@
+/**
+ * Program      pipe.cpp
+ *
+ * Purpose      Pipeline of tagged commands for scripted sweeps: the host sends the
+ *              next commands without waiting for the answers, each one with a tag,
+ *              and every answer carries the tag of its command
+ *
+ * Formulas     Command:  #<tag> <menu command or SCPI line>\n      tag 0 .. 65535
+ *
+ *                        #17 e1000
+ *                        #18 FREQ?;OUTP:STAT?
+ *
+ *              Answer:   #17 ACK <output of the command>\r\n
+ *                        #17 NAK <reason>\r\n            not executed
+ *                        #17 BUSY\r\n                    queue full, send it again
+ *
+ *              Bytes in the queue: line + 1 per command, PIPE_QUEUE - 1 at most
+ *
+ * Remarks      The command line reads a tagged line as soon as it has come and puts
+ *              it into the queue, in one pass with all the tagged lines received after
+ *              it. The pipe task executes the queued commands in order, one per pass.
+ *              So a command needs no CMD_ARG_WAIT, and the next ones are read while
+ *              one is executed.
+ *
+ *              ACK and NAK are decided before the command runs: a menu command by its
+ *              key and the ranges of its arguments, a SCPI line by all of its headers
+ *              and parameters. A NAK command has done nothing. A handler may still
+ *              refuse in the state of the generator, e.g. [p] outside of the square
+ *              wave mode: it is acknowledged and its output says so.
+ *
+ *              Every answer is one line: the handlers leave their last line open,
+ *              the lines of an output of several lines ([T], [P], [S]) are joined
+ *              with " | " (see cmdJoinLines()).
+ *
+ *              Back-pressure: a line that does not fit into the queue is answered
+ *              BUSY at once and dropped, the host sends it again after the next
+ *              answer. The queue is filled from the 64 byte receive buffer of Serial,
+ *              which holds what comes in while a command runs, so the host keeps
+ *              less than 64 bytes of commands unanswered beyond the queue. Commands
+ *              that run long ([x], [B], [a], [g]) hold the line for all of their run.
+ */
+#include <Arduino.h>
+#include <ctype.h>
+#include "pipe.h"
+
+static_assert(PIPE_QUEUE <= 256 && (PIPE_QUEUE & (PIPE_QUEUE - 1)) == 0, "PIPE_QUEUE: power of 2 up to 256");
+static_assert(PIPE_QUEUE - 1 >= SCPI_LINE + 1, "PIPE_QUEUE: a line of SCPI_LINE must fit");
+
+uint8_t  pipeBuf[PIPE_QUEUE];           // length byte, then the line, for every command
+uint8_t  pipeHead     = 0;              // next byte to put
+uint8_t  pipeTail     = 0;              // next byte to execute
+int32_t  pipeLastTag  = -1;             // of the line rejected
+bool     pipeTooLong  = false;
+uint32_t pipeDone     = 0;              // commands executed
+uint16_t pipeBusy     = 0;              // lines rejected, queue full
+uint8_t  pipeMaxUsed  = 0;              // high-water mark of the queue
+
+static uint8_t used()
+{
+  return (uint8_t)(pipeHead - pipeTail) & (PIPE_QUEUE - 1);
+}
+
+/**
+ * Tag after the '#', -1 if there is none. Returns the command after it
+ */
+static const char *parseTag(const char *line, int32_t *tag)
+{
+  const char *p = line + 1;
+  *tag = -1;
+  if (isdigit(*p))
+  {
+    *tag = 0;
+    while (isdigit(*p) && *tag <= 65535) *tag = *tag * 10 + (*p++ - '0');
+    if (*tag > 65535 || (*p && *p != ' ')) *tag = -1;
+  }
+  while (*p == ' ') p++;
+  return p;
+}
+
+static void printTag(int32_t tag)
+{
+  char buf[8];
+  if (tag < 0)
+    Serial.print("#? ");
+  else
+  {
+    snprintf(buf, sizeof(buf), "#%u ", (uint16_t)tag);
+    Serial.print(buf);
+  }
+}
+
+/**
+ * Put the tagged line the command line has read into the queue.
+ * Returns false if it is too long or does not fit, see pipeReject()
+ */
+bool pipeQueue()
+{
+  const char *line;
+  uint8_t     len = scpiTake(&line, &pipeTooLong);
+
+  parseTag(line, &pipeLastTag);
+  if (pipeTooLong) return false;
+  if (len + 1 > PIPE_QUEUE - 1 - used())
+  {
+    pipeBusy++;
+    return false;
+  }
+  pipeBuf[pipeHead++ & (PIPE_QUEUE - 1)] = len;
+  for (uint8_t i = 0; i < len; i++) pipeBuf[pipeHead++ & (PIPE_QUEUE - 1)] = line[i];
+  if (used() > pipeMaxUsed) pipeMaxUsed = used();
+  return true;
+}
+
+/**
+ * Answer the line pipeQueue() has not taken
+ */
+void pipeReject()
+{
+  printTag(pipeLastTag);
+  Serial.println(pipeTooLong ? "NAK Line too long" : "BUSY");
+}
+
+/**
+ * Is there a command in the queue?
+ */
+bool pipePending()
+{
+  return pipeHead != pipeTail;
+}
+
+/**
+ * Execute the oldest command of the queue and answer it with its tag
+ */
+void pipeExecute(const Command *table, uint8_t nCommands, const CmdIndex *index,
+                 const ScpiCommand *scpiTable, uint8_t nScpi)
+{
+  char           line[SCPI_LINE + 1];
+  int32_t        tag;
+  const Command *c;
+  int32_t        arg[CMD_MAX_ARGS];
+  uint8_t        len = pipeBuf[pipeTail++ & (PIPE_QUEUE - 1)];
+
+  for (uint8_t i = 0; i < len; i++) line[i] = pipeBuf[pipeTail++ & (PIPE_QUEUE - 1)];
+  line[len] = 0;
+
+  const char *body   = parseTag(line, &tag);
+  uint8_t     n      = len - (body - line);
+  CMD_PARSE   result = cmdParseLine(table, nCommands, index, body, &c, arg);
+  printTag(tag);
+  pipeDone++;
+  cmdJoinLines(true);
+
+  if (tag < 0)
+    Serial.print("NAK Missing tag");
+  else if (!n)
+    Serial.print("NAK Missing command");
+  else if (result == CMD_PARSE::UNKNOWN && scpiStart(body[0], n > 1 ? body[1] : -1))
+  {
+    int16_t error = scpiCheck(scpiTable, nScpi, body, n);
+    if (error)
+    {
+      Serial.print("NAK ");
+      scpiPrintErrorText(error);
+    }
+    else
+    {
+      Serial.print("ACK ");
+      scpiExecuteLine(scpiTable, nScpi, body, n);
+    }
+  }
+  else
+  {
+    if (result == CMD_PARSE::UNKNOWN)
+      Serial.print("NAK Unknown command");
+    else if (result == CMD_PARSE::RANGE)
+    {
+      Serial.print("NAK ");
+      cmdPrintError(c);
+    }
+    else
+    {
+      Serial.print("ACK ");
+      cmdRun(c, arg);
+    }
+  }
+  cmdJoinLines(false);
+  Serial.println();
+}
+
+/**
+ * Show the commands executed, the lines rejected and the fill of the queue
+ */
+void pipePrintSettings()
+{
+  char buf[80];
+  snprintf(buf, sizeof(buf), "PIPE: executed %lu, busy %u, queue %u of %u bytes, max %u",
+           (unsigned long)pipeDone, pipeBusy, used(), PIPE_QUEUE - 1, pipeMaxUsed);
+  cmdBeginLine();
+  Serial.print(buf);
+  cmdEndLine();
+}
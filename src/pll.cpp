@@ -0,0 +1,309 @@
+/**
+ * Program      pll.cpp
+ *
+ * Purpose      Software PLL: locks the output on pin 9 (or 10) to N/M times the
+ *              frequency of a reference signal on pin 8 (ICP1), e.g. 1 kHz derived
+ *              from a 10 MHz lab reference
+ *
+ * Wiring       Reference 1 Hz .. 20 kHz, 5 V logic level, on pin 8
+ *
+ * Formulas     Timer1 runs in CTC mode, the output toggles at the end of each cycle.
+ *              A frame consists of M reference periods and must contain exactly
+ *              2N timer cycles (N output periods). The cycle length L is kept as a
+ *              fixed point number with 8 fractional bits and dithered: the compare
+ *              interrupt accumulates the fraction and sets OCR1A to L or L + 1
+ *
+ *              L = Tframe / (2N)                cycle length in ticks
+ *              f = fcpu / pre / (2L)            output frequency
+ *
+ *              Phase detector: the input capture gives the tick of every M-th
+ *              reference edge. The phase error e is its distance in ticks to the
+ *              nearest frame boundary of the output. A PI loop in integer arithmetic
+ *              corrects the cycle length
+ *
+ *              u = e * 256 / (2N)               error per cycle, 8 fractional bits
+ *              I = I + u / 4
+ *              L = I + u
+ *
+ * Remarks      Acquisition: the first two frames are measured with prescaler 1 and
+ *              TOP = 0xFFFF. From Tframe follows the start value of L and the smallest
+ *              prescaler for which L fits into OCR1A. After that the loop tracks the
+ *              phase. It reports LOCKED after 8 frames in a row with |e| <= 16 ticks
+ *              and falls back to TRACK when |e| exceeds 64 ticks.
+ *
+ *              The compare interrupt must write OCR1A before TCNT1 gets there, so a
+ *              cycle must be at least PLL_MIN_CYCLES long, which limits the output to
+ *              about 20 kHz. The capture interrupt runs on every reference edge, so
+ *              the reference must stay below about 20 kHz. The PI computation runs
+ *              with interrupts enabled, to let the compare interrupt through.
+ */
+#include <Arduino.h>
+#include "pll.h"
+#include "timer1.h"
+#include "timebase.h"
+
+constexpr uint32_t PLL_MIN_CYCLES   = 400;   // shortest timer cycle in CPU cycles
+constexpr int32_t  PLL_LOCK_WINDOW  = 16;    // |e| in ticks for lock
+constexpr uint8_t  PLL_LOCK_FRAMES  = 8;     // frames within the window until LOCKED
+constexpr uint32_t PLL_REF_TIMEOUT  = 2000;  // ms without a frame until NO_REF
+
+volatile PLL_STATE pllState      = PLL_STATE::ACQUIRE;
+volatile uint16_t  pll2N         = 2;       // timer cycles per frame
+volatile uint16_t  pllM          = 1;       // reference periods per frame
+volatile uint16_t  pllRefCount   = 0;       // reference edges in the current frame
+volatile uint16_t  pllCycle      = 0;       // timer cycle in the current frame
+volatile uint32_t  pllTime       = 0;       // tick at the start of the current cycle
+volatile uint32_t  pllFrameTime  = 0;       // tick at the start of the current frame
+volatile uint16_t  pllCurLen     = 0;       // length of the current cycle in ticks
+volatile uint32_t  pllL          = 0;       // cycle length, 8 fractional bits
+volatile uint8_t   pllAcc        = 0;       // dither accumulator
+volatile int32_t   pllI          = 0;       // integrator, 8 fractional bits
+volatile uint32_t  pllLastTs     = 0;       // tick of the last frame edge in acquisition
+volatile uint8_t   pllAcqFrames  = 0;       // frame edges seen in acquisition
+volatile int32_t   pllError      = 0;       // last phase error in ticks
+volatile uint32_t  pllAvgError   = 0;       // average of |e|, 4 fractional bits
+volatile uint8_t   pllInWindow   = 0;       // frames in a row within the lock window
+volatile uint32_t  pllLastFrameMs = 0;      // millis() of the last frame
+uint16_t           pllN          = 1;
+uint16_t           pllPre        = 1;
+
+/**
+ * Compare A interrupt: count the cycles, mark the frame boundaries
+ * and set the dithered length of the cycle that has just begun
+ */
+static void pllCompA()
+{
+  pllTime += pllCurLen;
+  if (++pllCycle >= pll2N)
+  {
+    pllCycle     = 0;
+    pllFrameTime = pllTime;
+  }
+
+  uint32_t l   = pllL;
+  uint16_t len = l >> 8;
+  uint8_t  acc = pllAcc + (uint8_t)l;
+  if (acc < pllAcc) len++;                    // carry of the fraction
+  pllAcc    = acc;
+  pllCurLen = len;
+  OCR1A     = len - 1;
+}
+
+/**
+ * Prescaler bits of TCCR1B for the prescaler
+ */
+static uint8_t preBits(uint16_t pre)
+{
+  switch (pre)
+  {
+    case 8:   return 0b010;
+    case 64:  return 0b011;
+    case 256: return 0b100;
+    default:  return 0b001;
+  }
+}
+
+/**
+ * Start at prescaler 1 with the longest cycle and wait for the reference
+ */
+void pllStart(uint16_t n, uint16_t m, uint8_t pin)
+{
+  TIMSK1 = 0;
+  pllN         = n;
+  pll2N        = 2 * n;
+  pllM         = m;
+  pllPre       = 1;
+  pllRefCount  = 0;
+  pllCycle     = 0;
+  pllTime      = 0;
+  pllFrameTime = 0;
+  pllCurLen    = 0xFFFF;
+  pllL         = 0xFFFFUL << 8;
+  pllAcc       = 0;
+  pllError     = 0;
+  pllAvgError  = 0;
+  pllInWindow  = 0;
+  pllLastTs    = 0;
+  pllAcqFrames = 0;
+  pllLastFrameMs = millis();
+  pllState     = PLL_STATE::ACQUIRE;
+
+  pinMode(8, INPUT);
+  Timer1Config t1 = {};
+  t1.ocr1a  = 0xFFFE;
+  t1.ocr1b  = 0;              // pin 10 toggles at BOTTOM, whatever the length of the cycle
+  t1.tccr1a = (pin == 10) ? 1 << COM1B0 : 1 << COM1A0;
+  t1.tccr1b = (1 << ICES1) | (1 << WGM12) | 0b001;   // capture rising edge, CTC, prescaler 1
+  t1.timsk1 = (1 << ICIE1) | (1 << OCIE1A);
+  timer1AttachCompA(pllCompA);
+  timer1Commit(t1, true);
+}
+
+/**
+ * Route the output to pin 9 (OC1A) or pin 10 (OC1B)
+ */
+void pllSetPin(uint8_t pin)
+{
+  TCCR1A = (pin == 10) ? 1 << COM1B0 : 1 << COM1A0;
+}
+
+/**
+ * Current state, NO_REF if the reference has gone
+ */
+PLL_STATE pllGetState()
+{
+  uint32_t last;
+  uint8_t oldSREG = SREG;
+  cli();
+  last = pllLastFrameMs;
+  SREG = oldSREG;
+  if (pllState != PLL_STATE::OUT_OF_RANGE && millis() - last > PLL_REF_TIMEOUT * pllM)
+  {
+    return PLL_STATE::NO_REF;
+  }
+  return pllState;
+}
+
+/**
+ * Output frequency in mHz from the current cycle length
+ */
+uint32_t pllGetFrequency_mHz()
+{
+  uint32_t l;
+  uint8_t oldSREG = SREG;
+  cli();
+  l = pllL;
+  SREG = oldSREG;
+
+  // f = fcpu / pre / (2 * L / 256) in mHz
+  return (uint32_t)(((uint64_t)timebaseFo() * 256000ULL + (uint64_t)pllPre * l / 2) / ((uint64_t)pllPre * l));
+}
+
+/**
+ * Show ratio, state, output frequency and phase error
+ */
+void pllPrintSettings()
+{
+  const char *names[] = { "ACQUIRE", "TRACK", "LOCKED", "NO REF", "OUT OF RANGE" };
+  char     buf[96];
+  int32_t  e;
+  uint32_t avg;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  e   = pllError;
+  avg = pllAvgError;
+  SREG = oldSREG;
+
+  uint32_t mHz  = pllGetFrequency_mHz();
+  int32_t  ns   = e * (int32_t)pllPre * 1000 / (int32_t)(F_CPU / 1000000);
+  snprintf(buf, sizeof(buf), "PLL: %u/%u, %s, %lu.%03lu Hz, PRESC: %u, ",
+           pllN, pllM, names[(uint8_t)pllGetState()],
+           (unsigned long)(mHz / 1000), (unsigned long)(mHz % 1000), pllPre);
+  Serial.print(buf);
+  snprintf(buf, sizeof(buf), "phase error: %ld ticks (%ld ns), avg: %lu ",
+           (long)e, (long)ns, (unsigned long)(avg >> 4));
+  Serial.print(buf);
+}
+
+/**
+ * Acquisition: measure two frames and choose prescaler and start length
+ */
+static void pllAcquire(uint32_t ts)
+{
+  if (pllAcqFrames++ == 0)
+  {
+    pllLastTs = ts;
+    return;
+  }
+  uint32_t tframe = ts - pllLastTs;
+  uint64_t l      = ((uint64_t)tframe << 8) / pll2N;   // at prescaler 1
+  uint16_t pre    = 1;
+
+  while (pre <= 256 && (l / pre) > (0xFFFFUL << 8))
+  {
+    pre = (pre < 64) ? pre * 8 : pre * 4;
+  }
+  if (pre > 256 || l < ((uint64_t)PLL_MIN_CYCLES << 8))
+  {
+    pllState = PLL_STATE::OUT_OF_RANGE;
+    TIMSK1  &= ~(1 << ICIE1);
+    return;
+  }
+
+  cli();
+  pllPre    = pre;
+  pllL      = (uint32_t)(l / pre);
+  pllI      = (int32_t)pllL;
+  pllCycle  = 0;
+  pllTime   = 0;
+  pllFrameTime = 0;
+  pllCurLen = pllL >> 8;
+  OCR1A     = pllCurLen - 1;
+  TCNT1     = 0;
+  TCCR1B    = (TCCR1B & ~0b111) | preBits(pre);
+  pllState  = PLL_STATE::TRACK;
+  sei();
+}
+
+/**
+ * Tracking: PI loop on the phase error
+ */
+static void pllTrack(uint32_t ts, uint32_t frameTime)
+{
+  uint32_t frameLen = (uint32_t)(((uint64_t)pllL * pll2N) >> 8);
+  int32_t  e = (int32_t)(ts - frameTime);
+  if (e >  (int32_t)(frameLen / 2)) e -= frameLen;   // the next boundary is closer
+  if (e < -(int32_t)(frameLen / 2)) e += frameLen;
+
+  int32_t u = (int32_t)(((int64_t)e << 8) / pll2N);
+  int32_t i = pllI + u / 4;
+  int32_t l = i + u;
+  if (l < (int32_t)((PLL_MIN_CYCLES / pllPre + 1) << 8)) l = (PLL_MIN_CYCLES / pllPre + 1) << 8;
+  if (l > (int32_t)(0xFFFFUL << 8)) l = 0xFFFFUL << 8;
+
+  uint32_t absE = e < 0 ? -e : e;
+  uint32_t avg  = pllAvgError - (pllAvgError >> 3) + (absE << 1);  // average over 8 frames
+
+  cli();
+  pllI        = i;
+  pllL        = l;
+  pllError    = e;
+  pllAvgError = avg;
+  sei();
+
+  if (absE <= PLL_LOCK_WINDOW)
+  {
+    if (pllInWindow < PLL_LOCK_FRAMES) pllInWindow++;
+    else pllState = PLL_STATE::LOCKED;
+  }
+  else
+  {
+    pllInWindow = 0;
+    if (absE > 4 * PLL_LOCK_WINDOW) pllState = PLL_STATE::TRACK;
+  }
+}
+
+/**
+ * Input capture: take the tick of every M-th reference edge
+ * and run acquisition or the loop with interrupts enabled
+ */
+ISR(TIMER1_CAPT_vect)
+{
+  uint16_t icr = ICR1;
+  if (++pllRefCount < pllM) return;
+  pllRefCount = 0;
+
+  // compare A still pending and capture after the wrap: the cycle has already ended
+  uint32_t ts = pllTime + icr;
+  if ((TIFR1 & (1 << OCF1A)) && icr < pllCurLen / 2) ts += pllCurLen;
+  uint32_t frameTime = pllFrameTime;
+  pllLastFrameMs = millis();
+
+  TIMSK1 &= ~(1 << ICIE1);
+  sei();
+  if (pllState == PLL_STATE::ACQUIRE) pllAcquire(ts);
+  else                                pllTrack(ts, frameTime);
+  cli();
+  if (pllState != PLL_STATE::OUT_OF_RANGE) TIMSK1 |= 1 << ICIE1;
+}
@@ -0,0 +1,186 @@
+/**
+ * Program      power.cpp
+ *
+ * Purpose      Power saving between the events: the CPU sleeps in idle mode when
+ *              no task has work (see sched.cpp) and the modules that are not in
+ *              use get no clock. Reports per generator mode how long the CPU has
+ *              been asleep, how often it woke up and how long the wake-up took
+ *
+ * Formulas     I = (Iactive * (t - tsleep) + Iidle * tsleep) / t
+ *
+ *              Iactive, Iidle: PWR_ACTIVE_UA, PWR_IDLE_UA, typical values of the
+ *              MCU alone. The chip cannot measure its current, so this is an
+ *              estimate from the measured idle share; a meter in the supply gives
+ *              the real value.
+ *
+ *              wake latency = TCNT0 after the wake-up * 64 cycles
+ *
+ * Remarks      In idle mode the CPU clock stops, the timers, the UART and the pin
+ *              change interrupt keep running, so the output is not affected. Every
+ *              interrupt wakes the CPU: the millis() tick every 1.024 ms, a received
+ *              character, and the interrupts of the generator modes (DDS 62.5 kHz,
+ *              waveform 31.25 kHz, ...).
+ *
+ *              PRR: SPI and TWI are never used and stay off. The ADC is off except
+ *              while the temperature is read or a Bode sweep runs, Timer2 except in
+ *              waveform mode. The ADC is disabled (ADEN) before its clock is stopped,
+ *              as the datasheet asks. The analog comparator is switched off.
+ *
+ *              The wake latency is measured for the wake-ups by the millis() tick:
+ *              Timer0 has overflowed during the sleep when TCNT0 is lower after it
+ *              than before. TCNT0 counts with fcpu / 64, so the resolution is 4 us.
+ *              The latency includes the millis() interrupt and any other interrupt
+ *              served before the code after the sleep runs.
+ *
+ *              The counters are added to the current mode once a second by the
+ *              task that calls powerAccount(), a mode change counts from there.
+ */
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
+#include "power.h"
+#include "command.h"
+
+typedef struct
+{
+  uint32_t ms;                                  // time in the mode
+  uint32_t sleepMs;
+  uint32_t wakes;
+  uint32_t latSum;                              // Timer0 ticks
+  uint32_t latN;
+  uint8_t  latMax;
+} PowerStats;
+
+PowerStats pwStats[PWR_MODES];
+uint32_t   pwSleepUs = 0;                       // counters since the last powerAccount()
+uint32_t   pwWakes   = 0;
+uint32_t   pwLatSum  = 0;
+uint32_t   pwLatN    = 0;
+uint8_t    pwLatMax  = 0;
+uint32_t   pwLast    = 0;                       // millis() of the last powerAccount()
+
+/**
+ * Stop the clock of the modules that are not used
+ */
+void powerBegin()
+{
+  powerAdc(false);
+  powerTimer2(false);
+  power_spi_disable();
+  power_twi_disable();
+  ACSR |= 1 << ACD;                             // analog comparator off
+  pwLast = millis();
+}
+
+/**
+ * Clock of the ADC on or off. The caller sets ADCSRA after turning it on
+ */
+void powerAdc(bool on)
+{
+  if (on)
+  {
+    power_adc_enable();
+  }
+  else
+  {
+    ADCSRA = 0;                                 // ADEN cleared first
+    power_adc_disable();
+  }
+}
+
+/**
+ * Clock of Timer2 on or off
+ */
+void powerTimer2(bool on)
+{
+  if (on) power_timer2_enable();
+  else    power_timer2_disable();
+}
+
+/**
+ * Sleep in idle mode until the next interrupt,
+ * returns the time asleep in us
+ */
+uint32_t powerSleep()
+{
+  uint32_t start = micros();
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  uint8_t t0 = TCNT0;
+  sleep_cpu();
+  uint8_t t1 = TCNT0;
+  sleep_disable();
+  uint32_t us = micros() - start;
+
+  pwSleepUs += us;
+  pwWakes++;
+  if (t1 < t0)                                  // woken by the millis() tick
+  {
+    pwLatSum += t1;
+    pwLatN++;
+    if (t1 > pwLatMax) pwLatMax = t1;
+  }
+  return us;
+}
+
+/**
+ * Add the counters since the last call to mode
+ */
+void powerAccount(uint8_t mode)
+{
+  uint32_t now = millis();
+  if (mode >= PWR_MODES) mode = PWR_MODES - 1;
+
+  PowerStats *s = &pwStats[mode];
+  s->ms      += now - pwLast;
+  s->sleepMs += pwSleepUs / 1000;
+  s->wakes   += pwWakes;
+  s->latSum  += pwLatSum;
+  s->latN    += pwLatN;
+  if (pwLatMax > s->latMax) s->latMax = pwLatMax;
+
+  pwLast    = now;
+  pwSleepUs = 0;
+  pwWakes   = 0;
+  pwLatSum  = 0;
+  pwLatN    = 0;
+  pwLatMax  = 0;
+}
+
+/**
+ * Show the modules that get no clock and, for every mode that
+ * has run, idle share, wake-ups, wake latency and the current
+ */
+void powerPrintSettings(const char *const *names, uint8_t n)
+{
+  char    buf[100];
+  uint8_t prr = PRR;
+
+  snprintf(buf, sizeof(buf), "POWER: sleep IDLE, off: %s%s%s%s",
+           prr & (1 << PRADC)  ? "ADC " : "", prr & (1 << PRTIM2) ? "Timer2 " : "",
+           prr & (1 << PRSPI)  ? "SPI " : "", prr & (1 << PRTWI)  ? "TWI " : "");
+  cmdBeginLine();
+  Serial.print(buf);
+  cmdEndLine();
+  for (uint8_t i = 0; i < n && i < PWR_MODES; i++)
+  {
+    const PowerStats *s = &pwStats[i];
+    if (!s->ms) continue;
+
+    uint32_t sleepMs = s->sleepMs < s->ms ? s->sleepMs : s->ms;
+    uint32_t idle    = (uint32_t)((uint64_t)sleepMs * 1000 / s->ms);           // 0.1 %
+    uint32_t wakes   = (uint32_t)((uint64_t)s->wakes * 1000 / s->ms);          // per s
+    uint32_t uA      = (uint32_t)(((uint64_t)PWR_ACTIVE_UA * (s->ms - sleepMs)
+                                 + (uint64_t)PWR_IDLE_UA * sleepMs) / s->ms);
+    uint32_t latAvg  = s->latN ? s->latSum * 4 / s->latN : 0;                  // us
+    snprintf(buf, sizeof(buf), "  %-11s idle %3lu.%lu %%, %6lu wakes/s, ",
+             names[i], (unsigned long)(idle / 10), (unsigned long)(idle % 10), (unsigned long)wakes);
+    cmdBeginLine();
+    Serial.print(buf);
+    snprintf(buf, sizeof(buf), "latency avg %lu max %u us, %lu.%lu mA, %lu s",
+             (unsigned long)latAvg, s->latMax * 4, (unsigned long)(uA / 1000), (unsigned long)(uA % 1000 / 100),
+             (unsigned long)(s->ms / 1000));
+    Serial.print(buf);
+    cmdEndLine();
+  }
+}
@@ -0,0 +1,216 @@
+/**
+ * Program      sched.cpp
+ *
+ * Purpose      Cooperative scheduler of the tasks that loop() used to poll: command
+ *              line, heartbeat, timebase, temperature measurement and EEPROM writes.
+ *              Every task declares its period and the time budget of a run, the
+ *              scheduler counts the runs over budget and the periods missed
+ *
+ * Formulas     Deadlines on the millis() tick, without drift:
+ *
+ *              due = due + period
+ *
+ *              A task that is a whole period behind skips the missed runs
+ *              (late + 1) and continues one period after now.
+ *
+ *              idle = time asleep / time since the last report
+ *
+ *              Load, measured every second by schedMeasure():
+ *
+ *              loop = 1 - time asleep / 1 s
+ *              ISR  = 1 - n / n0
+ *
+ *              n counts the turns of a spin loop while Timer0 advances by 1 ms,
+ *              n0 the same with the interrupts disabled, taken once at the start.
+ *              Every cycle an interrupt takes is missing from n.
+ *
+ * Remarks      A task is a protothread (see sched.h): a function that returns at
+ *              every wait and continues there at the next call. A task that returns
+ *              PT_WAITING at the same wait as before has done nothing and is not
+ *              counted as a run. A task with period 0 is called on every pass, e.g.
+ *              the command line waiting for a key.
+ *
+ *              When no task has done any work in a pass, the CPU sleeps in idle mode
+ *              (see power.cpp). The timers and the UART keep running, the next
+ *              interrupt wakes it up: at the latest the millis() tick after 1 ms, a
+ *              received character at once. A run is timed with micros(), so its length is known to 4 us.
+ *              The statistics are kept until the next reset, the idle time since the
+ *              last report.
+ *
+ *              The interrupts are disabled for the 1 ms of the calibration of n0 in
+ *              schedBegin(). The spin of the ISR load runs with interrupts, it costs
+ *              1 ms every second. Interrupts served outside of the sleep count in both
+ *              loads.
+ */
+#include <Arduino.h>
+#include "sched.h"
+#include "power.h"
+#include "command.h"
+
+const Task *schedTable = nullptr;
+TaskState  *schedState = nullptr;
+uint8_t     schedCount = 0;
+uint32_t    schedIdleUs = 0;                // time asleep since schedSince
+uint32_t    schedSince  = 0;                // micros() of the last report
+uint32_t    schedWinIdleUs = 0;             // time asleep since schedWinStart
+uint32_t    schedWinStart  = 0;             // micros() of the last schedMeasure()
+uint16_t    schedSpin0     = 0;             // spin() with the interrupts disabled
+uint16_t    schedLoopLoad  = 0;             // 0.1 %
+uint16_t    schedIsrLoad   = 0;             // 0.1 %
+
+/**
+ * Turns of an empty loop while Timer0 advances by 1 ms
+ */
+static uint16_t spin()
+{
+  uint16_t n     = 0;
+  uint8_t  start = TCNT0;
+  while ((uint8_t)(TCNT0 - start) < SCHED_SPIN_TICKS) n++;
+  return n;
+}
+
+/**
+ * Take the table of the tasks, all of them are due now
+ */
+void schedBegin(const Task *table, TaskState *state, uint8_t n)
+{
+  schedTable = table;
+  schedState = state;
+  schedCount = n;
+  memset(state, 0, n * sizeof(TaskState));
+  for (uint8_t i = 0; i < n; i++) state[i].due = millis();
+
+  uint8_t oldSREG = SREG;
+  cli();
+  schedSpin0 = spin();
+  SREG = oldSREG;
+
+  schedIdleUs    = 0;
+  schedSince     = micros();
+  schedWinIdleUs = 0;
+  schedWinStart  = schedSince;
+}
+
+/**
+ * Run the due tasks once. Returns true if one of them has done some work
+ */
+bool schedRun()
+{
+  bool busy = false;
+
+  for (uint8_t i = 0; i < schedCount; i++)
+  {
+    const Task *t = &schedTable[i];
+    TaskState  *s = &schedState[i];
+    uint16_t period = pgm_read_word(&t->period);
+    uint32_t now    = millis();
+
+    if (period)
+    {
+      if ((int32_t)(now - s->due) < 0) continue;
+      s->due += period;
+      if ((int32_t)(now - s->due) >= 0)
+      {
+        s->late++;
+        s->due = now + period;
+      }
+    }
+
+    uint8_t (*fn)(Pt *) = (uint8_t (*)(Pt *))pgm_read_ptr(&t->fn);
+    uint16_t lc    = s->pt.lc;
+    uint32_t start = micros();
+    uint8_t  state = fn(&s->pt);
+    uint32_t us    = micros() - start;
+    if (state == PT_WAITING && s->pt.lc == lc) continue;   // still at the same wait
+
+    busy = true;
+    s->runs++;
+    if (us > s->maxUs) s->maxUs = us;
+    if (us > pgm_read_word(&t->budget)) s->overruns++;
+  }
+  return busy;
+}
+
+/**
+ * Sleep in idle mode until the next interrupt
+ */
+void schedIdle()
+{
+  uint32_t us = powerSleep();
+  schedIdleUs    += us;
+  schedWinIdleUs += us;
+}
+
+/**
+ * Loop load of the last second and the ISR load now.
+ * To be called every second
+ */
+void schedMeasure()
+{
+  uint32_t now   = micros();
+  uint32_t total = now - schedWinStart;
+  uint32_t idle  = total ? (uint32_t)((uint64_t)schedWinIdleUs * 1000 / total) : 1000;
+  schedLoopLoad  = idle < 1000 ? 1000 - idle : 0;
+  schedWinIdleUs = 0;
+  schedWinStart  = now;
+
+  uint16_t n   = spin();
+  schedIsrLoad = n < schedSpin0 ? (uint32_t)(schedSpin0 - n) * 1000 / schedSpin0 : 0;
+}
+
+/**
+ * Loop and ISR load in 0.1 %, see schedMeasure()
+ */
+void schedLoad(uint16_t *loop, uint16_t *isr)
+{
+  *loop = schedLoopLoad;
+  *isr  = schedIsrLoad;
+}
+
+/**
+ * Runs over budget and periods missed of all tasks
+ */
+void schedErrors(uint16_t *overruns, uint16_t *late)
+{
+  *overruns = 0;
+  *late     = 0;
+  for (uint8_t i = 0; i < schedCount; i++)
+  {
+    *overruns += schedState[i].overruns;
+    *late     += schedState[i].late;
+  }
+}
+
+/**
+ * Show period, budget and the statistics of every task
+ * and the idle time since the last report
+ */
+void schedPrintSettings()
+{
+  char     buf[100];
+  uint32_t now   = micros();
+  uint32_t total = now - schedSince;
+  uint32_t idle  = total ? (uint32_t)((uint64_t)schedIdleUs * 1000 / total) : 0;
+
+  snprintf(buf, sizeof(buf), "SCHED: idle %lu.%lu %% over %lu ms, load: loop %u.%u %%, ISR %u.%u %%",
+           (unsigned long)(idle / 10), (unsigned long)(idle % 10), (unsigned long)(total / 1000),
+           schedLoopLoad / 10, schedLoopLoad % 10, schedIsrLoad / 10, schedIsrLoad % 10);
+  cmdBeginLine();
+  Serial.print(buf);
+  cmdEndLine();
+  for (uint8_t i = 0; i < schedCount; i++)
+  {
+    const Task      *t = &schedTable[i];
+    const TaskState *s = &schedState[i];
+    char name[sizeof(Task::name)];
+    memcpy_P(name, t->name, sizeof(name));
+    snprintf(buf, sizeof(buf), "  %-9s %5u ms %5u us  runs %lu, max %lu us, overruns %u, late %u",
+             name, pgm_read_word(&t->period), pgm_read_word(&t->budget), (unsigned long)s->runs,
+             (unsigned long)s->maxUs, s->overruns, s->late);
+    cmdBeginLine();
+    Serial.print(buf);
+    cmdEndLine();
+  }
+  schedIdleUs = 0;
+  schedSince  = now;
+}
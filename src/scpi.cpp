@@ -0,0 +1,474 @@
+/**
+ * Program      scpi.cpp
+ *
+ * Purpose      SCPI subset for test executives: lines like "FREQ 1000",
+ *              "OUTPut:STATe OFF" or "SYST:ERR?" are read next to the single-key
+ *              menu, matched against a table of the sketch and executed
+ *
+ * Formulas     Header: mnemonics separated by ':', a leading ':' is allowed,
+ *              '?' at the end makes it a query. Every mnemonic is accepted in the
+ *              short form (the capitals of the table) or the long form, in upper
+ *              or lower case: FREQ, freq, FREQuency, :FREQUENCY.
+ *
+ *              Parameters follow after a blank, separated by ','. Numbers are
+ *              decimal with an optional fraction and exponent, rounded to an
+ *              integer: 1000, 1E3, 1.5e6, 0.5
+ *
+ *              Several commands in a line are separated by ';', each with its
+ *              full header: "FREQ 1000;OUTP:STAT ON"
+ *
+ * Remarks      A line starts with '*', ':' or two letters. A menu key is a single
+ *              letter followed by a digit, a blank or the end of the line, so the
+ *              command line waits SCPI_WAIT for the second character of a letter
+ *              before it decides.
+ *
+ *              Nothing is allocated or copied: the line is collected in a static
+ *              buffer, the tokens are pointers into it. The headers of the table
+ *              stay in flash. A header is rejected at its first mnemonic that
+ *              does not match.
+ *
+ *              The table declares the parameters as for the menu: a range for a
+ *              number or the keywords allowed. They are checked before the handler
+ *              runs, so a command that fails has done nothing.
+ *
+ *              Only queries answer. The answers of one line are separated by ';',
+ *              the line is ended by "\r\n". Errors go into a queue of SCPI_ERRORS
+ *              entries. When it is full, the last one becomes -350. SYST:ERR? takes
+ *              out the oldest, 0,"No error" when empty.
+ */
+#include <Arduino.h>
+#include <ctype.h>
+#include "scpi.h"
+
+constexpr int16_t  SCPI_DATA_TYPE  = -104;
+constexpr uint32_t SCPI_INT_DIGITS = UINT32_MAX / 10;   // below it one more digit fits
+
+typedef struct
+{
+  int16_t code;
+  char    text[24];
+} ScpiErrorText;
+
+const ScpiErrorText scpiErrorTexts[] PROGMEM =
+{
+  { SCPI_NO_ERROR,          "No error" },
+  { SCPI_SYNTAX,            "Syntax error" },
+  { SCPI_DATA_TYPE,         "Data type error" },
+  { SCPI_PARAM_NOT_ALLOWED, "Parameter not allowed" },
+  { SCPI_MISSING_PARAM,     "Missing parameter" },
+  { SCPI_UNDEFINED_HEADER,  "Undefined header" },
+  { SCPI_SETTINGS_CONFLICT, "Settings conflict" },
+  { SCPI_OUT_OF_RANGE,      "Data out of range" },
+  { SCPI_ILLEGAL_VALUE,     "Illegal parameter value" },
+  { SCPI_QUEUE_OVERFLOW,    "Queue overflow" },
+};
+
+char    scpiLine[SCPI_LINE + 1];
+uint8_t scpiLen      = 0;
+bool    scpiTooLong  = false;
+bool    scpiActive   = false;              // a line is being read or waits to be executed
+bool    scpiAnswered = false;              // an answer of the line has been printed
+int16_t scpiErrQueue[SCPI_ERRORS];
+uint8_t scpiErrFirst = 0;
+uint8_t scpiErrCount = 0;
+
+/**
+ * Character of a string in flash or in RAM
+ */
+static char charAt(const char *p, bool flash)
+{
+  return flash ? (char)pgm_read_byte(p) : *p;
+}
+
+/**
+ * Upper case of a letter, inline instead of the call of toupper()
+ */
+static inline char upper(char c)
+{
+  return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+/**
+ * Does the mnemonic s match the word at p, in the short or the long form?
+ * The word ends at ':', '?', '|' or the end of the string, its length is returned
+ */
+static bool matchWord(const char *s, uint8_t len, const char *p, bool flash, uint8_t *wordLen)
+{
+  uint8_t n        = 0;
+  uint8_t shortLen = 0;
+  bool    inShort  = true;
+  bool    same     = true;
+  char    c;
+
+  while ((c = charAt(p + n, flash)) && c != ':' && c != '?' && c != '|')
+  {
+    if (n < len && upper(s[n]) != upper(c)) same = false;
+    if (inShort && upper(c) == c) shortLen++;
+    else inShort = false;
+    n++;
+  }
+  *wordLen = n;
+  return same && (len == n || len == shortLen);
+}
+
+/**
+ * Does the header s match the header of the table at p (flash)?
+ */
+static bool matchHeader(const char *s, uint8_t len, const char *p)
+{
+  uint8_t i = (len && s[0] == ':') ? 1 : 0;
+
+  for (;;)
+  {
+    uint8_t start = i;
+    uint8_t wordLen;
+    while (i < len && s[i] != ':' && s[i] != '?') i++;
+    if (!matchWord(s + start, i - start, p, true, &wordLen)) return false;
+    p += wordLen;
+
+    char sep = (char)pgm_read_byte(p);
+    if (i == len) return sep == 0;
+    if (s[i] != sep) return false;
+    i++;
+    p++;
+    if (sep == '?') return i == len;
+  }
+}
+
+/**
+ * Number with optional fraction and exponent, rounded to an integer.
+ * Returns 0 or the error code if it is none or too large
+ */
+static int16_t toInt(const ScpiParam *param, int32_t *value)
+{
+  const char *s      = param->s;
+  const char *end    = s + param->len;
+  bool        minus  = false;
+  uint32_t    v      = 0;
+  int16_t     exp    = 0;
+  uint8_t     digits = 0;
+
+  if (s < end && (*s == '+' || *s == '-')) minus = *s++ == '-';
+  for (; s < end && isdigit(*s); s++, digits++)
+  {
+    if (v < SCPI_INT_DIGITS) v = v * 10 + (*s - '0');
+    else exp++;                                   // digits that do not fit only scale
+  }
+  if (s < end && *s == '.')
+  {
+    for (s++; s < end && isdigit(*s); s++, digits++)
+    {
+      if (v >= SCPI_INT_DIGITS) continue;
+      v = v * 10 + (*s - '0');
+      exp--;
+    }
+  }
+  if (digits && s < end && (*s == 'E' || *s == 'e'))
+  {
+    bool    expMinus = false;
+    int16_t e        = 0;
+    if (++s < end && (*s == '+' || *s == '-')) expMinus = *s++ == '-';
+    if (s == end) digits = 0;
+    for (; s < end && isdigit(*s); s++) if (e < 100) e = e * 10 + (*s - '0');
+    exp += expMinus ? -e : e;
+  }
+  if (!digits || s != end) return SCPI_DATA_TYPE;
+
+  for (; exp < 0 && v; exp++) v = (exp == -1) ? (v + 5) / 10 : v / 10;
+  for (; exp > 0 && v && v <= INT32_MAX; exp--) v = v > INT32_MAX / 10 ? (uint32_t)INT32_MAX + 1 : v * 10;
+  if (v > INT32_MAX) return SCPI_OUT_OF_RANGE;
+  *value = minus ? -(int32_t)v : (int32_t)v;
+  return SCPI_NO_ERROR;
+}
+
+/**
+ * Number of a parameter checked by the table
+ */
+int32_t scpiInt(const ScpiParam *param)
+{
+  int32_t value = 0;
+  toInt(param, &value);
+  return value;
+}
+
+/**
+ * Is the parameter one of the keywords "ON|OFF|1|0" in flash?
+ */
+static bool isChoice(const ScpiParam *param, const char *p)
+{
+  uint8_t wordLen;
+
+  for (;;)
+  {
+    if (matchWord(param->s, param->len, p, true, &wordLen)) return true;
+    p += wordLen;
+    if (pgm_read_byte(p++) != '|') return false;
+  }
+}
+
+/**
+ * Check a parameter against the table: a keyword of the choices
+ * or a number in the range, if the command declares them
+ */
+static int16_t checkParam(const ScpiCommand *c, const ScpiParam *param)
+{
+  int32_t value;
+
+  if (pgm_read_byte(&c->choices[0]))
+    return isChoice(param, c->choices) ? SCPI_NO_ERROR : SCPI_ILLEGAL_VALUE;
+
+  int32_t min = pgm_read_dword(&c->min);
+  int32_t max = pgm_read_dword(&c->max);
+  if (!min && !max) return SCPI_NO_ERROR;
+  int16_t error = toInt(param, &value);
+  if (error) return error;
+  return (value < min || value > max) ? SCPI_OUT_OF_RANGE : SCPI_NO_ERROR;
+}
+
+/**
+ * Split the command s into header and parameters, find the header in the table
+ * and check the parameters. Returns the index of the command or a negative error code
+ */
+int16_t scpiParse(const ScpiCommand *table, uint8_t n, const char *s, uint8_t len,
+                  ScpiParam *param, uint8_t *nParams)
+{
+  uint8_t i = 0;
+  while (i < len && s[i] == ' ') i++;
+  uint8_t header = i;
+  while (i < len && s[i] != ' ') i++;
+  uint8_t headerLen = i - header;
+  if (!headerLen) return SCPI_SYNTAX;
+
+  *nParams = 0;
+  while (i < len)
+  {
+    while (i < len && s[i] == ' ') i++;
+    if (i == len) break;
+    if (*nParams == SCPI_MAX_PARAMS) return SCPI_PARAM_NOT_ALLOWED;
+    uint8_t start = i;
+    while (i < len && s[i] != ',') i++;
+    uint8_t end = i;
+    while (end > start && s[end - 1] == ' ') end--;
+    if (end == start) return SCPI_SYNTAX;
+    param[*nParams].s   = s + start;
+    param[*nParams].len = end - start;
+    (*nParams)++;
+    if (i < len && ++i == len) return SCPI_SYNTAX;   // ',' without a parameter
+  }
+
+  for (uint8_t c = 0; c < n; c++)
+  {
+    if (!matchHeader(s + header, headerLen, table[c].header)) continue;
+    uint8_t expected = pgm_read_byte(&table[c].nParams);
+    if (*nParams < expected) return SCPI_MISSING_PARAM;
+    if (*nParams > expected) return SCPI_PARAM_NOT_ALLOWED;
+    for (uint8_t p = 0; p < *nParams; p++)
+    {
+      int16_t error = checkParam(&table[c], &param[p]);
+      if (error) return error;
+    }
+    return c;
+  }
+  return SCPI_UNDEFINED_HEADER;
+}
+
+/**
+ * Can key start a SCPI line, with next the character after it (-1 if none)?
+ */
+bool scpiStart(int key, int next)
+{
+  if (key == '*' || key == ':') return true;
+  return key >= 0 && isalpha(key) && next >= 0 && isalpha(next);
+}
+
+/**
+ * Start a line with its first character
+ */
+void scpiBegin(char key)
+{
+  scpiLine[0] = key;
+  scpiLen     = 1;
+  scpiTooLong = false;
+  scpiActive  = true;
+}
+
+/**
+ * Take the characters received. Returns true at the end of the line
+ */
+bool scpiRead()
+{
+  while (Serial.available())
+  {
+    char c = Serial.read();
+    if (c == '\n') return true;
+    if (c == '\r') continue;
+    if (scpiLen < SCPI_LINE)
+      scpiLine[scpiLen++] = c;
+    else
+      scpiTooLong = true;
+  }
+  return false;
+}
+
+/**
+ * Is there a line to execute?
+ */
+bool scpiPending()
+{
+  return scpiActive;
+}
+
+/**
+ * Take the line read without executing it, for the tagged commands of the
+ * pipeline and the names of commands. Returns its length, tooLong if characters
+ * were lost. The line stays, scpiExecute() can still run it
+ */
+uint8_t scpiTake(const char **line, bool *tooLong)
+{
+  scpiActive = false;
+  *line      = scpiLine;
+  *tooLong   = scpiTooLong;
+  scpiLine[scpiLen] = 0;
+  return scpiLen;
+}
+
+/**
+ * Check all commands of a line without executing them.
+ * Returns 0 or the error code of the first that fails
+ */
+int16_t scpiCheck(const ScpiCommand *table, uint8_t n, const char *line, uint8_t len)
+{
+  ScpiParam param[SCPI_MAX_PARAMS];
+  uint8_t   nParams;
+  uint8_t   start = 0;
+
+  while (start < len)
+  {
+    uint8_t end = start;
+    while (end < len && line[end] != ';') end++;
+    int16_t c = scpiParse(table, n, line + start, end - start, param, &nParams);
+    if (c < 0) return c;
+    start = end + 1;
+  }
+  return SCPI_NO_ERROR;
+}
+
+/**
+ * Execute the commands of a line one after the other, the
+ * errors go into the queue. Returns true if one has answered
+ */
+bool scpiExecuteLine(const ScpiCommand *table, uint8_t n, const char *line, uint8_t len)
+{
+  ScpiParam param[SCPI_MAX_PARAMS];
+  uint8_t   nParams;
+  uint8_t   start = 0;
+
+  scpiAnswered = false;
+  while (start < len)
+  {
+    uint8_t end = start;
+    while (end < len && line[end] != ';') end++;
+    int16_t c = scpiParse(table, n, line + start, end - start, param, &nParams);
+    if (c < 0)
+      scpiError(c);
+    else
+    {
+      void (*handler)(const ScpiParam *) = (void (*)(const ScpiParam *))pgm_read_ptr(&table[c].handler);
+      handler(param);
+    }
+    start = end + 1;
+  }
+  return scpiAnswered;
+}
+
+/**
+ * Execute the line read, the answers end with a line feed
+ */
+void scpiExecute(const ScpiCommand *table, uint8_t n)
+{
+  scpiActive = false;
+  if (scpiTooLong)
+  {
+    scpiError(SCPI_SYNTAX);
+    return;
+  }
+  if (scpiExecuteLine(table, n, scpiLine, scpiLen)) Serial.println();
+}
+
+/**
+ * Print the answer of a query, after a ';' if the line has answered before
+ */
+void scpiAnswer(const char *text)
+{
+  if (scpiAnswered) Serial.print(';');
+  scpiAnswered = true;
+  Serial.print(text);
+}
+
+/**
+ * Is the parameter the word, in the short or the long form (e.g. "SQUare")?
+ */
+bool scpiIs(const ScpiParam *param, const char *word)
+{
+  uint8_t wordLen;
+  return matchWord(param->s, param->len, word, false, &wordLen);
+}
+
+/**
+ * Put an error into the queue
+ */
+void scpiError(int16_t code)
+{
+  if (scpiErrCount == SCPI_ERRORS)
+  {
+    scpiErrQueue[(scpiErrFirst + SCPI_ERRORS - 1) % SCPI_ERRORS] = SCPI_QUEUE_OVERFLOW;
+    return;
+  }
+  scpiErrQueue[(scpiErrFirst + scpiErrCount++) % SCPI_ERRORS] = code;
+}
+
+void scpiClearErrors()
+{
+  scpiErrCount = 0;
+}
+
+/**
+ * Code and text of an error: -222,"Data out of range"
+ */
+static void formatError(char *buf, uint8_t size, int16_t code)
+{
+  for (const ScpiErrorText &e : scpiErrorTexts)
+  {
+    if ((int16_t)pgm_read_word(&e.code) != code) continue;
+    int n = snprintf(buf, size, "%d,\"", code);
+    memcpy_P(buf + n, e.text, sizeof(e.text));
+    strcat(buf, "\"");
+    return;
+  }
+  snprintf(buf, size, "%d", code);
+}
+
+void scpiPrintErrorText(int16_t code)
+{
+  char buf[40];
+  formatError(buf, sizeof(buf), code);
+  Serial.print(buf);
+}
+
+/**
+ * Take the oldest error out of the queue and answer it with its text
+ */
+void scpiPrintError()
+{
+  char    buf[40];
+  int16_t code = SCPI_NO_ERROR;
+
+  if (scpiErrCount)
+  {
+    code = scpiErrQueue[scpiErrFirst];
+    scpiErrFirst = (scpiErrFirst + 1) % SCPI_ERRORS;
+    scpiErrCount--;
+  }
+  formatError(buf, sizeof(buf), code);
+  scpiAnswer(buf);
+}
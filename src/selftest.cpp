@@ -0,0 +1,133 @@
+/**
+ * Program      selftest.cpp
+ *
+ * Purpose      Closed-loop test of the generator. The square wave on pin 9 is fed
+ *              back into the pin change interrupt of the same pin, no wiring needed.
+ *              For several prescaler/OCR1A points the measured frequency is compared
+ *              with getFrequencyFromRegisters()
+ *
+ * Formulas     The interrupt takes micros() at the first and at the last of n edges
+ *
+ *              f = (n - 1) / 2 * 1'000'000 / (t_last - t_first)
+ *
+ * Remarks      Both the timer and micros() run from the same CPU clock, so the error
+ *              of the resonator cancels and the measurement must match the register
+ *              values within the resolution of micros() (4 us over about 8 ms, 0.05 %).
+ *              The limit is set to 0.5 %.
+ *
+ *              The points cover all prescalers at 1 .. 10 kHz, where the interrupt
+ *              easily keeps up. Each point is measured over about 8 ms, so the whole
+ *              test takes about 50 ms. Run it at boot with the build flag
+ *              -D SELFTEST_AT_BOOT or with the menu.
+ */
+#include <Arduino.h>
+#include "selftest.h"
+#include "generator.h"
+#include "timebase.h"
+#include "timer1.h"
+#include "command.h"
+
+constexpr uint32_t ST_WINDOW_US  = 8000;    // measurement time per point
+constexpr uint8_t  ST_MIN_EDGES  = 9;
+constexpr uint8_t  ST_MAX_EDGES  = 161;
+constexpr uint32_t ST_TIMEOUT_MS = 20;
+constexpr double   ST_TOLERANCE  = 0.005;
+
+typedef struct { uint8_t preBits; uint16_t ocr; } TestPoint;
+
+const TestPoint points[] =
+{
+  { 1,   799 },   // 10'000 Hz
+  { 2,   249 },   //  4'000 Hz
+  { 3,   124 },   //  1'000 Hz
+  { 4,    30 },   //  1'008 Hz
+  { 5,     7 },   //    977 Hz
+};
+
+volatile uint8_t  stEdges   = 0;     // edges counted so far
+volatile uint8_t  stWanted  = 0;     // edges to count
+volatile uint32_t stFirst   = 0;     // micros() of the first edge
+volatile uint32_t stLast    = 0;     // micros() of the last edge
+
+/**
+ * Pin change on pin 9: timestamp the first and the last edge
+ */
+static void countEdge()
+{
+  uint32_t t = micros();
+  uint8_t  n = stEdges;
+  if (n >= stWanted) return;
+  if (n == 0) stFirst = t;
+  stLast  = t;
+  stEdges = n + 1;
+}
+
+/**
+ * Set a test point, measure and compare. Returns true if within tolerance
+ */
+static bool testPoint(const TestPoint &p)
+{
+  char buf[96];
+
+  Timer1Config t1 = {};
+  t1.tccr1a = 1 << COM1A0;              // toggle pin 9
+  t1.tccr1b = 0b00001000 | p.preBits;   // CTC mode
+  t1.ocr1a  = p.ocr;
+  timer1Commit(t1, true);
+
+  double   expected = getFrequencyFromRegisters();
+  uint32_t edges    = (uint32_t)(expected * 2 * ST_WINDOW_US / 1000000) + 1;
+  stWanted = (uint8_t)constrain(edges, (uint32_t)ST_MIN_EDGES, (uint32_t)ST_MAX_EDGES);
+  stEdges  = 0;
+
+  uint32_t start = millis();
+  while (stEdges < stWanted && millis() - start < ST_TIMEOUT_MS);
+
+  double measured = 0;
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t  n  = stEdges;
+  uint32_t dt = stLast - stFirst;
+  SREG = oldSREG;
+  if (n == stWanted && dt) measured = (n - 1) * 500000.0 / dt;
+
+  bool ok = fabs(measured - expected) <= expected * ST_TOLERANCE;
+  snprintf(buf, sizeof(buf), "SELFTEST: PRESC bits %u, OCR1A %5u: %9.2f Hz expected, %9.2f Hz measured, %s",
+           p.preBits, p.ocr, expected, measured, ok ? "ok" : "FAIL");
+  cmdBeginLine();
+  Serial.print(buf);
+  cmdEndLine();
+  return ok;
+}
+
+/**
+ * Run all test points and report. Timer1 is left with the last
+ * test point, the caller sets the output again
+ */
+bool selftestRun()
+{
+  bool     passed = true;
+  uint32_t start  = millis();
+
+  timebaseEnable(false);                // PPS off, pin change interrupt of port B for pin 9
+  pcint0Handler = countEdge;
+  PCMSK0 |= 1 << PCINT1;
+  PCIFR   = 1 << PCIF0;
+  PCICR  |= 1 << PCIE0;
+
+  for (uint8_t i = 0; i < sizeof(points) / sizeof(points[0]); i++)
+  {
+    passed &= testPoint(points[i]);
+  }
+
+  PCMSK0 &= ~(1 << PCINT1);
+  pcint0Handler = nullptr;
+  timebaseEnable(true);
+
+  cmdBeginLine();
+  Serial.print(passed ? "SELFTEST passed in " : "SELFTEST FAILED in ");
+  Serial.print(millis() - start);
+  Serial.print(" ms");
+  cmdEndLine();
+  return passed;
+}
@@ -0,0 +1,94 @@
+/**
+ * Program      subharmonic.cpp
+ *
+ * Purpose      Outputs f on pin 9 and the phase locked subharmonic f/N on pin 10,
+ *              N = 2 .. 65535. Both outputs are made by the same Timer1 compare
+ *              events, so every edge on pin 10 coincides with an edge on pin 9
+ *
+ * Remarks      Timer1 keeps running in CTC mode as set by setFrequency() or setPeriod(),
+ *              pin 9 toggles on every compare match (COM1A0). OCR1B is set equal to
+ *              OCR1A, so compare match B happens at the same timer tick. Its interrupt
+ *              counts the matches and sets COM1B0 only for every N-th match. The toggle
+ *              of pin 10 is thus done by the hardware at the very same clock as the one
+ *              of pin 9, without the latency an ISR setting FOC1B would add.
+ *
+ *              The ISR has to arm or disarm COM1B0 before the next compare match.
+ *              It measures the timer ticks from the compare match until TCCR1A has
+ *              been written and keeps the maximum in subIsrMax. From this follows
+ *              the highest frequency on pin 9 at which the ISR keeps up:
+ *
+ *                f max = fcpu / (2 * cycles)
+ *
+ *              e.g. 60 cycles give 133 kHz. If a compare match B is pending again at
+ *              the end of the ISR, an edge was missed and subOverruns is incremented.
+ */
+#include <Arduino.h>
+#include "subharmonic.h"
+#include "timer1.h"
+#include "generator.h"
+
+volatile uint16_t subN         = 2;    // divider
+volatile uint16_t subCount     = 2;    // compare matches until the next toggle of pin 10
+volatile uint8_t  subTccrArmed = 0;    // TCCR1A with COM1B0, pin 10 toggles at the next match
+volatile uint8_t  subTccrIdle  = 0;    // TCCR1A without COM1B0
+volatile uint16_t subIsrMax    = 0;    // max timer ticks from compare match to TCCR1A write
+volatile uint16_t subOverruns  = 0;    // compare matches missed by the ISR
+
+/**
+ * Start the divided output on pin 10, pin 9 keeps the current frequency
+ */
+void subStart(uint16_t n)
+{
+  Timer1Config t1;
+
+  TIMSK1 = 0;
+  subN         = n;
+  subCount     = n;
+  subTccrIdle  = 1 << COM1A0;
+  subTccrArmed = (1 << COM1A0) | (1 << COM1B0);
+  subIsrMax    = 0;
+  subOverruns  = 0;
+  timer1Read(t1);             // frequency and prescaler as set
+  t1.tccr1a = subTccrIdle;
+  t1.ocr1b  = t1.ocr1a;
+  t1.timsk1 = 1 << OCIE1B;
+  timer1Commit(t1);
+}
+
+/**
+ * Show divider, measured ISR time and the resulting frequency ceiling
+ */
+void subPrintSettings()
+{
+  uint16_t pre = preValues[TCCR1B & 0b00000111];
+  uint32_t cycles;
+  uint16_t overruns;
+  char     buf[96];
+
+  uint8_t oldSREG = SREG;
+  cli();
+  cycles   = (uint32_t)subIsrMax * pre;
+  overruns = subOverruns;
+  SREG = oldSREG;
+
+  snprintf(buf, sizeof(buf), "SUB: pin 10 = f / %u, ISR max: %lu cycles, f max: %lu Hz, overruns: %u ",
+           subN, (unsigned long)cycles,
+           cycles ? (unsigned long)(F_CPU / 2 / cycles) : 0UL, overruns);
+  Serial.print(buf);
+}
+
+/**
+ * Count the compare matches and let the hardware toggle
+ * pin 10 at every N-th match
+ */
+ISR(TIMER1_COMPB_vect)
+{
+  uint16_t c = subCount - 1;
+  if (c == 0) c = subN;
+  subCount = c;
+  TCCR1A = (c == 1) ? subTccrArmed : subTccrIdle;
+
+  uint16_t t = TCNT1;                           // ticks since the compare match
+  if (t > subIsrMax) subIsrMax = t;
+  if (TIFR1 & (1 << OCF1B)) subOverruns++;
+}
@@ -0,0 +1,210 @@
+/**
+ * Program      telemetry.cpp
+ *
+ * Purpose      Status stream for the test rig: at 1 .. 100 Hz a frame with the
+ *              registers of Timer1, the output frequency, the generator mode, the
+ *              loop and ISR load and the error counters, as binary frame or as a
+ *              line of JSON
+ *
+ * Formulas     Binary frame, 39 bytes:
+ *
+ *              0xA5 0x5A len | TelemetryFrame (len = 34 bytes) | CRC16 (LSB first)
+ *
+ *              CRC-16/XMODEM (polynomial 0x1021, start 0) over the TelemetryFrame.
+ *
+ *              JSON, one line:
+ *
+ *              {"ms":1234,"mode":"SQUARE","f":1000.000,"tccr1a":64,"tccr1b":9,
+ *               "timsk1":0,"ocr1a":7999,"ocr1b":0,"icr1":0,"loop":2.1,"isr":0.6,
+ *               "ovr":0,"late":0,"cmderr":0,"drop":0}
+ *
+ *              f in Hz with 3 decimals, loop and isr in %.
+ *
+ *              bytes/s = rate * frame size: 100 Hz binary 3'900 bytes/s, JSON about
+ *              20'000 bytes/s, more than 115'200 baud carry (11'520 bytes/s)
+ *
+ * Remarks      A frame is put into the transmit buffer as a whole, if it fits, else it
+ *              is dropped and counted. The task hands the buffer over to Serial only
+ *              as far as the transmit buffer of Serial has room, so it never waits
+ *              for the UART and neither the output nor the commands are held up.
+ *
+ *              A command pauses the stream at the end of a frame before it prints,
+ *              so its answer never lands inside a frame. The frames made meanwhile
+ *              wait in the buffer.
+ *
+ *              The period is 1000 / rate ms, rounded down, on the millis() tick.
+ */
+#include <Arduino.h>
+#include <util/crc16.h>
+#include "telemetry.h"
+#include "timer1.h"
+#include "command.h"
+#include "generator.h"
+
+static_assert(TM_BUFFER <= 256 && (TM_BUFFER & (TM_BUFFER - 1)) == 0, "TM_BUFFER: power of 2 up to 256");
+
+uint8_t   tmBuf[TM_BUFFER];               // length byte, then the frame, for every frame
+uint8_t   tmHead    = 0;                  // next byte to put
+uint8_t   tmTail    = 0;                  // next byte to send
+uint8_t   tmLeft    = 0;                  // bytes of the frame being sent
+bool      tmPaused  = false;
+uint8_t   tmRate    = 0;                  // Hz, 0 = off
+TM_FORMAT tmFormat  = TM_FORMAT::BINARY;
+uint32_t  tmNext    = 0;                  // millis() of the next frame
+uint32_t  tmFrames  = 0;
+uint16_t  tmDrops   = 0;
+
+static uint8_t used()
+{
+  return (uint8_t)(tmHead - tmTail) & (TM_BUFFER - 1);
+}
+
+/**
+ * Put a frame into the buffer, drop it if it does not fit
+ */
+static void put(const uint8_t *data, uint8_t n)
+{
+  if (n + 1 > TM_BUFFER - 1 - used())
+  {
+    tmDrops++;
+    return;
+  }
+  tmBuf[tmHead++ & (TM_BUFFER - 1)] = n;
+  for (uint8_t i = 0; i < n; i++) tmBuf[tmHead++ & (TM_BUFFER - 1)] = data[i];
+  tmFrames++;
+}
+
+/**
+ * Start the stream with rate frames per second, 0 stops it
+ */
+void telemetryStart(uint8_t rate, TM_FORMAT format)
+{
+  tmRate   = rate;
+  tmFormat = format;
+  tmNext   = millis();
+  tmFrames = 0;
+  tmDrops  = 0;
+}
+
+/**
+ * Stop the stream at the end of the frame being sent.
+ * Returns true when no frame is half sent
+ */
+bool telemetryPause()
+{
+  tmPaused = true;
+  return tmLeft == 0;
+}
+
+void telemetryResume()
+{
+  tmPaused = false;
+}
+
+/**
+ * Take the values of a frame
+ */
+static void snapshot(TelemetryFrame &f)
+{
+  Timer1Config t1;
+  uint16_t     loop, isr, overruns, late;
+  timer1Read(t1);
+  schedLoad(&loop, &isr);
+  schedErrors(&overruns, &late);
+
+  f.ms        = millis();
+  f.mode      = generatorMode();
+  f.tccr1a    = t1.tccr1a;
+  f.tccr1b    = t1.tccr1b;
+  f.timsk1    = t1.timsk1;
+  f.ocr1a     = t1.ocr1a;
+  f.ocr1b     = t1.ocr1b;
+  f.icr1      = t1.icr1;
+  f.mHz       = generatorFrequency_mHz();
+  f.loopLoad  = loop;
+  f.isrLoad   = isr;
+  f.overruns  = overruns;
+  f.late      = late;
+  f.cmdErrors = cmdErrorCount();
+  f.drops     = tmDrops;
+}
+
+/**
+ * Make a frame in the selected format and put it into the buffer
+ */
+static void makeFrame()
+{
+  TelemetryFrame f;
+  snapshot(f);
+
+  if (tmFormat == TM_FORMAT::BINARY)
+  {
+    uint8_t  frame[3 + sizeof(f) + 2] = { TM_SYNC1, TM_SYNC2, sizeof(f) };
+    uint16_t crc = 0;
+    memcpy(&frame[3], &f, sizeof(f));
+    for (uint8_t i = 0; i < sizeof(f); i++) crc = _crc_xmodem_update(crc, frame[3 + i]);
+    frame[3 + sizeof(f)]     = crc & 0xFF;
+    frame[3 + sizeof(f) + 1] = crc >> 8;
+    put(frame, sizeof(frame));
+  }
+  else
+  {
+    char line[232];
+    int  n = snprintf(line, sizeof(line),
+               "{\"ms\":%lu,\"mode\":\"%s\",\"f\":%lu.%03u,\"tccr1a\":%u,\"tccr1b\":%u,\"timsk1\":%u,"
+               "\"ocr1a\":%u,\"ocr1b\":%u,\"icr1\":%u,\"loop\":%u.%u,\"isr\":%u.%u,"
+               "\"ovr\":%u,\"late\":%u,\"cmderr\":%u,\"drop\":%u}\r\n",
+               (unsigned long)f.ms, generatorModeName(),
+               (unsigned long)(f.mHz / 1000), (unsigned)(f.mHz % 1000),
+               f.tccr1a, f.tccr1b, f.timsk1, f.ocr1a, f.ocr1b, f.icr1,
+               f.loopLoad / 10, f.loopLoad % 10, f.isrLoad / 10, f.isrLoad % 10,
+               f.overruns, f.late, f.cmdErrors, f.drops);
+    if (n > 0 && n < (int)sizeof(line)) put((const uint8_t *)line, n);
+  }
+}
+
+/**
+ * Make the frames on time and hand the buffer over to Serial
+ * as far as it has room
+ */
+uint8_t telemetryTask(Pt *pt)
+{
+  bool busy = false;
+
+  if (tmRate && (int32_t)(millis() - tmNext) >= 0)
+  {
+    tmNext += 1000 / tmRate;
+    if ((int32_t)(millis() - tmNext) >= 0) tmNext = millis() + 1000 / tmRate;
+    makeFrame();
+    busy = true;
+  }
+
+  int room = Serial.availableForWrite();
+  while (room > 0 && (tmLeft || (used() && !tmPaused)))
+  {
+    if (!tmLeft) tmLeft = tmBuf[tmTail++ & (TM_BUFFER - 1)];
+    Serial.write(tmBuf[tmTail++ & (TM_BUFFER - 1)]);
+    tmLeft--;
+    room--;
+    busy = true;
+  }
+  return busy ? PT_ENDED : PT_WAITING;
+}
+
+/**
+ * Show rate, format and the frames sent and dropped
+ */
+void telemetryPrintSettings()
+{
+  char buf[64];
+
+  if (!tmRate)
+  {
+    Serial.print("STREAM: off ");
+    return;
+  }
+  snprintf(buf, sizeof(buf), "STREAM: %u Hz, %s, frames: %lu, dropped: %u ",
+           tmRate, tmFormat == TM_FORMAT::BINARY ? "binary" : "JSON",
+           (unsigned long)tmFrames, tmDrops);
+  Serial.print(buf);
+}
@@ -0,0 +1,253 @@
+/**
+ * Program      tempcomp.cpp
+ *
+ * Purpose      Temperature compensation of the ceramic resonator. The on-chip
+ *              temperature sensor (ADC channel 8) is read every 10 s. A curve of
+ *              the frequency offset versus temperature, learned while a 1PPS signal
+ *              disciplines the timebase, gives the offset when there is no PPS
+ *
+ * Formulas     Sensor with the internal 1.1 V reference, typical values from the
+ *              datasheet: 314 LSB at 25 degC, about 1.1 LSB/degC
+ *
+ *              T [0.1 degC] = (raw - 314) * 10 / 1.1 + 250
+ *
+ *              The absolute accuracy of the sensor is only +-10 degC, but as the curve
+ *              is learned and used with the same sensor, this does not matter.
+ *
+ * Remarks      The curve has a point every 5 degC from -10 to 70 degC, in ppb. Between
+ *              two known points the offset is interpolated linearly, outside of them
+ *              the nearest point is used up to 2.5 degC away.
+ *
+ *              Learning: while the timebase is LOCKED with a full window, the offset
+ *              measured with the PPS is passed in by tempcompLearn(). Every 10 s it is
+ *              averaged into the point nearest to the current temperature. The curve is
+ *              saved in the EEPROM when a point has moved by more than 100 ppb, at most
+ *              every 10 minutes, to spare the EEPROM.
+ *
+ *              The scheduler (see sched.cpp) calls tempcompUpdate() every TC_INTERVAL.
+ *              A save copies the curve and leaves the writing to the task
+ *              tempcompSaveTask(), one byte at a time while the EEPROM is ready, so
+ *              the 3.3 ms of every byte written do not block the other tasks.
+ */
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "tempcomp.h"
+#include "sched.h"
+#include "power.h"
+
+constexpr uint16_t TC_MAGIC         = 0x5443;       // 'TC'
+constexpr uint8_t  TC_SAMPLES       = 16;           // conversions averaged per measurement
+constexpr int32_t  TC_SAVE_PPB      = 100;          // change of a point that is worth a save
+constexpr uint32_t TC_SAVE_INTERVAL = 600000;       // ms
+
+typedef struct
+{
+  uint16_t magic;
+  uint32_t valid;                                   // bit i set: point i is known
+  int32_t  ppb[TC_POINTS];
+} Curve;
+
+Curve EEMEM eeCurve;
+
+Curve    tcCurve;
+Curve    tcWrite;                                   // copy being written to the EEPROM
+bool     tcSaveRequest = false;
+uint8_t  tcWriteAt   = 0;                           // next byte of tcWrite
+int32_t  tcSaved[TC_POINTS];                        // points as in the EEPROM
+uint32_t tcSavedValid = 0;                          // valid bits as in the EEPROM
+int16_t  tcTemp      = 0;                           // 0.1 degC
+bool     tcHaveTemp  = false;
+int32_t  tcLearnPpb  = 0;
+bool     tcLearn     = false;
+uint32_t tcLastSave  = 0;
+
+/**
+ * Read the temperature sensor, average TC_SAMPLES conversions
+ * and restore the ADC settings, the ADC is switched off again
+ */
+static int16_t readTemperature()
+{
+  uint8_t  admux  = ADMUX;
+  uint8_t  adcsra = ADCSRA;
+  uint16_t sum    = 0;
+
+  powerAdc(true);
+  ADMUX  = (1 << REFS1) | (1 << REFS0) | (1 << MUX3);   // 1.1 V reference, channel 8
+  ADCSRA = (1 << ADEN) | 0b111;                         // prescaler 128, 104 us per conversion
+  delayMicroseconds(500);                               // let the reference settle
+
+  for (uint8_t i = 0; i <= TC_SAMPLES; i++)
+  {
+    ADCSRA |= 1 << ADSC;
+    while (ADCSRA & (1 << ADSC));
+    if (i) sum += ADC;                                  // first conversion discarded
+  }
+  ADMUX  = admux;
+  ADCSRA = adcsra;
+  powerAdc(false);
+
+  // (sum / 16 - 314) * 100 / 11 + 250
+  return (int16_t)(((int32_t)sum - 314L * TC_SAMPLES) * 100 / (11 * TC_SAMPLES) + 250);
+}
+
+/**
+ * Load the curve from the EEPROM
+ */
+void tempcompBegin()
+{
+  eeprom_read_block(&tcCurve, &eeCurve, sizeof(tcCurve));
+  if (tcCurve.magic != TC_MAGIC)
+  {
+    tcCurve.magic = TC_MAGIC;
+    tcCurve.valid = 0;
+  }
+  memcpy(tcSaved, tcCurve.ppb, sizeof(tcSaved));
+  tcSavedValid = tcCurve.valid;
+}
+
+/**
+ * Hand the curve over to tempcompSaveTask()
+ */
+static void saveCurve()
+{
+  tcWrite = tcCurve;
+  tcSaveRequest = true;
+  memcpy(tcSaved, tcCurve.ppb, sizeof(tcSaved));
+  tcSavedValid = tcCurve.valid;
+}
+
+/**
+ * Point of the curve nearest to temperature t
+ */
+static int8_t nearestPoint(int16_t t)
+{
+  int16_t i = (t - TC_T_MIN + TC_T_STEP / 2) / TC_T_STEP;
+  if (t < TC_T_MIN - TC_T_STEP / 2 || i >= TC_POINTS) return -1;
+  return (int8_t)i;
+}
+
+/**
+ * Measure the temperature, learn and save the curve.
+ * To be called every TC_INTERVAL
+ */
+void tempcompUpdate()
+{
+  tcTemp     = readTemperature();
+  tcHaveTemp = true;
+
+  int8_t i = nearestPoint(tcTemp);
+  if (!tcLearn || i < 0) return;
+  tcLearn = false;
+
+  if (tcCurve.valid & (1UL << i))
+    tcCurve.ppb[i] += (tcLearnPpb - tcCurve.ppb[i]) / 8;  // average over about 8 measurements
+  else
+    tcCurve.ppb[i] = tcLearnPpb;
+  tcCurve.valid |= 1UL << i;
+
+  int32_t moved = tcCurve.ppb[i] - tcSaved[i];
+  bool    isNew = !(tcSavedValid & (1UL << i));
+  if ((isNew || moved > TC_SAVE_PPB || moved < -TC_SAVE_PPB)
+      && millis() - tcLastSave > TC_SAVE_INTERVAL)
+  {
+    saveCurve();
+    tcLastSave = millis();
+  }
+}
+
+/**
+ * Write the copy of the curve to the EEPROM, a byte whenever the
+ * EEPROM is ready. A save requested meanwhile starts over
+ */
+uint8_t tempcompSaveTask(Pt *pt)
+{
+  PT_BEGIN(pt);
+  PT_WAIT_UNTIL(pt, tcSaveRequest);
+  tcSaveRequest = false;
+  for (tcWriteAt = 0; tcWriteAt < sizeof(Curve); tcWriteAt++)
+  {
+    PT_WAIT_UNTIL(pt, eeprom_is_ready());
+    eeprom_update_byte((uint8_t *)&eeCurve + tcWriteAt, ((uint8_t *)&tcWrite)[tcWriteAt]);
+  }
+  PT_END(pt);
+}
+
+/**
+ * Offset measured with the PPS, learned at the next temperature measurement
+ */
+void tempcompLearn(int32_t ppb)
+{
+  tcLearnPpb = ppb;
+  tcLearn    = true;
+}
+
+/**
+ * Offset in ppb at the current temperature from the curve.
+ * Returns false if the curve has no point near the temperature
+ */
+bool tempcompPpb(int32_t *ppb)
+{
+  if (!tcHaveTemp) return false;
+
+  int16_t d = tcTemp - TC_T_MIN;
+  int8_t  i = (d < 0) ? -1 : d / TC_T_STEP;            // point below the temperature
+  bool    lo = i >= 0 && i < TC_POINTS && (tcCurve.valid & (1UL << i));
+  bool    hi = i + 1 >= 0 && i + 1 < TC_POINTS && (tcCurve.valid & (1UL << (i + 1)));
+  int16_t r  = d - i * TC_T_STEP;                      // 0.1 degC above point i
+
+  if (lo && hi)
+  {
+    *ppb = tcCurve.ppb[i] + (tcCurve.ppb[i + 1] - tcCurve.ppb[i]) * r / TC_T_STEP;
+    return true;
+  }
+  if (lo && r <= TC_T_STEP / 2)
+  {
+    *ppb = tcCurve.ppb[i];
+    return true;
+  }
+  if (hi && r >= TC_T_STEP / 2)
+  {
+    *ppb = tcCurve.ppb[i + 1];
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Last measured temperature in 0.1 degC
+ */
+int16_t tempcompTemperature()
+{
+  return tcTemp;
+}
+
+/**
+ * Forget the curve, also in the EEPROM
+ */
+void tempcompClear()
+{
+  tcCurve.valid = 0;
+  saveCurve();
+}
+
+/**
+ * Show the temperature and the known points of the curve
+ */
+void tempcompPrintCurve()
+{
+  char    buf[48];
+  int16_t a = tcTemp < 0 ? -tcTemp : tcTemp;
+
+  snprintf(buf, sizeof(buf), "TEMP: %s%d.%d degC, curve [degC: ppm]:", tcTemp < 0 ? "-" : "", a / 10, a % 10);
+  Serial.print(buf);
+  for (uint8_t i = 0; i < TC_POINTS; i++)
+  {
+    if (!(tcCurve.valid & (1UL << i))) continue;
+    int32_t  ppb = tcCurve.ppb[i];
+    uint32_t a   = ppb < 0 ? -ppb : ppb;
+    snprintf(buf, sizeof(buf), " %d: %c%lu.%03lu", (TC_T_MIN + i * TC_T_STEP) / 10, ppb < 0 ? '-' : '+',
+             (unsigned long)(a / 1000), (unsigned long)(a % 1000));
+    Serial.print(buf);
+  }
+  Serial.print(" ");
+}
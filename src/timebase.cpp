@@ -0,0 +1,235 @@
+/**
+ * Program      timebase.cpp
+ *
+ * Purpose      Disciplines the timebase with a 1PPS signal (GPS receiver or lab
+ *              reference) on pin 8. The deviation of the CPU clock is measured every
+ *              second and the running estimate of fo replaces the nominal 8 MHz in
+ *              all frequency formulas
+ *
+ * Wiring       1PPS, 5 V logic level, rising edge on time, on pin 8
+ *
+ * Formulas     D   = micros() between two PPS edges
+ *              dev = D - 1'000'000                 deviation of the CPU clock in ppm
+ *              fo  = 8'000'000 * D / 1'000'000
+ *                  = 8'000'000 + 8 * avg(dev)      in Hz
+ *
+ *              Allan deviation for tau = 1 s over the last n seconds
+ *
+ *              sigma = sqrt( sum (dev[i+1] - dev[i])^2 / (2 * (n - 1)) )
+ *
+ * Remarks      Timer1 makes the output, so the PPS is timestamped by the pin change
+ *              interrupt of pin 8 with micros() (Timer0, 4 us resolution). A single
+ *              second is only resolved to 4 ppm, but the sum of the deviations over
+ *              the window is the time between its first and last edge, so the average
+ *              over 32 s is good to about 0.13 ppm (1 Hz of fo). All arithmetic is
+ *              integer.
+ *
+ *              Pulses deviating more than 1000 ppm from one second are discarded. With
+ *              fewer than 4 valid seconds the nominal fo is used (ACQUIRE). When the
+ *              PPS stops for more than 2.5 s the last estimate is kept (HOLDOVER) until
+ *              the pulses come back. In holdover, the change of the temperature curve
+ *              (see tempcomp.cpp) since the PPS was lost is added. Without any PPS the
+ *              offset comes from the curve alone (TEMPCOMP), if it knows the temperature.
+ *
+ *              Pin 8 is also the reference input of the PLL. While the PLL runs, the
+ *              pin change interrupt is disabled and the timebase holds over.
+ */
+#include <Arduino.h>
+#include "timebase.h"
+#include "isqrt.h"
+#include "tempcomp.h"
+
+constexpr int32_t  TB_MAX_DEV     = 1000;     // ppm
+constexpr uint8_t  TB_MIN_SAMPLES = 4;
+constexpr uint32_t TB_TIMEOUT_US  = 2500000;
+constexpr uint8_t  TB_QUEUE       = 4;        // samples taken by the ISR, not yet processed
+
+volatile uint32_t tbLastEdge = 0;             // micros() of the last PPS edge
+volatile bool     tbHadEdge  = false;
+volatile int16_t  tbQueue[TB_QUEUE];          // deviations from the ISR
+volatile uint8_t  tbQueueHead = 0;
+volatile uint8_t  tbQueueTail = 0;
+
+void (* volatile pcint0Handler)() = nullptr;
+
+int16_t  tbDev[TB_WINDOW];                    // deviations of the last seconds in ppm
+uint8_t  tbCount = 0;
+uint8_t  tbIndex = 0;                         // next position in tbDev
+int32_t  tbSum   = 0;                         // sum of tbDev
+uint32_t tbFo    = TB_FO_NOMINAL;
+int32_t  tbPpb   = 0;                         // offset of the CPU clock behind tbFo
+TB_STATE tbState = TB_STATE::NOMINAL;
+int32_t  tbHoldPpb      = 0;                  // last offset measured with the PPS
+int32_t  tbHoldCurve    = 0;                  // offset of the temperature curve at that time
+bool     tbHoldHasCurve = false;
+
+/**
+ * Pin 8 as input with pin change interrupt
+ */
+void timebaseBegin()
+{
+  pinMode(8, INPUT);
+  timebaseEnable(true);
+}
+
+/**
+ * Turn the pin change interrupt of pin 8 on or off
+ */
+void timebaseEnable(bool enable)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (enable)
+  {
+    tbHadEdge = false;
+    PCMSK0 |= 1 << PCINT0;
+    PCIFR   = 1 << PCIF0;
+    PCICR  |= 1 << PCIE0;
+  }
+  else
+  {
+    PCMSK0 &= ~(1 << PCINT0);
+  }
+  SREG = oldSREG;
+}
+
+/**
+ * Take the samples from the ISR into the window, update fo and the state.
+ * To be called from loop()
+ */
+void timebaseUpdate()
+{
+  uint32_t last;
+  bool     had;
+
+  while (tbQueueTail != tbQueueHead)
+  {
+    int16_t dev = tbQueue[tbQueueTail];
+    tbQueueTail = (tbQueueTail + 1) % TB_QUEUE;
+
+    if (tbCount == TB_WINDOW) tbSum -= tbDev[tbIndex];
+    else                      tbCount++;
+    tbDev[tbIndex] = dev;
+    tbSum += dev;
+    tbIndex = (tbIndex + 1) % TB_WINDOW;
+  }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  last = tbLastEdge;
+  had  = tbHadEdge;
+  SREG = oldSREG;
+
+  int32_t ppb   = 0;
+  int32_t curve = 0;
+  bool    haveCurve = tempcompPpb(&curve);
+
+  if (tbCount >= TB_MIN_SAMPLES && had && micros() - last <= TB_TIMEOUT_US)
+  {
+    tbState     = TB_STATE::LOCKED;
+    ppb         = tbSum * 1000 / tbCount;
+    tbHoldPpb   = ppb;
+    tbHoldCurve = curve;
+    tbHoldHasCurve = haveCurve;
+    if (tbCount == TB_WINDOW) tempcompLearn(ppb);
+  }
+  else if (tbCount >= TB_MIN_SAMPLES)
+  {
+    // keep the last PPS estimate, follow the temperature if the curve knows both points
+    tbState = TB_STATE::HOLDOVER;
+    ppb     = tbHoldPpb;
+    if (tbHoldHasCurve && haveCurve) ppb += curve - tbHoldCurve;
+  }
+  else if (haveCurve)
+  {
+    tbState = TB_STATE::TEMPCOMP;
+    ppb     = curve;
+  }
+  else
+  {
+    tbState = tbCount ? TB_STATE::ACQUIRE : TB_STATE::NOMINAL;
+  }
+
+  // fo = 8'000'000 * (1 + ppb / 10^9)
+  tbPpb = ppb;
+  int32_t d = ppb * 8;
+  tbFo = TB_FO_NOMINAL + (d + (d < 0 ? -500 : 500)) / 1000;
+}
+
+/**
+ * Estimated fo = fcpu / 2 in Hz
+ */
+uint32_t timebaseFo()
+{
+  return tbFo;
+}
+
+/**
+ * Frequency derived from the CPU clock, corrected by the estimate
+ */
+uint32_t timebaseScale(uint32_t nominal)
+{
+  return (uint32_t)(((uint64_t)nominal * tbFo + TB_FO_NOMINAL / 2) / TB_FO_NOMINAL);
+}
+
+TB_STATE timebaseGetState()
+{
+  return tbState;
+}
+
+/**
+ * Show state, fo, offset and the Allan deviation for tau = 1 s
+ */
+void timebasePrintSettings()
+{
+  const char *names[] = { "NOMINAL", "ACQUIRE", "LOCKED", "HOLDOVER", "TEMPCOMP" };
+  char     buf[96];
+  int32_t  ppb   = tbPpb;
+  uint32_t adev  = 0;                             // ppb
+
+  if (tbCount > 1)
+  {
+    uint64_t sq    = 0;
+    uint8_t  first = (tbCount == TB_WINDOW) ? tbIndex : 0;   // oldest sample
+    for (uint8_t i = 0; i < tbCount - 1; i++)
+    {
+      int32_t d = tbDev[(first + i + 1) % TB_WINDOW] - tbDev[(first + i) % TB_WINDOW];
+      sq += (uint32_t)(d * d);
+    }
+    adev = isqrt(sq * 1000000ULL / (2 * (tbCount - 1)));
+  }
+
+  uint32_t absPpb = ppb < 0 ? -ppb : ppb;
+  snprintf(buf, sizeof(buf), "TIMEBASE: %s, fo: %lu Hz, offset: %c%lu.%03lu ppm, ADEV(1 s): %lu.%03lu ppm over %u s ",
+           names[(uint8_t)tbState], (unsigned long)tbFo, ppb < 0 ? '-' : '+',
+           (unsigned long)(absPpb / 1000), (unsigned long)(absPpb % 1000),
+           (unsigned long)(adev / 1000), (unsigned long)(adev % 1000), tbCount);
+  Serial.print(buf);
+}
+
+/**
+ * Timestamp the rising edge of the PPS and queue its deviation.
+ * Other users of the pin change interrupt of port B take it over
+ * with pcint0Handler, while the PPS is disabled
+ */
+ISR(PCINT0_vect)
+{
+  if (pcint0Handler)
+  {
+    pcint0Handler();
+    return;
+  }
+  if (!(PINB & (1 << PB0))) return;             // falling edge
+
+  uint32_t t = micros();
+  int32_t  dev = (int32_t)(t - tbLastEdge) - 1000000L;
+  bool     had = tbHadEdge;
+  tbLastEdge = t;
+  tbHadEdge  = true;
+
+  if (!had || dev < -TB_MAX_DEV || dev > TB_MAX_DEV) return;
+  uint8_t next = (tbQueueHead + 1) % TB_QUEUE;
+  if (next == tbQueueTail) return;              // loop() busy, drop the sample
+  tbQueue[tbQueueHead] = (int16_t)dev;
+  tbQueueHead = next;
+}
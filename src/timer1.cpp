@@ -0,0 +1,106 @@
+/**
+ * Program      timer1.cpp
+ *
+ * Purpose      Helpers shared by the modes that use Timer1
+ *
+ * Remarks      The 16-bit registers are accessed through the shared TEMP byte: the
+ *              high byte is latched in TEMP, the write of the low byte commits both.
+ *              An interrupt between the two that accesses any 16-bit register of
+ *              Timer1 corrupts the write. timer1Commit() writes a whole configuration
+ *              with interrupts disabled, about 30 cycles, and restores SREG instead of
+ *              enabling them, so it works in main-line code and in ISRs alike.
+ *              The interrupts of the new configuration are enabled last, with the
+ *              flags that are still pending from before cleared.
+ *
+ *              In CTC mode a new OCR1A below the current TCNT1 lets the timer run
+ *              up to 0xFFFF, a glitch of up to one full timer round. The deferred
+ *              write waits for the next compare match, when TCNT1 has just restarted
+ *              at 0, and retries at the following match if it came too late.
+ *              A cycle shorter than the interrupt (about 512 cycles) is too short for
+ *              that: timer1WriteOCR1ASync() polls OCF1A with interrupts disabled and
+ *              writes right after the match, for at most one timer round.
+ */
+#include <Arduino.h>
+#include "timer1.h"
+
+static volatile uint16_t t1PendingOcr = 0;
+
+/**
+ * Write the configuration c at once, clearCounter restarts TCNT1 at 0
+ */
+void timer1Commit(const Timer1Config &c, bool clearCounter)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  TIMSK1 = 0;
+  ICR1   = c.icr1;
+  OCR1A  = c.ocr1a;
+  OCR1B  = c.ocr1b;
+  TCCR1A = c.tccr1a;
+  TCCR1B = c.tccr1b;
+  if (clearCounter) TCNT1 = 0;
+  TIFR1  = c.timsk1;                       // flag bits are at the positions of their enable bits
+  TIMSK1 = c.timsk1;
+  SREG = oldSREG;
+}
+
+/**
+ * Read the current configuration at once
+ */
+void timer1Read(Timer1Config &c)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  c.tccr1a = TCCR1A;
+  c.tccr1b = TCCR1B;
+  c.ocr1a  = OCR1A;
+  c.ocr1b  = OCR1B;
+  c.icr1   = ICR1;
+  c.timsk1 = TIMSK1;
+  SREG = oldSREG;
+}
+
+/**
+ * Compare A interrupt of the deferred write, disables itself when done
+ */
+static void writePendingOCR1A()
+{
+  uint16_t ocr = t1PendingOcr;
+  if (TCNT1 >= ocr) return;                // too late for this cycle
+  OCR1A   = ocr;
+  TIMSK1 &= ~(1 << OCIE1A);
+}
+
+/**
+ * Write OCR1A at the next compare match, for CTC mode without interrupts
+ */
+void timer1WriteOCR1AAtMatch(uint16_t ocr)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  t1PendingOcr = ocr;
+  timer1AttachCompA(writePendingOCR1A);
+  TIFR1   = 1 << OCF1A;
+  TIMSK1 |= 1 << OCIE1A;
+  SREG = oldSREG;
+}
+
+/**
+ * Write OCR1A right after the next compare match, polled with interrupts
+ * disabled, for CTC cycles too short for timer1WriteOCR1AAtMatch().
+ * Tries the following matches while TCNT1 is not below ocr yet
+ */
+void timer1WriteOCR1ASync(uint16_t ocr)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  TIFR1 = 1 << OCF1A;
+  for (uint8_t i = 0; i < T1_SYNC_TRIES; i++)
+  {
+    while (!(TIFR1 & (1 << OCF1A)));
+    TIFR1 = 1 << OCF1A;
+    if (TCNT1 + T1_SYNC_MARGIN < ocr) break;
+  }
+  OCR1A = ocr;
+  SREG = oldSREG;
+}
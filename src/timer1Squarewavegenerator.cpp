@@ -11,6 +11,33 @@
  *              Frequency and period can be entered numerically as integer values
  *              but by entering values for output control register and prescaler directly 
  *              fractional frequencies as low as 0.12 HZ are possible
+ *
+ *              Below 1 kHz a DDS mode (see dds.cpp) generates the square wave in 
+ *              an interrupt with a resolution of 14.55 uHz, entered in mHz
+ *
+ *              Sine, triangle and sawtooth are output through a PWM DAC
+ *              (see waveform.cpp), also entered in mHz
+ *
+ *              For LED tests the duty cycle of a 15.6 kHz PWM can be modulated with
+ *              a sine, triangle or breathing envelope (see breathe.cpp)
+ *
+ *              Pin 10 can output the phase locked subharmonic f/N of the frequency
+ *              on pin 9 (see subharmonic.cpp)
+ *
+ *              Up to 8 slow square waves on arbitrary pins share Timer1 through
+ *              an event queue (see multipin.cpp)
+ *
+ *              A software PLL locks the output to N/M times a reference
+ *              on pin 8 (see pll.cpp)
+ *
+ *              loop() runs the tasks of a cooperative scheduler and lets the
+ *              CPU sleep when none of them has work (see sched.cpp)
+ *
+ *              The serial port starts at 115'200 baud and can be switched
+ *              up to 2 Mbaud (see uart.cpp). Besides the single keys of the
+ *              menu it takes a subset of SCPI for test executives (see scpi.cpp),
+ *              and both as tagged lines "#17 e1000" that are queued and answered
+ *              ACK, NAK or BUSY with their tag (see pipe.cpp)
  * 
  * Output       500.00 Hz  /  2000.00 us
  *   example    PRESC: 1
@@ -27,13 +54,16 @@
  * Board        Arduino uno
  *
  * Wiring       Oscilloscope on pin 9 or 10
+ *              Reference for the PLL or 1PPS on pin 8
  *
  * Remarks      Uses Timer1 in CTC mode (clear timer on compare)
  *              prescaler:       3 least significant bits of TCCR1B = 0b00000xxx
  *                               stand for a divider of 1, 8, 64, 256, 1024 for fo
  *              compare value:   OCR1A (output compare register) contains values 0x0000 .. 0xFFFF
  * 
- *              fo               8'000'000 (half of fcpu)
+ *              fo               8'000'000 (half of fcpu), corrected when a 1PPS
+ *                               signal on pin 8 disciplines the timebase (see timebase.cpp)
+ *                               or by the learned temperature curve (see tempcomp.cpp)
  *              f                desired frequency in Hz
  *              T                desired period in seconds
  *              Tus              desired period in microseconds
@@ -71,88 +101,289 @@
  *            http://www.gammon.com.au/timers
  */
 #include <Arduino.h>
+#include "dds.h"
+#include "waveform.h"
+#include "breathe.h"
+#include "subharmonic.h"
+#include "multipin.h"
+#include "pll.h"
+#include "timebase.h"
+#include "tempcomp.h"
+#include "timer1.h"
+#include "selftest.h"
+#include "generator.h"
+#include "analyzer.h"
+#include "bode.h"
+#include "bench.h"
+#include "mem.h"
+#include "command.h"
+#include "sched.h"
+#include "power.h"
+#include "telemetry.h"
+#include "uart.h"
+#include "scpi.h"
+#include "pipe.h"
 
 // Clear the current line with a carriage return, then printing 80 blanks 
 // followed by another carriage return to position the cursor on line beginning
 #define CLR_LINE    "\r                                                                                \r"
 
 enum class INPUT_MODE { FREQUENCY, PERIOD };
+enum class GEN_MODE   { SQUARE, DDS, WAVEFORM, BREATHE, SUBHARMONIC, MULTIPIN, PLL };
+const char *const genModeNames[] = { "SQUARE", "DDS", "WAVEFORM", "BREATHE", "SUBHARMONIC", "MULTIPIN", "PLL" };
+
+void setValue(uint32_t value, INPUT_MODE m);
+bool setOutputPin(uint8_t pin);
+
+// Handlers of the commands, the arguments are checked against the table
+void toggleInputMode(const int32_t *arg);
+void enterValue(const int32_t *arg);
+void setPrescaler(const int32_t *arg);
+void setOCR1A(const int32_t *arg);
+void enterDdsFrequency(const int32_t *arg);
+void enterWaveform(const int32_t *arg);
+void enterBreathe(const int32_t *arg);
+void enterDivider(const int32_t *arg);
+void enterMultipin(const int32_t *arg);
+void enterRatio(const int32_t *arg);
+void showTimebase(const int32_t *arg);
+void enterTempcomp(const int32_t *arg);
+void runSelftest(const int32_t *arg);
+void runBench(const int32_t *arg);
+void showMemory(const int32_t *arg);
+void showTasks(const int32_t *arg);
+void showPower(const int32_t *arg);
+void enterStream(const int32_t *arg);
+void enterBaud(const int32_t *arg);
+void enterAnalyzer(const int32_t *arg);
+void enterBode(const int32_t *arg);
+void toggleHeartbeat(const int32_t *arg);
+void showSettings(const int32_t *arg);
+void showMenu(const int32_t *arg = nullptr);
+
+// Command table. Each command is composed of a key, a name, a help text, its
+// arguments with their ranges and the handler. Kept in flash, see command.cpp
+constexpr Command commands[] PROGMEM =
+{
+  { 'f', "mode",      "Toggle input mode frequency <--> period",     0, { },                                toggleInputMode },
+  { 'e', "value",     "Enter frequency or period",                   1, { { "Hz/us", ARG::INT, 1, 8000000 } }, enterValue },
+  { 'p', "prescaler", "Enter prescaler 1=1 2=8 3=64 4=256 5=1024",   1, { { "bits", ARG::INT, 1, 5 } },      setPrescaler },
+  { 'r', "ocr",       "Enter OCR1A",                                 1, { { "OCR1A", ARG::INT, 0, 0xFFFF } }, setOCR1A },
+  { 'd', "dds",       "DDS mode",                                    1, { { "mHz", ARG::INT, DDS_MIN_MHZ, DDS_MAX_MHZ } }, enterDdsFrequency },
+  { 'w', "waveform",  "Waveform 1=sin 2=tri 3=saw",                  2, { { "shape", ARG::INT, 1, 3 },
+                                                                          { "mHz", ARG::INT, WAV_MIN_MHZ, WAV_MAX_MHZ } }, enterWaveform },
+  { 'b', "breathe",   "Breathing 1=sin 2=tri 3=exp",                 2, { { "env", ARG::INT, 1, 3 },
+                                                                          { "ms", ARG::INT, BREATHE_MIN_MS, BREATHE_MAX_MS } }, enterBreathe },
+  { 'n', "divide",    "Pin 10 = pin 9 / N",                          1, { { "N", ARG::INT, SUB_MIN_N, SUB_MAX_N } }, enterDivider },
+  { 'm', "multipin",  "Multi-pin square wave, 0 mHz = off",          2, { { "pin", ARG::INT, MP_MIN_PIN, MP_MAX_PIN },
+                                                                          { "mHz", ARG::INT_OR_OFF, MP_MIN_MHZ, MP_MAX_MHZ } }, enterMultipin },
+  { 'l', "lock",      "Lock to N/M times the reference on pin 8",    2, { { "N", ARG::INT, 1, PLL_MAX_N },
+                                                                          { "M", ARG::INT, 1, PLL_MAX_M } }, enterRatio },
+  { 't', "timebase",  "Show timebase (1PPS on pin 8)",               0, { },                                showTimebase },
+  { 'c', "curve",     "Temperature curve 1=show 2=clear",            1, { { "cmd", ARG::INT, 1, 2 } },       enterTempcomp },
+  { 'x', "selftest",  "Run self-test of the output on pin 9",        0, { },                                runSelftest },
+  { 'B', "bench",     "Benchmark: cycles of solver, format, menu",   0, { },                                runBench },
+  { 'M', "mem",       "Show RAM: static, heap, free, stack max",     0, { },                                showMemory },
+  { 'T', "tasks",     "Show tasks: runs, max time, overruns, idle",  0, { },                                showTasks },
+  { 'P', "power",     "Show power: idle, wake-ups, mA per mode",     0, { },                                showPower },
+  { 'v', "stream",    "Status stream, 0 Hz = off, 1=binary 2=JSON",  2, { { "Hz", ARG::INT_OR_OFF, TM_MIN_RATE, TM_MAX_RATE },
+                                                                          { "fmt", ARG::INT, 1, 2 } }, enterStream },
+  { 'u', "baud",      "Baud 115200 250000 500000 1000000 2000000",   1, { { "baud", ARG::INT, UART_MIN_BAUD, UART_MAX_BAUD } }, enterBaud },
+  { 'a', "analyzer",  "Logic analyzer 0=D 1=B, trigger mask, level", 4, { { "port", ARG::INT, 0, 1 },
+                                                                          { "kS/s", ARG::INT, LA_MIN_KSPS, LA_MAX_KSPS },
+                                                                          { "mask", ARG::INT, 0, 255 },
+                                                                          { "level", ARG::INT, 0, 255 } }, enterAnalyzer },
+  { 'g', "bode",      "Bode sweep f1 .. f2, steps/decade, on A0..5", 4, { { "f1", ARG::INT, BODE_MIN_HZ, BODE_MAX_HZ },
+                                                                          { "f2", ARG::INT, BODE_MIN_HZ, BODE_MAX_HZ },
+                                                                          { "steps", ARG::INT, 1, BODE_MAX_STEPS },
+                                                                          { "A", ARG::INT, 0, 5 } }, enterBode },
+  { 'o', "pin",       "Toggle output pin 9 <--> 10",                 0, { },                                toggleOutputPin },
+  { 'h', "heartbeat", "Toggle heartbeat on <--> off",                0, { },                                toggleHeartbeat },
+  { 's', "show",      "Show settings",                               0, { },                                showSettings },
+  { 'S', "menu",      "Show menu",                                   0, { },                                showMenu },
+};
+constexpr uint8_t nbrCommands = sizeof(commands) / sizeof(commands[0]);
+static_assert(cmdKeysUnique(commands, nbrCommands), "two commands with the same key");
+
+constexpr CmdIndex commandIndex PROGMEM = cmdMakeIndex(commands);
+
+// Handlers of the SCPI commands, the number of parameters is checked against the table
+void scpiIdn(const ScpiParam *param);
+void scpiRst(const ScpiParam *param);
+void scpiCls(const ScpiParam *param);
+void scpiFreq(const ScpiParam *param);
+void scpiFreqQuery(const ScpiParam *param);
+void scpiPer(const ScpiParam *param);
+void scpiPerQuery(const ScpiParam *param);
+void scpiOutpStat(const ScpiParam *param);
+void scpiOutpStatQuery(const ScpiParam *param);
+void scpiOutpChan(const ScpiParam *param);
+void scpiOutpChanQuery(const ScpiParam *param);
+void scpiSourFunc(const ScpiParam *param);
+void scpiSourFuncQuery(const ScpiParam *param);
+void scpiSystErr(const ScpiParam *param);
+
+// SCPI commands: header in the long form with the short form in capitals, number
+// of parameters, range of a number or the keywords allowed, and the handler.
+// Kept in flash, see scpi.cpp
+const ScpiCommand scpiCommands[] PROGMEM =
+{
+  { "*IDN?",            0, 0, 0,       "",           scpiIdn },
+  { "*RST",             0, 0, 0,       "",           scpiRst },
+  { "*CLS",             0, 0, 0,       "",           scpiCls },
+  { "FREQuency",        1, 1, 8000000, "",           scpiFreq },
+  { "FREQuency?",       0, 0, 0,       "",           scpiFreqQuery },
+  { "PERiod",           1, 1, 8000000, "",           scpiPer },
+  { "PERiod?",          0, 0, 0,       "",           scpiPerQuery },
+  { "OUTPut:STATe",     1, 0, 0,       "ON|OFF|1|0", scpiOutpStat },
+  { "OUTPut:STATe?",    0, 0, 0,       "",           scpiOutpStatQuery },
+  { "OUTPut:CHANnel",   1, 0, 0,       "9|10",       scpiOutpChan },
+  { "OUTPut:CHANnel?",  0, 0, 0,       "",           scpiOutpChanQuery },
+  { "SOURce:FUNCtion",  1, 0, 0,       "SQUare|PWM", scpiSourFunc },
+  { "SOURce:FUNCtion?", 0, 0, 0,       "",           scpiSourFuncQuery },
+  { "SYSTem:ERRor?",    0, 0, 0,       "",           scpiSystErr },
+};
+constexpr uint8_t nbrScpiCommands = sizeof(scpiCommands) / sizeof(scpiCommands[0]);
 
-// Definition of a menuitem
-typedef struct { const char key; const char *txt; void (&action)(); } MenuItem;
- 
-void toggleInputMode();
-void enterValue();
-void setPrescaler();
-void setOCR1A();
-void toggleOutputPin();
-void toggleHeartbeat();
-void showSettings();
-void showMenu(); 
-
-// Menu definition. Each menuitem is composed of a key, a text and an action
-MenuItem menu[] = 
-{
-  { 'f', "[f] Toggle input mode frequency <--> period",   toggleInputMode },
-  { 'e', "[e] Enter a value 1 .. 8000000 (freq or per)",  enterValue },
-  { 'p', "[p] Enter prescaler 1=1 2=8 3=64 4=256 5=1024", setPrescaler },
-  { 'r', "[r] Enter OCR1A 0 .. 65535",                    setOCR1A },
-  { 'o', "[o] Toggle output pin 9 <--> 10",               toggleOutputPin },
-  { 'h', "[h] Toggle heartbeat on <--> off",              toggleHeartbeat },
-  { 's', "[s] Show settings",                             showSettings },
-  { 'S', "[S] Show menu",                                 showMenu },
+// Answer to *IDN?: manufacturer, model, serial number, firmware
+#define SCPI_IDN "dodeka.ch,Timer1Squarewavegenerator,0,1.0"
+
+// SOUR:FUNC PWM: the breathing PWM with this envelope
+constexpr uint32_t SCPI_PWM_MS = 2000;
+
+// Tasks of loop(), see sched.cpp
+uint8_t cliTask(Pt *pt);
+uint8_t heartbeatTask(Pt *pt);
+uint8_t timebaseTask(Pt *pt);
+uint8_t temperatureTask(Pt *pt);
+uint8_t powerTask(Pt *pt);
+uint8_t loadTask(Pt *pt);
+uint8_t pipeTask(Pt *pt);
+
+// Task table: name, period [ms] (0 = every pass), budget [us] and the task.
+// The command line is over budget with the commands that print a lot or measure
+const Task tasks[] PROGMEM =
+{
+  { "cli",       0,             20000, cliTask },
+  { "heartbeat", 0,               100, heartbeatTask },
+  { "timebase",  100,            1000, timebaseTask },
+  { "temp",      TC_INTERVAL,    3000, temperatureTask },
+  { "eeprom",    0,               100, tempcompSaveTask },
+  { "power",     1000,             100, powerTask },
+  { "load",      1000,            1500, loadTask },
+  { "stream",    0,               500, telemetryTask },
+  { "pipe",      0,             20000, pipeTask },
 };
-constexpr uint8_t nbrMenuItems = sizeof(menu) / sizeof(menu[0]);
+constexpr uint8_t nbrTasks = sizeof(tasks) / sizeof(tasks[0]);
+TaskState taskState[nbrTasks];
 
 bool heartbeatEnabled = true;
 uint8_t        pinOut = 9;                     // default output pin, can be changed to 10 on serial monitor
 uint32_t     freq_per = 1000;                  // holds frequency or period value 
 INPUT_MODE       mode = INPUT_MODE::FREQUENCY; // input mode defaults to frequency, can be changed to period on serial monitor
+INPUT_MODE   freqMode = INPUT_MODE::FREQUENCY; // meaning of freq_per
+bool       resolvable = true;                  // freq_per solved, may be solved again when fo changes
+GEN_MODE      genMode = GEN_MODE::SQUARE;      // square wave by Timer1 hardware, DDS, PWM DAC, breathing PWM, f/N, multi-pin or PLL
+SquareStatus   status = {};                    // fo 0: not yet derived
+
+const uint16_t preValues[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };  // prescaler for the bits of TCCR1B, 6 and 7: external clock
+
+/**
+ * Release what the current generator mode uses besides Timer1,
+ * before Timer1 gets reconfigured for another mode
+ */
+void leaveGenMode()
+{
+  if (genMode == GEN_MODE::WAVEFORM) wavStop();
+  if (genMode == GEN_MODE::PLL)      timebaseEnable(true);  // pin 8 free again for the PPS
+  genMode = GEN_MODE::SQUARE;
+}
+
+/**
+ * Longest time in cycles the current generator mode keeps the interrupts
+ * disabled, in its ISR or polling with cli(), see uart.cpp
+ */
+uint16_t modeIsrCycles()
+{
+  switch (genMode)
+  {
+    case GEN_MODE::DDS:         return DDS_ISR_CYCLES;
+    case GEN_MODE::WAVEFORM:    return WAV_ISR_CYCLES;
+    case GEN_MODE::BREATHE:     return BREATHE_ISR_CYCLES;
+    case GEN_MODE::SUBHARMONIC: return SUB_ISR_CYCLES;
+    case GEN_MODE::MULTIPIN:    return MP_ISR_CYCLES;
+    case GEN_MODE::PLL:         return PLL_ISR_CYCLES;
+    default:                    break;
+  }
+  uint32_t cycle = ((uint32_t)OCR1A + 1) * preValues[TCCR1B & 0b00000111];
+  if (resolvable && cycle < 512) return T1_SYNC_TRIES * cycle;  // see resolveOutput()
+  return T1_ISR_CYCLES;
+}
+
+/**
+ * OCR1A for frequency freq with prescaler pre
+ */
+uint16_t ocrForFrequency(uint32_t freq, uint32_t pre)
+{
+  const uint32_t fo = timebaseFo();   // 8'000'000, corrected by the PPS
+  return (uint16_t) (round( (double)fo / (double)pre / (double)freq - 1.0 ));
+}
+
+/**
+ * OCR1A for period in us with prescaler pre
+ */
+uint16_t ocrForPeriod(uint32_t period, uint32_t pre)
+{
+  uint32_t ocr_long = (uint32_t)((uint64_t)period * timebaseFo() / 1000000 / pre) - 1;
+  if (ocr_long > 0xFFFF) ocr_long = 0xFFFF;  // fo above nominal at the prescaler limits
+  return (uint16_t)ocr_long;
+}
 
 /**
  * Set frequency between 1 .. 8'000'000 Hz
  */
 void setFrequency(uint32_t freq, uint8_t pin)
 {
-  const uint32_t fo = 8000000;
-  uint32_t pre = 1;
+  uint32_t     pre = 1;
+  Timer1Config t1  = {};
 
-  TCCR1A = 0;  // clear the register
-  if (pin ==  9) TCCR1A = 1 << COM1A0;  // set output pin
-  if (pin == 10) TCCR1A = 1 << COM1B0;
+  leaveGenMode();
+  if (pin ==  9) t1.tccr1a = 1 << COM1A0;  // set output pin
+  if (pin == 10) t1.tccr1a = 1 << COM1B0;
 
-  TCCR1B = 0b00001001; // Prescaler = 001 = 1
-  //             ^--- 
-  //             | |
-  //             | prescaler bits
-  //             WGM12 bit for CTC mode 
+  t1.tccr1b = 0b00001001; // Prescaler = 001 = 1
+  //                ^--- 
+  //                | |
+  //                | prescaler bits
+  //                WGM12 bit for CTC mode 
 
   // Why these values were chosen for the decisions
   // can be seen from the tables in the header
   if (freq < 123) 
   {
-    TCCR1B = 0b00001010; // Prescaler: 010 = 8
+    t1.tccr1b = 0b00001010; // Prescaler: 010 = 8
     pre = 8;
   }
 
   if (freq < 16)
   {
-    TCCR1B = 0b00001011; // Prescaler: 011 = 64
+    t1.tccr1b = 0b00001011; // Prescaler: 011 = 64
     pre = 64;
   }
 
   if (freq < 2)
   {
-    TCCR1B = 0b00001100; // Prescaler: 100 = 256
+    t1.tccr1b = 0b00001100; // Prescaler: 100 = 256
     pre = 256;
   }
   
   if (freq < 1)
   {
-    TCCR1B = 0b00001101; // Prescaler: 101 = 1024
+    t1.tccr1b = 0b00001101; // Prescaler: 101 = 1024
   }
-  OCR1A = (uint16_t) (round( (double)fo / (double)pre / (double)freq - 1.0 ));
-  TIMSK1 = 0;             // Timer 1 interrupt mask register
+  t1.ocr1a = ocrForFrequency(freq, pre);
+  t1.timsk1 = 0;          // no Timer 1 interrupts
+  timer1Commit(t1);
 }
 
 /**
@@ -160,90 +391,102 @@ void setFrequency(uint32_t freq, uint8_t pin)
  **/
 void setPeriod(uint32_t period, uint8_t pin)
 {
-  uint32_t pre = 8;
+  uint32_t     pre = 8;
+  Timer1Config t1  = {};
 
-  TCCR1A = 0;
-  if (pin ==  9) TCCR1A = 1 << COM1A0;  // set output pin
-  if (pin == 10) TCCR1A = 1 << COM1B0;
+  leaveGenMode();
+  if (pin ==  9) t1.tccr1a = 1 << COM1A0;  // set output pin
+  if (pin == 10) t1.tccr1a = 1 << COM1B0;
 
-  TCCR1B = 0b00001010; // Prescaler: 010 = 8, resulting step 1 us
+  t1.tccr1b = 0b00001010; // Prescaler: 010 = 8, resulting step 1 us
 
   // Why these values were chosen for the decisions
   // can be seen from the tables in the header
   if (period > 65536)
   {
-    TCCR1B = 0b00001011; // Prescaler: 011 = 64, resulting step 8 us
+    t1.tccr1b = 0b00001011; // Prescaler: 011 = 64, resulting step 8 us
     pre = 64;
   }
 
   if (period > 524288)
   {
-    TCCR1B = 0b00001100; // Prescaler: 100 = 256, resulting step 32 us
+    t1.tccr1b = 0b00001100; // Prescaler: 100 = 256, resulting step 32 us
     pre = 256;
   }  
 
   if (period > 2097152)
   {
-    TCCR1B = 0b00001101; // Prescaler: 101 = 1024, resulting step 128 us
+    t1.tccr1b = 0b00001101; // Prescaler: 101 = 1024, resulting step 128 us
     pre = 1024;
   } 
 
   if (period == 0)
   {
-    TCCR1B = 0b00001001; // Prescaler: 001 = 1, resulting step 0.125 us
+    t1.tccr1b = 0b00001001; // Prescaler: 001 = 1, resulting step 0.125 us
     pre = 1;
   }
 
-  uint32_t ocr_long = period * 8 / pre - 1;
-  OCR1A = (uint16_t)ocr_long;
-  TIMSK1 = 0;             // Timer 1 interrupt mask register
+  t1.ocr1a = ocrForPeriod(period, pre);
+  t1.timsk1 = 0;          // no Timer 1 interrupts
+  timer1Commit(t1);
 }
 
 /**
- * Calculate frequency from register values
+ * Status of the square wave. Prescaler, OCR1A and fo are compared with
+ * the last call, frequency, period and text are only computed on a change
+ */
+const SquareStatus &squareStatus()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t  preBits = TCCR1B & 0b00000111;      // get bits of prescaler
+  uint16_t ocr     = OCR1A;
+  SREG = oldSREG;
+  uint32_t fo      = timebaseFo();
+
+  if (preBits == status.preBits && ocr == status.ocr && fo == status.fo) return status;
+
+  status.preBits   = preBits;
+  status.ocr       = ocr;
+  status.fo        = fo;
+  status.pre       = preValues[preBits];
+  status.frequency = (double)fo / ((uint32_t)ocr + 1) / status.pre;
+  status.period    = ((double)ocr + 1) * status.pre * 1000000.0 / fo;
+  // to use snprintf() with floats use the build_flags = -Wl,-u,vfprintf -lprintf_flt -lm
+  snprintf(status.text, sizeof(status.text), "%.2f Hz / %.2f us, PRESC: %u, OCR1A: 0x%04X / %u ",
+           status.frequency, status.period, status.pre, ocr, ocr);
+  return status;
+}
+
+/**
+ * Frequency from the register values
  */
 double getFrequencyFromRegisters()
 {
-  int      pre[] = { 0, 1, 8, 64, 256, 1024};  // possible prescaler values
-  uint16_t preBits = TCCR1B & 0b00000111;      // get bits of prescaler
-  double   frequency = 8000000.0 / (uint32_t(OCR1A) + 1) / pre[preBits]; 
-  return frequency;
+  return squareStatus().frequency;
 }
 
 /**
- * Calculate period from register values
+ * Period from the register values
  */
 double getPeriodFromRegisters()
 {
-  int      pre[] = { 0, 1, 8, 64, 256, 1024};  // possible prescaler values
-  uint16_t preBits = TCCR1B & 0b00000111;      // get bits of prescaler
-  double   period = ((double)OCR1A + 1) * pre[preBits] / 8.0;
-  return period;  
+  return squareStatus().period;
 }
 
 /**
- * Get prescaler and content of OCR1A and compute resulting frequency and period.
- * Show both values and also prescaler and OCR1A in hex and decimal. 
+ * Show frequency and period computed from prescaler and OCR1A, 
+ * also prescaler and OCR1A in hex and decimal
  */
 void printRegisterSettings()
 {
-int      pre[] = { 0, 1, 8, 64, 256, 1024};  // possible prescaler values
-uint16_t preBits = TCCR1B & 0b00000111;      // get bits of prescaler
-double   frequency;
-double   period;
-char     buf[64];
-
-frequency = 8000000.0 / (uint32_t(OCR1A) + 1) / pre[preBits];
-period = ((double)OCR1A + 1) * pre[preBits] / 8.0;
-// to use snprintf() with floats use the build_flags = -Wl,-u,vfprintf -lprintf_flt -lm
-snprintf(buf, sizeof(buf), "%.2f Hz / %.2f us, PRESC: %d, OCR1A: 0x%04X / %u ", frequency, period, pre[preBits], OCR1A, OCR1A);
-Serial.print(buf);
+  Serial.print(squareStatus().text);
 }
 
 /**
  * Switch input mode between frequency and period
  */
-void toggleInputMode()
+void toggleInputMode(const int32_t *arg)
 {
   if (mode == INPUT_MODE::FREQUENCY)
   {
@@ -261,22 +504,19 @@ void toggleInputMode()
  * Enter a value, either for the frequency or 
  * the period, depending on the input mode
  */
-void enterValue()
+void enterValue(const int32_t *arg)
 {
-  uint32_t value = 0;
-
-  delay(2000);
-  while (Serial.available())
-  {
-    value = Serial.parseInt();
-  }
+  setValue(arg[0], mode);
+  printRegisterSettings();
+  uartKeepsUp(modeIsrCycles());
+}
 
-  if (value < 1 || value > 8000000)
-  {
-    Serial.print("Value out of range, allowed: 1 .. 8'000'000 (Hz or us)");
-    return;
-  }
-  if (mode == INPUT_MODE::FREQUENCY)
+/**
+ * Set the frequency [Hz] or the period [us] of the square wave
+ */
+void setValue(uint32_t value, INPUT_MODE m)
+{
+  if (m == INPUT_MODE::FREQUENCY)
   {
     setFrequency(value, pinOut);
   }
@@ -284,81 +524,185 @@ void enterValue()
   {
     setPeriod(value, pinOut);
   }
-  printRegisterSettings();
+  freq_per   = value;
+  freqMode   = m;
+  resolvable = true;
 }
 
 /**
  * Set the prescaler
  */
-void setPrescaler()
+void setPrescaler(const int32_t *arg)
 {
-  int32_t preBits;
-
-  delay(2000);
-  while (Serial.available())
+  if (genMode != GEN_MODE::SQUARE)
   {
-    preBits = Serial.parseInt();
+    Serial.print("Not in square wave mode, enter a value with [e] first ");
+    return;
   }
+  
+  TCCR1B &= 0b11111000; // clear the prescaler bits
+  TCCR1B |= (uint8_t)arg[0];     // set the new value
+  resolvable = false;            // registers set by hand, keep them
+  printRegisterSettings();
+}
 
-  if (preBits < 1 || preBits > 5)
+/**
+ * Set the output control register OCR1A
+ */
+void setOCR1A(const int32_t *arg)
+{
+  if (genMode != GEN_MODE::SQUARE)
   {
-    Serial.println("Value out of range, allowed: 1 .. 5 ");
+    Serial.print("Not in square wave mode, enter a value with [e] first ");
     return;
   }
   
-  TCCR1B &= 0b11111000; // clear the prescaler bits
-  TCCR1B |= (uint8_t)preBits;    // set the new value
+  timer1WriteOCR1A((uint16_t)arg[0]);
+  resolvable = false;
   printRegisterSettings();
 }
 
 /**
- * Set the output control register OCR1A
+ * Enter a frequency in mHz and switch to DDS mode
  */
-void setOCR1A()
+void enterDdsFrequency(const int32_t *arg)
 {
-  int32_t value;
+  leaveGenMode();
+  ddsStart(arg[0], pinOut);
+  genMode = GEN_MODE::DDS;
+  ddsPrintSettings();
+  uartKeepsUp(modeIsrCycles());
+}
 
-  delay(2000);
-  while (Serial.available())
+/**
+ * Enter the shape and a frequency in mHz and
+ * output the waveform through the PWM DAC
+ */
+void enterWaveform(const int32_t *arg)
+{
+  leaveGenMode();
+  wavStart((WAVE_SHAPE)arg[0], arg[1], pinOut);
+  genMode = GEN_MODE::WAVEFORM;
+  wavPrintSettings();
+  uartKeepsUp(modeIsrCycles());
+}
+
+/**
+ * Enter the envelope and its period in ms and
+ * modulate the duty cycle of the PWM output
+ */
+void enterBreathe(const int32_t *arg)
+{
+  leaveGenMode();
+  breatheStart((ENVELOPE)arg[0], arg[1], pinOut);
+  genMode = GEN_MODE::BREATHE;
+  breathePrintSettings();
+  uartKeepsUp(modeIsrCycles());
+}
+
+/**
+ * Enter the divider N and output f/N on pin 10
+ * while pin 9 keeps the current frequency f
+ */
+void enterDivider(const int32_t *arg)
+{
+  if (genMode != GEN_MODE::SQUARE && genMode != GEN_MODE::SUBHARMONIC)
   {
-    value = Serial.parseInt();
+    Serial.print("Not in square wave mode, enter a value with [e] first ");
+    return;
   }
+  pinOut = 9;
+  subStart((uint16_t)arg[0]);
+  genMode = GEN_MODE::SUBHARMONIC;
+  printRegisterSettings();
+  subPrintSettings();
+  uartKeepsUp(modeIsrCycles());
+}
 
-  if (value < 0 || value > 0xffff)
+/**
+ * Enter a pin and its frequency in mHz for one of up 
+ * to 8 low frequency square waves, 0 mHz turns it off
+ */
+void enterMultipin(const int32_t *arg)
+{
+  if (genMode != GEN_MODE::MULTIPIN)
+  {
+    leaveGenMode();
+    mpStart();
+    genMode = GEN_MODE::MULTIPIN;
+  }
+  if (!mpSetChannel((uint8_t)arg[0], arg[1]))
   {
-    Serial.println("Value out of range, allowed: 0 .. 65535 ");
+    Serial.print("All 8 channels in use ");
     return;
   }
-  
-  OCR1A = (uint16_t)value;
-  printRegisterSettings();
+  mpPrintSettings();
+  uartKeepsUp(modeIsrCycles());
+}
+
+/**
+ * Enter N and M and lock the output to
+ * N/M times the reference on pin 8
+ */
+void enterRatio(const int32_t *arg)
+{
+  leaveGenMode();
+  timebaseEnable(false);      // pin 8 carries the reference, the timebase holds over
+  pllStart((uint16_t)arg[0], (uint16_t)arg[1], pinOut);
+  genMode = GEN_MODE::PLL;
+  pllPrintSettings();
+  uartKeepsUp(modeIsrCycles());
 }
 
 /**
  * Switch output signal from pin 9 to pin 10 and vice versa
  */
-void toggleOutputPin()
+void toggleOutputPin(const int32_t *arg)
+{
+  if (!setOutputPin(pinOut == 9 ? 10 : 9))
+  {
+    Serial.print("Output pins set by the mode, enter a value with [e] first");
+    return;
+  }
+  Serial.print(pinOut == 9 ? "Output pin set to 9" : "Output pin set to 10");
+}
+
+/**
+ * Move the output to pin 9 or 10. Returns false in the modes
+ * that set the pins themselves (subharmonic, multi-pin)
+ */
+bool setOutputPin(uint8_t pin)
 {
-  TCCR1A = 0;
+  if (genMode == GEN_MODE::SUBHARMONIC || genMode == GEN_MODE::MULTIPIN) return false;
+  pinOut = pin;
 
-  if (pinOut == 9)
+  if (genMode == GEN_MODE::DDS)
+  {
+    ddsSetPin(pinOut);
+  }
+  else if (genMode == GEN_MODE::WAVEFORM)
   {
-    pinOut = 10;
-    TCCR1A = 1 << COM1B0;
-    Serial.print("Output pin set to 10");
+    wavSetPin(pinOut);
+  }
+  else if (genMode == GEN_MODE::BREATHE)
+  {
+    breatheSetPin(pinOut);
+  }
+  else if (genMode == GEN_MODE::PLL)
+  {
+    pllSetPin(pinOut);
   }
   else
   {
-    pinOut = 9;
-    TCCR1A = 1 << COM1A0;
-    Serial.print("Output pin set to 9");
+    TCCR1A = (pinOut == 9) ? 1 << COM1A0 : 1 << COM1B0;
   }
+  return true;
 }
 
 /**
  * Turn on or off flashing led
  */
-void toggleHeartbeat()
+void toggleHeartbeat(const int32_t *arg)
 {
   heartbeatEnabled = !heartbeatEnabled;
   if (heartbeatEnabled)
@@ -367,20 +711,189 @@ void toggleHeartbeat()
     Serial.print("Heartbeat off ");
 }
 
+/**
+ * Show the statistics of the scheduler
+ */
+void showTasks(const int32_t *arg)
+{
+  schedPrintSettings();
+  pipePrintSettings();
+}
+
+/**
+ * Show idle share, wake-ups and current of the generator modes
+ */
+void showPower(const int32_t *arg)
+{
+  powerPrintSettings(genModeNames, sizeof(genModeNames) / sizeof(genModeNames[0]));
+}
+
+/**
+ * Enter the rate and the format of the status stream
+ */
+void enterStream(const int32_t *arg)
+{
+  telemetryStart(arg[0], (TM_FORMAT)arg[1]);
+  telemetryPrintSettings();
+}
+
+/**
+ * Enter the baud rate, the host confirms it or the port stays at the
+ * rate before. Refused if the current mode holds the interrupts too long
+ */
+void enterBaud(const int32_t *arg)
+{
+  uartSwitch(arg[0], modeIsrCycles());
+}
+
+/**
+ * Show state and estimate of the PPS disciplined timebase
+ */
+void showTimebase(const int32_t *arg)
+{
+  timebasePrintSettings();
+}
+
+/**
+ * Show the use of the 2 KB RAM
+ */
+void showMemory(const int32_t *arg)
+{
+  memPrintSettings();
+}
+
+/**
+ * Show the temperature compensation curve or clear it
+ */
+void enterTempcomp(const int32_t *arg)
+{
+  if (arg[0] == 2) tempcompClear();
+  tempcompPrintCurve();
+}
+
+/**
+ * Set the frequency or period entered last again,
+ * after a mode that borrowed Timer1
+ */
+void restoreOutput()
+{
+  if (freqMode == INPUT_MODE::FREQUENCY)
+    setFrequency(freq_per, pinOut);
+  else
+    setPeriod(freq_per, pinOut);
+  resolvable = true;
+}
+
+/**
+ * Measure the output at several test points, then
+ * set the frequency or period entered last again
+ */
+void runSelftest(const int32_t *arg)
+{
+  leaveGenMode();
+  selftestRun();
+  restoreOutput();
+}
+
+/**
+ * Time the hot paths with Timer1, then
+ * set the frequency or period entered last again
+ */
+void runBench(const int32_t *arg)
+{
+  leaveGenMode();
+  benchRun();
+  restoreOutput();
+}
+
+/**
+ * Enter port, sample rate and trigger, then capture
+ * the port and dump the samples
+ */
+void enterAnalyzer(const int32_t *arg)
+{
+  laCapture((LA_PORT)arg[0], arg[1], arg[2], arg[3]);
+}
+
+/**
+ * Enter the frequency range, the steps per decade and the
+ * analog pin, then sweep and set the last output again
+ */
+void enterBode(const int32_t *arg)
+{
+  if (arg[1] < arg[0])
+  {
+    Serial.print("Value out of range, allowed: f1 <= f2");
+    return;
+  }
+  leaveGenMode();
+  bodeSweep(arg[0], arg[1], arg[2], arg[3], pinOut);
+  restoreOutput();
+}
+
+/**
+ * Solve OCR1A again when the estimate of fo has changed, as long as
+ * the square wave was set by frequency or period. The new value is
+ * written right after a compare match, so there is no glitch
+ */
+void resolveOutput()
+{
+  static uint32_t foSolved = TB_FO_NOMINAL;
+  uint16_t pre = preValues[TCCR1B & 0b00000111];
+  uint16_t ocr;
+
+  if (timebaseFo() == foSolved) return;
+  foSolved = timebaseFo();
+  if (genMode != GEN_MODE::SQUARE || !resolvable) return;
+
+  if (freqMode == INPUT_MODE::FREQUENCY)
+    ocr = ocrForFrequency(freq_per, pre);
+  else
+    ocr = ocrForPeriod(freq_per, pre);
+
+  if (ocr == OCR1A) return;                    // change below one LSB
+  if ((uint32_t)OCR1A * pre < 512)
+    timer1WriteOCR1ASync(ocr);                 // cycle too short for the interrupt
+  else
+    timer1WriteOCR1AAtMatch(ocr);
+}
+
 /**
  * Show frequency [Hz], period [us], prescaler
  * and output control register OCR1A
  */
-void showSettings()
+void showSettings(const int32_t *arg)
 {
-  printRegisterSettings();
+  if (genMode == GEN_MODE::DDS)
+    ddsPrintSettings();
+  else if (genMode == GEN_MODE::WAVEFORM)
+    wavPrintSettings();
+  else if (genMode == GEN_MODE::BREATHE)
+    breathePrintSettings();
+  else if (genMode == GEN_MODE::MULTIPIN)
+    mpPrintSettings();
+  else if (genMode == GEN_MODE::PLL)
+    pllPrintSettings();
+  else if (genMode == GEN_MODE::SUBHARMONIC)
+  {
+    printRegisterSettings();
+    subPrintSettings();
+  }
+  else
+    printRegisterSettings();
 }
 
 /**
  * Display menu on monitor
  */
-void showMenu()
+void showMenu(const int32_t *arg)
 {
+  if (cmdLinesJoined())                  // one line in the pipeline: the commands only
+  {
+    cmdPrintHelp(commands, nbrCommands);
+    return;
+  }
+
   // title is packed into a raw string
   Serial.print(
   R"TITLE(
@@ -390,51 +903,411 @@ void showMenu()
 ------------------------------
 )TITLE");
 
-  for (int i = 0; i < nbrMenuItems; i++)
+  cmdPrintHelp(commands, nbrCommands);
+  Serial.print("\nPress a key: ");
+}
+
+/**
+ * Stop the output: Timer1 without clock, pins 9 and 10 low
+ */
+void outputOff()
+{
+  Timer1Config t1 = {};
+
+  leaveGenMode();
+  timer1Commit(t1);
+  digitalWrite(9, LOW);
+  digitalWrite(10, LOW);
+}
+
+/**
+ * Is there an output, in any mode?
+ */
+bool outputEnabled()
+{
+  return genMode != GEN_MODE::SQUARE || (TCCR1B & 0b00000111);
+}
+
+/**
+ * *IDN?: manufacturer, model, serial number, firmware
+ */
+void scpiIdn(const ScpiParam *param)
+{
+  scpiAnswer(SCPI_IDN);
+}
+
+/**
+ * *RST: the state after power-on, 1000 Hz on pin 9
+ */
+void scpiRst(const ScpiParam *param)
+{
+  leaveGenMode();
+  mode   = INPUT_MODE::FREQUENCY;
+  pinOut = 9;
+  setValue(1000, INPUT_MODE::FREQUENCY);
+}
+
+/**
+ * *CLS: clear the error queue
+ */
+void scpiCls(const ScpiParam *param)
+{
+  scpiClearErrors();
+}
+
+/**
+ * FREQ and PER: the value of [e], while the output is off it is kept for OUTP:STAT ON
+ */
+static void scpiValue(const ScpiParam *param, INPUT_MODE m)
+{
+  int32_t value = scpiInt(param);
+
+  if (outputEnabled())
   {
-    Serial.println(menu[i].txt);
+    setValue(value, m);
+    return;
+  }
+  freq_per = value;
+  freqMode = m;
+}
+
+void scpiFreq(const ScpiParam *param)
+{
+  scpiValue(param, INPUT_MODE::FREQUENCY);
+}
+
+void scpiPer(const ScpiParam *param)
+{
+  scpiValue(param, INPUT_MODE::PERIOD);
+}
+
+/**
+ * Output frequency in mHz, while the output is off that of the value set
+ */
+static uint64_t scpiFrequency_mHz()
+{
+  if (outputEnabled()) return generatorFrequency_mHz();
+  return freqMode == INPUT_MODE::FREQUENCY ? (uint64_t)freq_per * 1000 : 1000000000ULL / freq_per;
+}
+
+/**
+ * FREQ?: frequency in Hz with 3 decimals
+ */
+void scpiFreqQuery(const ScpiParam *param)
+{
+  char     buf[24];
+  uint64_t mHz = scpiFrequency_mHz();
+
+  snprintf(buf, sizeof(buf), "%lu.%03u", (unsigned long)(mHz / 1000), (unsigned)(mHz % 1000));
+  scpiAnswer(buf);
+}
+
+/**
+ * PER?: period in us with 3 decimals, 0 without a frequency
+ */
+void scpiPerQuery(const ScpiParam *param)
+{
+  char     buf[24];
+  uint64_t mHz = scpiFrequency_mHz();
+  uint64_t ns  = mHz ? (1000000000000ULL + mHz / 2) / mHz : 0;
+
+  snprintf(buf, sizeof(buf), "%lu.%03u", (unsigned long)(ns / 1000), (unsigned)(ns % 1000));
+  scpiAnswer(buf);
+}
+
+/**
+ * OUTP:STAT ON|OFF|1|0, ON sets the frequency or period entered last again
+ */
+void scpiOutpStat(const ScpiParam *param)
+{
+  if (scpiIs(param, "ON") || scpiIs(param, "1"))
+  {
+    if (!outputEnabled()) restoreOutput();
+  }
+  else
+    outputOff();
+}
+
+void scpiOutpStatQuery(const ScpiParam *param)
+{
+  scpiAnswer(outputEnabled() ? "1" : "0");
+}
+
+/**
+ * OUTP:CHAN 9|10, like [o]. While the output is off only the pin is kept
+ */
+void scpiOutpChan(const ScpiParam *param)
+{
+  int32_t pin = scpiInt(param);
+
+  if (!outputEnabled())
+    pinOut = pin;
+  else if (pin != pinOut && !setOutputPin(pin))
+    scpiError(SCPI_SETTINGS_CONFLICT);
+}
+
+void scpiOutpChanQuery(const ScpiParam *param)
+{
+  scpiAnswer(pinOut == 9 ? "9" : "10");
+}
+
+/**
+ * SOUR:FUNC SQUare|PWM: the square wave of the value entered last
+ * or the breathing PWM with a sine envelope
+ */
+void scpiSourFunc(const ScpiParam *param)
+{
+  if (scpiIs(param, "SQUare"))
+  {
+    if (genMode != GEN_MODE::SQUARE) restoreOutput();
+  }
+  else
+  {
+    leaveGenMode();
+    breatheStart(ENVELOPE::SINE, SCPI_PWM_MS, pinOut);
+    genMode = GEN_MODE::BREATHE;
   }
-  Serial.print("\nPress a key: ");
 }
 
 /**
- * Execute the action assigned to the key
+ * SOUR:FUNC?: SQU, PWM or the name of another mode
+ */
+void scpiSourFuncQuery(const ScpiParam *param)
+{
+  if (genMode == GEN_MODE::SQUARE)
+    scpiAnswer("SQU");
+  else if (genMode == GEN_MODE::BREATHE)
+    scpiAnswer("PWM");
+  else
+    scpiAnswer(generatorModeName());
+}
+
+void scpiSystErr(const ScpiParam *param)
+{
+  scpiPrintError();
+}
+
+/**
+ * Parse a SCPI command without executing it, and the number of its
+ * first parameter if value is given. For the benchmarks
+ */
+int16_t scpiParseLine(const char *line, int32_t *value)
+{
+  ScpiParam param[SCPI_MAX_PARAMS];
+  uint8_t   nParams;
+  int16_t   c = scpiParse(scpiCommands, nbrScpiCommands, line, strlen(line), param, &nParams);
+
+  if (c >= 0 && nParams && value) *value = scpiInt(&param[0]);
+  return c;
+}
+
+/**
+ * Generator mode for the status stream
+ */
+uint8_t generatorMode()
+{
+  return (uint8_t)genMode;
+}
+
+const char *generatorModeName()
+{
+  return genModeNames[(uint8_t)genMode];
+}
+
+/**
+ * Output frequency in mHz, 0 for the modes without a single output
+ * frequency (breathing PWM, multi-pin)
+ */
+uint64_t generatorFrequency_mHz()
+{
+  switch (genMode)
+  {
+    case GEN_MODE::DDS:      return ddsGetFrequency_mHz();
+    case GEN_MODE::WAVEFORM: return wavGetFrequency_mHz();
+    case GEN_MODE::PLL:      return pllGetFrequency_mHz();
+    case GEN_MODE::BREATHE:
+    case GEN_MODE::MULTIPIN: return 0;
+    default:
+    {
+      const SquareStatus &st = squareStatus();
+      uint32_t d = (uint32_t)(st.ocr + 1) * st.pre;
+      return d ? ((uint64_t)st.fo * 1000 + d / 2) / d : 0;
+    }
+  }
+}
+
+/**
+ * Execute the command assigned to the key, waits for the arguments.
+ * The blocking form of cliTask(), for the benchmarks
  */
 void doMenu()
 {
-  char key = Serial.read();
+  int key = Serial.read();
   Serial.print(CLR_LINE);
-  for (int i = 0; i < nbrMenuItems; i++)
+  if (cmdArgCount(commands, &commandIndex, key)) delay(CMD_ARG_WAIT);
+  cmdDispatch(commands, &commandIndex, key);
+}
+
+/**
+ * Execute the line read if it starts with the name of a command,
+ * e.g. "value 1000". Returns false if it is a SCPI line
+ */
+static bool runNamed()
+{
+  const char    *line;
+  bool           tooLong;
+  const Command *c;
+  int32_t        arg[CMD_MAX_ARGS];
+
+  scpiTake(&line, &tooLong);
+  if (tooLong) return false;
+  CMD_PARSE result = cmdParseLine(commands, nbrCommands, &commandIndex, line, &c, arg);
+  if (result == CMD_PARSE::UNKNOWN) return false;
+  Serial.print(CLR_LINE);
+  if (result == CMD_PARSE::RANGE)
+    cmdPrintError(c);
+  else
+    cmdRun(c, arg);
+  return true;
+}
+
+/**
+ * Wait for a key, give the user CMD_ARG_WAIT to type the
+ * arguments without blocking the other tasks, then execute.
+ * A key followed by a letter starts a line instead, the name of a
+ * command or SCPI. A '#' starts a tagged line that goes into the queue
+ * of pipeTask(), with all the tagged lines received after it
+ */
+uint8_t cliTask(Pt *pt)
+{
+  static int key;
+
+  PT_BEGIN(pt);
+  PT_WAIT_UNTIL(pt, Serial.available());
+  key = Serial.read();
+  while (key == '#')
   {
-    if (key == menu[i].key)
+    scpiBegin(key);
+    pt->t = millis();
+    PT_WAIT_UNTIL(pt, scpiRead() || millis() - pt->t >= CMD_ARG_WAIT);
+    if (!pipeQueue())                      // a queued line is answered by pipeTask()
     {
-      menu[i].action();
-      break;
+      PT_WAIT_UNTIL(pt, telemetryPause());
+      pipeReject();
+      telemetryResume();
     }
-  } 
+    key = Serial.peek() == '#' ? Serial.read() : -1;   // the next one has come, same pass
+  }
+  if (key >= 0)
+  {
+    pt->t = millis();
+    PT_WAIT_UNTIL(pt, Serial.available() || !isalpha(key) || millis() - pt->t >= SCPI_WAIT);
+    if (scpiStart(key, Serial.peek()))
+    {
+      scpiBegin(key);
+      pt->t = millis();
+      PT_WAIT_UNTIL(pt, scpiRead() || millis() - pt->t >= CMD_ARG_WAIT);
+    }
+    else if (cmdArgCount(commands, &commandIndex, key))
+    {
+      PT_SLEEP(pt, CMD_ARG_WAIT);
+    }
+    PT_WAIT_UNTIL(pt, telemetryPause());   // the answer must not land inside a frame
+    if (scpiPending())
+    {
+      if (!runNamed()) scpiExecute(scpiCommands, nbrScpiCommands);
+    }
+    else
+    {
+      Serial.print(CLR_LINE);
+      cmdDispatch(commands, &commandIndex, key);
+    }
+    telemetryResume();
+  }
+  PT_END(pt);
+}
+
+/**
+ * Execute the tagged commands of the queue, one per pass
+ */
+uint8_t pipeTask(Pt *pt)
+{
+  PT_BEGIN(pt);
+  PT_WAIT_UNTIL(pt, pipePending() && telemetryPause());
+  pipeExecute(commands, nbrCommands, &commandIndex, scpiCommands, nbrScpiCommands);
+  telemetryResume();
+  PT_END(pt);
+}
+
+/**
+ * Flash the led with a pulse of 20 ms every second
+ */
+uint8_t heartbeatTask(Pt *pt)
+{
+  PT_BEGIN(pt);
+  PT_WAIT_UNTIL(pt, heartbeatEnabled);
+  digitalWrite(LED_BUILTIN, HIGH);
+  PT_SLEEP(pt, 20);
+  digitalWrite(LED_BUILTIN, LOW);
+  PT_SLEEP(pt, 980);
+  PT_END(pt);
+}
+
+/**
+ * Take the PPS samples and solve OCR1A again if fo has moved
+ */
+uint8_t timebaseTask(Pt *pt)
+{
+  timebaseUpdate();
+  resolveOutput();
+  return PT_ENDED;
+}
+
+uint8_t temperatureTask(Pt *pt)
+{
+  tempcompUpdate();
+  return PT_ENDED;
+}
+
+/**
+ * Measure loop and ISR load
+ */
+uint8_t loadTask(Pt *pt)
+{
+  schedMeasure();
+  return PT_ENDED;
 }
 
 /**
- * Flash the led on pin with period and pulse width
+ * Count the last second for the current generator mode
  */
-void heartbeat(uint8_t pin, uint32_t period, uint32_t pulseWidth)
+uint8_t powerTask(Pt *pt)
 {
-  digitalWrite(pin, millis() % period < pulseWidth ? HIGH : LOW);
+  powerAccount((uint8_t)genMode);
+  return PT_ENDED;
 }
 
 void setup()
 {
-  Serial.begin(115200);
+  uartBegin();
   pinMode(LED_BUILTIN, OUTPUT);
   pinMode(9, OUTPUT);
   pinMode(10, OUTPUT);
+  powerBegin();
+  tempcompBegin();
+  timebaseBegin();
+#ifdef SELFTEST_AT_BOOT
+  selftestRun();
+#endif
   setFrequency(freq_per, pinOut); // default frequency is 1000 Hz on pin 9
   showMenu();
+  schedBegin(tasks, taskState, nbrTasks);
+#ifdef SIM_BENCH
+  benchSim();                     // cycle counts in simavr, see sim/simbench.c
+#endif
 }
 
 void loop()
 {
-  // handle the menu
-  if (Serial.available()) doMenu();
-  if (heartbeatEnabled)   heartbeat(LED_BUILTIN, 1000, 20); 
+  if (!schedRun()) schedIdle();
 }
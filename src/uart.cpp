@@ -0,0 +1,176 @@
+/**
+ * Program      uart.cpp
+ *
+ * Purpose      Switches the serial port at runtime from 115'200 baud up to 2 Mbaud.
+ *              The host has to confirm the new rate, else the port falls back to
+ *              the rate before
+ *
+ * Formulas     With U2X (double speed) the USART divides by 8 instead of 16:
+ *
+ *              baud  = F_CPU / 8 / (UBRR0 + 1)
+ *              UBRR0 = F_CPU / 8 / baud - 1
+ *
+ *              baud        UBRR0   actual      error
+ *              115'200     16      117'647     +2.1 %
+ *              250'000     7       250'000     0
+ *              500'000     3       500'000     0
+ *              1'000'000   1       1'000'000   0
+ *              2'000'000   0       2'000'000   0
+ *
+ *              Time of a character (start, 8 data, stop): 10 / baud,
+ *              5 us = 80 cycles at 2 Mbaud
+ *
+ *              Receive window, two characters: 20 * F_CPU / baud cycles
+ *
+ *              baud        window      modes that fit
+ *              115'200     2'777       all
+ *              250'000     1'280       all but multi-pin (1'730)
+ *              500'000     640         the same
+ *              1'000'000   320         the same
+ *              2'000'000   160         square, DDS (66), waveform (100),
+ *                                      breathe (80), f/N (90), not PLL (200)
+ *
+ *              Square waves with a cycle below 512 cycles get their correction by
+ *              the PPS written in sync, with interrupts off for T1_SYNC_TRIES
+ *              cycles: they fit with a cycle up to window / 4, e.g. 40 cycles
+ *              (200 kHz) at 2 Mbaud.
+ *
+ * Remarks      Negotiation: the answer to the command announces the rate at the old
+ *              one and waits until it is sent. Then the port switches and waits
+ *              UART_CONFIRM_MS for UART_CONFIRM_KEY from the host, which has switched
+ *              as well. Other characters, e.g. the glitch of a port that switches,
+ *              are ignored. Without the key the port returns to the old rate and
+ *              says so. After a reset the port always starts at UART_BOOT_BAUD.
+ *
+ *              Receiving stays with the interrupt of the Arduino core: it owns
+ *              USART_RX_vect and puts every character into the 64 byte buffer of
+ *              Serial, the core neither counts overruns nor framing errors. The
+ *              USART holds two received characters and a third one in the shift
+ *              register, so its interrupt may wait up to two character times before
+ *              a character is lost. So uartSwitch() takes the longest time the
+ *              active mode keeps the interrupts disabled (an ISR or a loop with
+ *              cli()) and refuses a rate whose window is shorter. A mode entered
+ *              later at a rate too fast for it is reported by uartKeepsUp().
+ *              The interrupts of every mode, Timer0 of millis() and the PPS edge,
+ *              take less than 160 cycles.
+ *
+ *              Not covered: the logic analyzer samples with interrupts disabled and
+ *              loses what comes in meanwhile at any rate, and the command line has
+ *              to take the characters out of the buffer before 64 of them are
+ *              waiting. The host sends a command and waits for its answer.
+ */
+#include <Arduino.h>
+#include "uart.h"
+#include "command.h"
+
+const uint32_t uartRates[] = { 115200, 250000, 500000, 1000000, 2000000 };
+
+uint32_t uartRate = UART_BOOT_BAUD;
+
+/**
+ * Open the port at the rate after reset
+ */
+void uartBegin()
+{
+  Serial.begin(UART_BOOT_BAUD);
+  uartRate = UART_BOOT_BAUD;
+}
+
+uint32_t uartBaud()
+{
+  return uartRate;
+}
+
+/**
+ * Open the port at baud and forget what came in before
+ */
+static void reopen(uint32_t baud)
+{
+  Serial.flush();                           // the last answer out at the old rate
+  Serial.begin(baud);
+  while (Serial.available()) Serial.read();
+}
+
+/**
+ * Switch to baud if the host confirms it within UART_CONFIRM_MS,
+ * else stay at the rate before. Refuses a rate whose receive window
+ * is shorter than isrCycles with interrupts disabled. Returns true
+ * if switched
+ */
+bool uartSwitch(uint32_t baud, uint16_t isrCycles)
+{
+  char buf[80];
+  bool valid = false;
+
+  for (uint8_t i = 0; i < sizeof(uartRates) / sizeof(uartRates[0]); i++)
+    if (uartRates[i] == baud) valid = true;
+  if (!valid)
+  {
+    Serial.print("Value out of range, allowed: 115200, 250000, 500000, 1000000, 2000000");
+    return false;
+  }
+  if (isrCycles > uartWindowCycles(baud))
+  {
+    snprintf(buf, sizeof(buf), "BAUD: %lu refused, interrupts off up to %u cycles, %lu allowed ",
+             (unsigned long)baud, isrCycles, (unsigned long)uartWindowCycles(baud));
+    Serial.print(buf);
+    return false;
+  }
+
+  snprintf(buf, sizeof(buf), "BAUD: %lu, send '%c' within %u ms",
+           (unsigned long)baud, UART_CONFIRM_KEY, UART_CONFIRM_MS);
+  cmdBeginLine();
+  Serial.print(buf);
+  cmdEndLine();
+  reopen(baud);
+
+  uint32_t start = millis();
+  while (millis() - start < UART_CONFIRM_MS)
+  {
+    if (Serial.read() != UART_CONFIRM_KEY) continue;
+    uartRate = baud;
+    cmdBeginLine();
+    uartPrintSettings();
+    return true;
+  }
+
+  reopen(uartRate);
+  cmdBeginLine();
+  snprintf(buf, sizeof(buf), "BAUD: no answer at %lu, back to %lu ",
+           (unsigned long)baud, (unsigned long)uartRate);
+  Serial.print(buf);
+  return false;
+}
+
+/**
+ * True if the receive interrupt can wait isrCycles at the current rate,
+ * else say on a line of its own that characters may get lost
+ */
+bool uartKeepsUp(uint16_t isrCycles)
+{
+  char buf[80];
+
+  if (isrCycles <= uartWindowCycles(uartRate)) return true;
+  snprintf(buf, sizeof(buf), "BAUD: %lu too fast, interrupts off up to %u cycles, %lu allowed ",
+           (unsigned long)uartRate, isrCycles, (unsigned long)uartWindowCycles(uartRate));
+  cmdBeginLine();
+  Serial.print(buf);
+  return false;
+}
+
+/**
+ * Show the rate, UBRR0, U2X and the error of the actual rate
+ */
+void uartPrintSettings()
+{
+  char     buf[80];
+  bool     u2x    = UCSR0A & (1 << U2X0);
+  uint16_t ubrr   = UBRR0;
+  uint32_t actual = F_CPU / (u2x ? 8 : 16) / ((uint32_t)ubrr + 1);
+  int32_t  error  = (int32_t)(((int64_t)actual - uartRate) * 1000 / (int32_t)uartRate);   // 0.1 %
+
+  snprintf(buf, sizeof(buf), "BAUD: %lu, UBRR0: %u%s, actual %lu, error %c%ld.%ld %% ",
+           (unsigned long)uartRate, ubrr, u2x ? " U2X" : "", (unsigned long)actual,
+           error < 0 ? '-' : '+', labs(error) / 10, labs(error) % 10);
+  Serial.print(buf);
+}
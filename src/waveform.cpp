@@ -0,0 +1,226 @@
+/**
+ * Program      waveform.cpp
+ *
+ * Purpose      Sine, triangle and sawtooth output through a PWM DAC.
+ *              Timer1 runs in 8-bit fast PWM mode with prescaler 1, so the
+ *              PWM frequency on pin 9 (or 10) is 16 MHz / 256 = 62'500 Hz.
+ *              Timer2 interrupts at WAV_FS = 31'250 Hz, steps a 32-bit phase
+ *              accumulator and writes the wavetable entry addressed by the
+ *              upper 8 bits of the phase to OCR1A (or OCR1B)
+ *
+ * Formulas     f  = tw * fs / 2^32,  fs = 31'250 Hz
+ *              tw = mHz * 2^32 / 31'250'000
+ *
+ *              resolution = fs / 2^32 = 7.28 uHz
+ *
+ *              fs is corrected with the PPS timebase (see timebase.cpp)
+ *
+ * Wiring       RC low pass on pin 9 (or 10) to remove the 62.5 kHz carrier,
+ *              e.g. 2 x (1 kOhm, 100 nF) for a corner frequency of 1.6 kHz
+ *
+ * Remarks      OCR1A/B are double buffered in fast PWM mode and are updated at
+ *              BOTTOM, so a new sample never produces a glitch.
+ *
+ *              Between two interrupts there are 512 cycles. At the end of the
+ *              ISR, TCNT2 (cleared at the compare match, counting with fcpu/8)
+ *              tells how many cycles have elapsed since the compare match. The
+ *              maximum is kept in wavIsrMax and shown with the settings. Together
+ *              with the epilogue the ISR needs about 100 of the 512 cycles, which
+ *              leaves enough time for the serial interrupts and the CLI.
+ */
+#include <Arduino.h>
+#include "waveform.h"
+#include "timer1.h"
+#include "timebase.h"
+#include "power.h"
+
+// round(127.5 + 127.5 * sin(2 * pi * i / 256))
+const uint8_t sineTable[256] PROGMEM =
+{
+  128, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162, 165, 167, 170, 173,
+  176, 179, 182, 185, 188, 190, 193, 196, 198, 201, 203, 206, 208, 211, 213, 215,
+  218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+  245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+  255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+  245, 244, 243, 241, 240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+  218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190, 188, 185, 182, 179,
+  176, 173, 170, 167, 165, 162, 158, 155, 152, 149, 146, 143, 140, 137, 134, 131,
+  128, 124, 121, 118, 115, 112, 109, 106, 103, 100,  97,  93,  90,  88,  85,  82,
+   79,  76,  73,  70,  67,  65,  62,  59,  57,  54,  52,  49,  47,  44,  42,  40,
+   37,  35,  33,  31,  29,  27,  25,  23,  21,  20,  18,  17,  15,  14,  12,  11,
+   10,   9,   7,   6,   5,   5,   4,   3,   2,   2,   1,   1,   1,   0,   0,   0,
+    0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,   5,   6,   7,   9,
+   10,  11,  12,  14,  15,  17,  18,  20,  21,  23,  25,  27,  29,  31,  33,  35,
+   37,  40,  42,  44,  47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+   79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112, 115, 118, 121, 124
+};
+
+// rises from 0 to 254 and falls from 255 to 1
+const uint8_t triangleTable[256] PROGMEM =
+{
+    0,   2,   4,   6,   8,  10,  12,  14,  16,  18,  20,  22,  24,  26,  28,  30,
+   32,  34,  36,  38,  40,  42,  44,  46,  48,  50,  52,  54,  56,  58,  60,  62,
+   64,  66,  68,  70,  72,  74,  76,  78,  80,  82,  84,  86,  88,  90,  92,  94,
+   96,  98, 100, 102, 104, 106, 108, 110, 112, 114, 116, 118, 120, 122, 124, 126,
+  128, 130, 132, 134, 136, 138, 140, 142, 144, 146, 148, 150, 152, 154, 156, 158,
+  160, 162, 164, 166, 168, 170, 172, 174, 176, 178, 180, 182, 184, 186, 188, 190,
+  192, 194, 196, 198, 200, 202, 204, 206, 208, 210, 212, 214, 216, 218, 220, 222,
+  224, 226, 228, 230, 232, 234, 236, 238, 240, 242, 244, 246, 248, 250, 252, 254,
+  255, 253, 251, 249, 247, 245, 243, 241, 239, 237, 235, 233, 231, 229, 227, 225,
+  223, 221, 219, 217, 215, 213, 211, 209, 207, 205, 203, 201, 199, 197, 195, 193,
+  191, 189, 187, 185, 183, 181, 179, 177, 175, 173, 171, 169, 167, 165, 163, 161,
+  159, 157, 155, 153, 151, 149, 147, 145, 143, 141, 139, 137, 135, 133, 131, 129,
+  127, 125, 123, 121, 119, 117, 115, 113, 111, 109, 107, 105, 103, 101,  99,  97,
+   95,  93,  91,  89,  87,  85,  83,  81,  79,  77,  75,  73,  71,  69,  67,  65,
+   63,  61,  59,  57,  55,  53,  51,  49,  47,  45,  43,  41,  39,  37,  35,  33,
+   31,  29,  27,  25,  23,  21,  19,  17,  15,  13,  11,   9,   7,   5,   3,   1
+};
+
+// rises from 0 to 255
+const uint8_t sawTable[256] PROGMEM =
+{
+    0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+   16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+   32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+   48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+   64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,
+   80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
+   96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+  112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,
+  128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+  144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+  160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+  176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+  192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+  208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+  224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+  240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+};
+
+volatile uint32_t  wavPhase      = 0;          // phase accumulator
+volatile uint32_t  wavTuningWord = 0;          // added to the phase on every interrupt
+const uint8_t * volatile wavTable = sineTable; // wavetable in flash
+decltype(&OCR1A) volatile wavOcr = &OCR1A;  // compare register of the output pin
+volatile uint8_t   wavIsrMax     = 0;          // max TCNT2 at the end of the ISR
+WAVE_SHAPE         wavShape      = WAVE_SHAPE::SINE;
+
+/**
+ * Wavetable in flash for the shape
+ */
+static const uint8_t *shapeTable(WAVE_SHAPE shape)
+{
+  switch (shape)
+  {
+    case WAVE_SHAPE::TRIANGLE: return triangleTable;
+    case WAVE_SHAPE::SAW:      return sawTable;
+    default:                   return sineTable;
+  }
+}
+
+/**
+ * Start the waveform with a frequency between 1 .. 2'000'000 mHz on pin 9 or 10
+ */
+void wavStart(WAVE_SHAPE shape, uint32_t mHz, uint8_t pin)
+{
+  uint32_t fs = timebaseScale(WAV_FS * 1000);   // in mHz
+  uint32_t tw = (uint32_t)((((uint64_t)mHz << 32) + fs / 2) / fs);
+
+  powerTimer2(true);
+  TIMSK2 = 0;
+  TIMSK1 = 0;
+  wavShape      = shape;
+  wavTable      = shapeTable(shape);
+  wavTuningWord = tw;
+  wavPhase      = 0;
+  wavIsrMax     = 0;
+
+  // Timer1: 8-bit fast PWM (WGM13..0 = 0101), prescaler 1
+  Timer1Config t1 = {};
+  t1.ocr1a  = 128;
+  t1.ocr1b  = 128;
+  t1.tccr1b = 0b00001001;
+  //                ^  ^--- prescaler 1
+  //                WGM12, together with WGM10 in TCCR1A: 8-bit fast PWM
+  timer1Commit(t1);
+  wavSetPin(pin);
+
+  // Timer2: CTC mode, prescaler 8, interrupt at 31'250 Hz
+  TCCR2A = 1 << WGM21;
+  TCCR2B = 1 << CS21;
+  OCR2A  = WAV_OCR2A;
+  TCNT2  = 0;
+  TIFR2  = 1 << OCF2A;
+  TIMSK2 = 1 << OCIE2A;
+}
+
+/**
+ * Stop the sample interrupt, release Timer2 and stop its clock
+ */
+void wavStop()
+{
+  TIMSK2 = 0;
+  TCCR2B = 0;
+  powerTimer2(false);
+}
+
+/**
+ * Route the PWM output to pin 9 (OC1A) or pin 10 (OC1B)
+ */
+void wavSetPin(uint8_t pin)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (pin == 10)
+  {
+    TCCR1A = (1 << COM1B1) | (1 << WGM10);
+    wavOcr = &OCR1B;
+  }
+  else
+  {
+    TCCR1A = (1 << COM1A1) | (1 << WGM10);
+    wavOcr = &OCR1A;
+  }
+  SREG = oldSREG;
+}
+
+/**
+ * Effective waveform frequency in mHz computed from the tuning word
+ */
+uint32_t wavGetFrequency_mHz()
+{
+  uint32_t tw;
+  uint8_t oldSREG = SREG;
+  cli();
+  tw = wavTuningWord;
+  SREG = oldSREG;
+  return (uint32_t)(((uint64_t)tw * timebaseScale(WAV_FS * 1000) + 0x80000000ULL) >> 32);
+}
+
+/**
+ * Show shape, effective frequency and the measured ISR time
+ */
+void wavPrintSettings()
+{
+  const char *names[] = { "", "SINE", "TRIANGLE", "SAW" };
+  char     buf[80];
+  uint32_t mHz = wavGetFrequency_mHz();
+
+  snprintf(buf, sizeof(buf), "WAV: %s %lu.%03lu Hz, FS: %lu Hz, ISR max: %u / %u cycles ",
+           names[(uint8_t)wavShape], (unsigned long)(mHz / 1000), (unsigned long)(mHz % 1000),
+           (unsigned long)timebaseScale(WAV_FS), wavIsrMax * 8, WAV_ISR_BUDGET);
+  Serial.print(buf);
+}
+
+/**
+ * Step the phase and output the next sample. The 16-bit write
+ * also sets the high byte, so a stale TEMP register is harmless
+ */
+ISR(TIMER2_COMPA_vect)
+{
+  uint32_t phase = wavPhase + wavTuningWord;
+  wavPhase = phase;
+  *wavOcr  = pgm_read_byte(wavTable + (uint8_t)(phase >> 24));
+
+  uint8_t t = TCNT2;
+  if (t > wavIsrMax) wavIsrMax = t;
+}
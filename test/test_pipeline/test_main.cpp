@@ -0,0 +1,185 @@
+/**
+ * Program      test_main.cpp
+ *
+ * Purpose      Native tests of the pipeline of tagged commands: the whole sketch
+ *              runs, the commands go in through the receive buffer of Serial and
+ *              the answers come back through a pipe. Back-pressure with BUSY, tags
+ *              that are no tag and the order of the ACK and NAK answers
+ *
+ *              pio test -e native
+ *
+ * Formulas     115'200 baud: 1 character = 10 bits = 1'389 cycles
+ *
+ *              "#12 FREQ?\n" is 10 characters, its answer "#12 ACK 1000.000\r\n" 18:
+ *              a burst of commands comes in faster than the answers go out, so the
+ *              queue of PIPE_QUEUE - 1 bytes fills up
+ *
+ * Remarks      The host Serial has the 64 byte receive buffer of the board and waits
+ *              while 64 characters are queued for sending. A line that finds the
+ *              queue full must be answered BUSY, none may be lost in the receive
+ *              buffer (Serial.rxDropped).
+ */
+#include <unity.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "hostio.h"
+#include "pipe.h"
+
+extern uint8_t pipeMaxUsed;
+
+constexpr uint16_t BURST_LINES = 40;
+
+static int  fdSend;                     // to the receive buffer of Serial
+static int  fdAnswer;                   // from the output of Serial
+static char answers[16384];
+
+/**
+ * Run the scheduler for ms of virtual time
+ */
+static void run(uint32_t ms)
+{
+  uint32_t start = millis();
+  while (millis() - start < ms) loop();
+}
+
+static void send(const char *s)
+{
+  TEST_ASSERT_EQUAL(strlen(s), write(fdSend, s, strlen(s)));
+}
+
+/**
+ * All output since the last call
+ */
+static const char *receive()
+{
+  ssize_t n = read(fdAnswer, answers, sizeof(answers) - 1);
+  answers[n > 0 ? n : 0] = 0;
+  return answers;
+}
+
+/**
+ * The answer to tag, nullptr if there is none
+ */
+static const char *answerOf(const char *out, uint16_t tag)
+{
+  char head[8];
+  snprintf(head, sizeof(head), "#%u ", tag);
+  for (const char *p = out; (p = strstr(p, head)); p++)
+  {
+    if (p == out || p[-1] == '\n') return p + strlen(head);
+  }
+  return nullptr;
+}
+
+void setUp()
+{
+  run(10);
+  receive();
+}
+
+void tearDown()
+{
+}
+
+/**
+ * More commands than the queue holds, in one write: the ones that do
+ * not fit are answered BUSY, the others run in order, none is lost
+ */
+void test_burst_busy()
+{
+  char     line[16];
+  char     burst[BURST_LINES * sizeof(line)] = "";
+  uint16_t busy = 0;
+
+  for (uint16_t t = 1; t <= BURST_LINES; t++)
+  {
+    snprintf(line, sizeof(line), "#%u FREQ?\n", t);
+    strcat(burst, line);
+  }
+  TEST_ASSERT_GREATER_THAN(PIPE_QUEUE, strlen(burst));
+  send(burst);
+  run(500);
+
+  const char *out  = receive();
+  const char *last = out;
+  for (uint16_t t = 1; t <= BURST_LINES; t++)
+  {
+    const char *a = answerOf(out, t);
+    TEST_ASSERT_NOT_NULL_MESSAGE(a, "tag not answered");
+    if (!strncmp(a, "BUSY\r\n", 6))
+    {
+      busy++;
+      continue;
+    }
+    TEST_ASSERT_EQUAL_STRING_LEN("ACK 1000.000\r\n", a, 14);
+    TEST_ASSERT_TRUE_MESSAGE(a > last, "executed out of order");
+    last = a;
+  }
+  TEST_ASSERT_GREATER_THAN(0, busy);
+  TEST_ASSERT_GREATER_THAN(PIPE_QUEUE - 1 - 11, pipeMaxUsed);   // BUSY only when full
+  TEST_ASSERT_EQUAL_UINT32(0, Serial.rxDropped);
+}
+
+/**
+ * Tags that are not a number up to 65535 followed by a blank: the
+ * line is answered NAK without a tag, in its place in the queue
+ */
+void test_bad_tag()
+{
+  send("#x FREQ?\n#70000 FREQ?\n#17e1000\n");
+  run(100);
+  TEST_ASSERT_EQUAL_STRING("#? NAK Missing tag\r\n#? NAK Missing tag\r\n#? NAK Missing tag\r\n",
+                           receive());
+}
+
+/**
+ * ACK and NAK in the order of the commands, one line each
+ */
+void test_answer_order()
+{
+  const char *expected[] =
+  {
+    "#1 ACK 1000.000\r\n",
+    "#? NAK Missing tag\r\n",
+    "#2 NAK -222,\"Data out of range\"\r\n",
+    "#3 NAK Unknown command\r\n",
+    "#4 ACK 500.00 Hz",
+    "#5 NAK Missing command\r\n",
+    "#6 ACK 500.000;1\r\n",
+  };
+
+  send("#1 FREQ?\n#x e1000\n#2 FREQ 1e100\n#3 ~\n#4 e500\n#5\n#6 FREQ?;OUTP:STAT?\n");
+  run(200);
+
+  const char *out = receive();
+  for (const char *e : expected)
+  {
+    TEST_ASSERT_EQUAL_STRING_LEN(e, out, strlen(e));
+    out = strchr(out, '\n');
+    TEST_ASSERT_NOT_NULL_MESSAGE(out, "answer missing");
+    out++;
+  }
+  TEST_ASSERT_EQUAL_STRING("", out);
+}
+
+int main(int argc, char **argv)
+{
+  int in[2], out[2];
+  if (pipe(in) || pipe(out)) return 1;
+  fcntl(out[0], F_SETFL, O_NONBLOCK);
+  fcntl(out[1], F_SETPIPE_SZ, 1 << 16);
+  fdSend   = in[1];
+  fdAnswer = out[0];
+
+  init();
+  Serial.fdIn  = in[0];
+  Serial.fdOut = out[1];
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_busy);
+  RUN_TEST(test_bad_tag);
+  RUN_TEST(test_answer_order);
+  return UNITY_END();
+}
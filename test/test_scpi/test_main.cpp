@@ -0,0 +1,214 @@
+/**
+ * Program      test_main.cpp
+ *
+ * Purpose      Native tests of the SCPI parser: headers in the short and the long
+ *              form, numbers with fraction and exponent, keyword lists and the
+ *              error queue
+ *
+ *              pio test -e native
+ *
+ * Formulas     1.5E6 = 1'500'000, 1.5 = 2 (rounded), 1e100 > INT32_MAX: -222
+ *
+ * Remarks      The table of the tests stands in for the one of the sketch. The
+ *              answers of the queries are read back through a pipe from Serial.
+ */
+#include <unity.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "scpi.h"
+
+constexpr int16_t SCPI_DATA_TYPE = -104;      // not exported by scpi.cpp
+
+static int     fdAnswer;                      // from the output of Serial
+static char    answers[512];
+static int32_t lastValue;
+
+static void setValue(const ScpiParam *param)
+{
+  lastValue = scpiInt(param);
+}
+
+static void systErr(const ScpiParam *param)
+{
+  scpiPrintError();
+}
+
+const ScpiCommand table[] PROGMEM =
+{
+  { "FREQuency",      1, 1, 8000000, "",           setValue },
+  { "FREQuency?",     0, 0, 0,       "",           nullptr },
+  { "OUTPut:STATe",   1, 0, 0,       "ON|OFF|1|0", nullptr },
+  { "OUTPut:CHANnel", 1, 0, 0,       "9|10",       nullptr },
+  { "SYSTem:ERRor?",  0, 0, 0,       "",           systErr },
+};
+constexpr uint8_t nbrCommands = sizeof(table) / sizeof(table[0]);
+
+/**
+ * Index of the command or the error code of the line s
+ */
+static int16_t parse(const char *s)
+{
+  ScpiParam param[SCPI_MAX_PARAMS];
+  uint8_t   nParams;
+  return scpiParse(table, nbrCommands, s, strlen(s), param, &nParams);
+}
+
+/**
+ * Number of a parameter as the handler gets it
+ */
+static int32_t number(const char *s)
+{
+  ScpiParam param = { s, (uint8_t)strlen(s) };
+  return scpiInt(&param);
+}
+
+/**
+ * Execute the line and return what it answered
+ */
+static const char *execute(const char *line)
+{
+  scpiExecuteLine(table, nbrCommands, line, strlen(line));
+  ssize_t n = read(fdAnswer, answers, sizeof(answers) - 1);
+  answers[n > 0 ? n : 0] = 0;
+  return answers;
+}
+
+void setUp()
+{
+  scpiClearErrors();
+}
+
+void tearDown()
+{
+}
+
+/**
+ * Every mnemonic in the short or the long form, any case, leading ':'
+ */
+void test_header_forms()
+{
+  TEST_ASSERT_EQUAL(0, parse("FREQ 1000"));
+  TEST_ASSERT_EQUAL(0, parse("freq 1000"));
+  TEST_ASSERT_EQUAL(0, parse("FREQuency 1000"));
+  TEST_ASSERT_EQUAL(0, parse(":FREQUENCY 1000"));
+  TEST_ASSERT_EQUAL(1, parse("FREQ?"));
+  TEST_ASSERT_EQUAL(2, parse("OUTP:STAT ON"));
+  TEST_ASSERT_EQUAL(2, parse("output:state on"));
+  TEST_ASSERT_EQUAL(2, parse("OUTPut:STAT 1"));
+  TEST_ASSERT_EQUAL(4, parse("SYST:ERR?"));
+}
+
+/**
+ * Neither form: a part of the long one, a longer word, a missing
+ * mnemonic or '?', a wrong separator
+ */
+void test_header_rejected()
+{
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("FRE 1000"));
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("FREQU 1000"));
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("FREQUENCYX 1000"));
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("OUTP ON"));
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("SYST:ERR"));
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("SYST:ERR??"));
+  TEST_ASSERT_EQUAL(SCPI_UNDEFINED_HEADER, parse("OUTP;STAT ON"));
+  TEST_ASSERT_EQUAL(SCPI_MISSING_PARAM, parse("FREQ"));
+  TEST_ASSERT_EQUAL(SCPI_PARAM_NOT_ALLOWED, parse("FREQ? 1"));
+}
+
+/**
+ * Fraction and exponent rounded to an integer
+ */
+void test_number()
+{
+  TEST_ASSERT_EQUAL_INT32(1500000, number("1.5E6"));
+  TEST_ASSERT_EQUAL_INT32(1500000, number("1.5e+6"));
+  TEST_ASSERT_EQUAL_INT32(2, number("1.5"));
+  TEST_ASSERT_EQUAL_INT32(1, number("1.49"));
+  TEST_ASSERT_EQUAL_INT32(-2, number("-1.5"));
+  TEST_ASSERT_EQUAL_INT32(1, number("0.5"));
+  TEST_ASSERT_EQUAL_INT32(0, number("0.49"));
+  TEST_ASSERT_EQUAL_INT32(12, number("1234E-2"));
+  TEST_ASSERT_EQUAL_INT32(2147483647, number("2147483647"));
+  TEST_ASSERT_EQUAL_INT32(2147483647, number("21474836470E-1"));
+}
+
+/**
+ * Too large or not a number, checked against the range of FREQ
+ */
+void test_number_rejected()
+{
+  TEST_ASSERT_EQUAL(SCPI_OUT_OF_RANGE, parse("FREQ 1e100"));
+  TEST_ASSERT_EQUAL(SCPI_OUT_OF_RANGE, parse("FREQ 2147483648"));
+  TEST_ASSERT_EQUAL(SCPI_OUT_OF_RANGE, parse("FREQ 8.1E6"));
+  TEST_ASSERT_EQUAL(SCPI_OUT_OF_RANGE, parse("FREQ 0.4"));
+  TEST_ASSERT_EQUAL(0, parse("FREQ 8E6"));
+  TEST_ASSERT_EQUAL(SCPI_DATA_TYPE, parse("FREQ 1E"));
+  TEST_ASSERT_EQUAL(SCPI_DATA_TYPE, parse("FREQ 1.5x"));
+  TEST_ASSERT_EQUAL(SCPI_DATA_TYPE, parse("FREQ E6"));
+}
+
+/**
+ * Keyword lists: the whole keyword in either form, numbers as words
+ */
+void test_keywords()
+{
+  TEST_ASSERT_EQUAL(3, parse("OUTP:CHAN 9"));
+  TEST_ASSERT_EQUAL(3, parse("OUTP:CHAN 10"));
+  TEST_ASSERT_EQUAL(SCPI_ILLEGAL_VALUE, parse("OUTP:CHAN 1"));
+  TEST_ASSERT_EQUAL(SCPI_ILLEGAL_VALUE, parse("OUTP:CHAN 100"));
+  TEST_ASSERT_EQUAL(SCPI_ILLEGAL_VALUE, parse("OUTP:CHAN 9|10"));
+  TEST_ASSERT_EQUAL(2, parse("OUTP:STAT off"));
+  TEST_ASSERT_EQUAL(SCPI_ILLEGAL_VALUE, parse("OUTP:STAT O"));
+  TEST_ASSERT_EQUAL(SCPI_ILLEGAL_VALUE, parse("OUTP:STAT ONN"));
+}
+
+/**
+ * The commands of a line run one after the other, the
+ * handler gets the parameter checked
+ */
+void test_line()
+{
+  lastValue = 0;
+  TEST_ASSERT_EQUAL_STRING("", execute("FREQ 1.5E3;FREQ 2E3"));
+  TEST_ASSERT_EQUAL_INT32(2000, lastValue);
+  TEST_ASSERT_EQUAL_STRING("-113,\"Undefined header\";0,\"No error\"",
+                           execute("FRE 1;SYST:ERR?;SYST:ERR?"));
+}
+
+/**
+ * More errors than the queue holds: the last entry becomes -350,
+ * the oldest ones stay
+ */
+void test_error_overflow()
+{
+  for (uint8_t i = 0; i < SCPI_ERRORS + 3; i++) scpiError(SCPI_SYNTAX);
+  scpiError(SCPI_OUT_OF_RANGE);
+
+  for (uint8_t i = 0; i < SCPI_ERRORS - 1; i++)
+    TEST_ASSERT_EQUAL_STRING("-102,\"Syntax error\"", execute("SYST:ERR?"));
+  TEST_ASSERT_EQUAL_STRING("-350,\"Queue overflow\"", execute("SYST:ERR?"));
+  TEST_ASSERT_EQUAL_STRING("0,\"No error\"", execute("SYST:ERR?"));
+
+  scpiError(SCPI_SYNTAX);                       // room again after reading
+  TEST_ASSERT_EQUAL_STRING("-102,\"Syntax error\"", execute("SYST:ERR?"));
+}
+
+int main(int argc, char **argv)
+{
+  int out[2];
+  if (pipe(out)) return 1;
+  fcntl(out[0], F_SETFL, O_NONBLOCK);
+  fdAnswer     = out[0];
+  Serial.fdOut = out[1];
+
+  UNITY_BEGIN();
+  RUN_TEST(test_header_forms);
+  RUN_TEST(test_header_rejected);
+  RUN_TEST(test_number);
+  RUN_TEST(test_number_rejected);
+  RUN_TEST(test_keywords);
+  RUN_TEST(test_line);
+  RUN_TEST(test_error_overflow);
+  return UNITY_END();
+}
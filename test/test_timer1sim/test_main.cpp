@@ -0,0 +1,206 @@
+/**
+ * Program      test_main.cpp
+ *
+ * Purpose      Native tests of the Timer1 host model and the firmware that writes
+ *              it: edge intervals of the square wave across an OCR1A change, the
+ *              CTC wrap through 0xFFFF, and the outputs of the DDS and PLL ISRs
+ *
+ *              pio test -e native
+ *
+ * Formulas     CTC toggle on pin 9:  edge interval = (OCR1A + 1) * prescaler cycles
+ *                                    1 kHz -> 8'000 cycles, 50 kHz -> 160 cycles
+ *
+ *              DDS 100 Hz:           edge interval = 80'000 cycles, on the grid of
+ *                                    256 cycles (DDS_FS = 62'500 Hz)
+ *
+ *              PLL 3/2 x 1 kHz:      edge interval = 16'000'000 / 1'500 / 2
+ *                                    = 5'333.3 cycles
+ *
+ * Remarks      A probe registered as a host device records the CPU cycle of every
+ *              edge on pin 9. The new OCR1A is always written while TCNT1 is above
+ *              it, the case that makes CTC run through 0xFFFF. test_ctc_wrap shows
+ *              that the model has the glitch, the other tests that the firmware
+ *              avoids it. fo is changed through tbFo as the timebase would, and each
+ *              test uses a value of its own: resolveOutput() only solves again when
+ *              fo has changed.
+ */
+#include <unity.h>
+#include "hostio.h"
+#include "generator.h"
+#include "timebase.h"
+#include "timer1.h"
+#include "dds.h"
+#include "pll.h"
+
+extern uint32_t tbFo;
+extern uint32_t freq_per;
+void resolveOutput();
+void restoreOutput();
+
+constexpr uint16_t PROBE_EDGES = 1024;
+
+/**
+ * Records the edges of pin 9, keeps no time of its own
+ */
+class EdgeProbe : public HostDevice
+{
+public:
+  uint64_t nextEvent() override { return HOST_NEVER; }
+  void     run(uint64_t until) override {}
+  void     pinChanged(uint8_t pin, bool level) override
+  {
+    if (pin == 9 && n < PROBE_EDGES) edges[n++] = hostCycles;
+  }
+
+  uint32_t interval(uint16_t i) const { return (uint32_t)(edges[i + 1] - edges[i]); }
+
+  uint64_t edges[PROBE_EDGES];
+  uint16_t n = 0;
+};
+
+static EdgeProbe probe;
+
+/**
+ * Square wave of freq on pin 9 with fo nominal, as [e] leaves it
+ */
+static void square(uint32_t freq)
+{
+  tbFo     = TB_FO_NOMINAL;
+  freq_per = freq;
+  restoreOutput();
+}
+
+/**
+ * Wait until TCNT1 is in lo .. hi
+ */
+static void waitCounter(uint16_t lo, uint16_t hi)
+{
+  uint16_t t;
+  do t = TCNT1; while (t < lo || t > hi);
+}
+
+static uint32_t maxInterval()
+{
+  uint32_t m = 0;
+  for (uint16_t i = 0; i + 1 < probe.n; i++) if (probe.interval(i) > m) m = probe.interval(i);
+  return m;
+}
+
+void setUp()
+{
+  hostDriveInput(8, 0);
+  square(1000);
+  delay(1);
+  probe.n = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_square_edges()
+{
+  delay(10);
+  TEST_ASSERT_GREATER_OR_EQUAL(19, probe.n);
+  for (uint16_t i = 0; i + 1 < probe.n; i++) TEST_ASSERT_EQUAL_UINT32(8000, probe.interval(i));
+}
+
+/**
+ * A new OCR1A below TCNT1, written at once: the counter runs to 0xFFFF
+ */
+void test_ctc_wrap()
+{
+  delay(1);
+  waitCounter(7300, 7900);
+  timer1WriteOCR1A(7199);
+  delay(10);
+  TEST_ASSERT_GREATER_THAN_UINT32(65536, maxInterval());
+}
+
+/**
+ * fo changes with a long cycle: the interrupt writes OCR1A after the next match
+ */
+void test_resolve_at_match()
+{
+  delay(1);
+  tbFo = 7600000;
+  waitCounter(7650, 7900);
+  resolveOutput();
+  delay(10);
+  TEST_ASSERT_GREATER_OR_EQUAL(3, probe.n);
+  TEST_ASSERT_EQUAL_UINT16(7599, OCR1A);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(8000, maxInterval());
+  TEST_ASSERT_EQUAL_UINT32(7600, probe.interval(probe.n - 2));
+}
+
+/**
+ * fo changes with a cycle too short for the interrupt: the write is polled
+ */
+void test_resolve_short_cycle()
+{
+  square(50000);
+  probe.n = 0;
+  delay(1);
+  tbFo = 7200000;
+  waitCounter(138, 142);
+  resolveOutput();
+  delay(10);
+  TEST_ASSERT_GREATER_OR_EQUAL(3, probe.n);
+  TEST_ASSERT_EQUAL_UINT16(143, OCR1A);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(160, maxInterval());
+  TEST_ASSERT_EQUAL_UINT32(144, probe.interval(probe.n - 2));
+}
+
+/**
+ * The DDS ISR toggles on the sample grid, the average is exact
+ */
+void test_dds_output()
+{
+  ddsStart(100000, 9);
+  delay(5);
+  probe.n = 0;
+  delay(200);
+  TEST_ASSERT_GREATER_OR_EQUAL(39, probe.n);
+  for (uint16_t i = 0; i + 1 < probe.n; i++)
+  {
+    TEST_ASSERT_UINT32_WITHIN(256, 80000, probe.interval(i));
+    TEST_ASSERT_EQUAL_UINT32(0, probe.interval(i) % 256);
+  }
+  uint32_t avg = (uint32_t)((probe.edges[probe.n - 1] - probe.edges[0]) / (probe.n - 1));
+  TEST_ASSERT_UINT32_WITHIN(10, 80000, avg);
+}
+
+/**
+ * The PLL ISR locks 3/2 times a reference of 1 kHz on pin 8
+ */
+void test_pll_output()
+{
+  hostDriveInput(8, 1000);
+  pllStart(3, 2, 9);
+  delay(1000);
+  TEST_ASSERT_TRUE(pllGetState() == PLL_STATE::LOCKED);
+  probe.n = 0;
+  delay(100);
+  TEST_ASSERT_GREATER_OR_EQUAL(299, probe.n);
+  uint64_t total = probe.edges[probe.n - 1] - probe.edges[0];
+  TEST_ASSERT_UINT32_WITHIN(2, 5333, (uint32_t)(total / (probe.n - 1)));
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(5333 + 64, maxInterval());
+}
+
+int main(int argc, char **argv)
+{
+  init();
+  Serial.fdOut = -1;
+  pinMode(9, OUTPUT);
+  pinMode(10, OUTPUT);
+  hostAddDevice(&probe);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_square_edges);
+  RUN_TEST(test_ctc_wrap);
+  RUN_TEST(test_resolve_at_match);
+  RUN_TEST(test_resolve_short_cycle);
+  RUN_TEST(test_dds_output);
+  RUN_TEST(test_pll_output);
+  return UNITY_END();
+}
@@ -0,0 +1,281 @@
+/**
+ * Program      uartbench.c
+ *
+ * Purpose      Throughput of the serial port at every rate: switches the generator
+ *              to the rate with [u], then measures the round trips of a command and
+ *              the status stream at 100 Hz, binary and JSON, and prints a table
+ *
+ * Usage        uartbench [-r rate,rate,..] [-n commands] [-t seconds] port
+ *
+ *              -r  rates to measure, default 115200,500000,1000000,2000000
+ *              -n  round trips of the command, default 200
+ *              -t  seconds of each stream, default 5
+ *
+ * Build        cc -O2 tools/uartbench.c -o uartbench
+ *
+ * Formulas     cmd/s    = round trips / time
+ *              ms/cmd   = time / round trips
+ *              frames/s = frames with a valid CRC (binary) or complete lines
+ *                         (JSON) / time
+ *
+ * Remarks      The command is [h] by its name, the line "heartbeat\n": a bare
+ *              letter would wait the 10 ms of SCPI_WAIT for the rest of a line.
+ *              Its answer "Heartbeat on " or "Heartbeat off " ends with a known
+ *              text. An even number of round trips leaves the heartbeat as it was.
+ *              A round trip includes the 80 blanks of CLR_LINE that every answer
+ *              starts with.
+ *
+ *              The generator has to run at 115'200 baud when the program starts,
+ *              and is switched back to it at the end. Linux has no B250000, so
+ *              250'000 baud cannot be measured here. Every [u] and [v] takes the
+ *              2 s the command line gives for the arguments.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUF_SIZE (1 << 20)
+
+static char buf[BUF_SIZE];
+static int  len;
+static long current = 115200;             // rate of the generator
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static speed_t speedOf(long rate)
+{
+  switch (rate)
+  {
+    case 115200:  return B115200;
+    case 500000:  return B500000;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    default:      return 0;
+  }
+}
+
+static int setRate(int fd, long rate)
+{
+  struct termios tio;
+  if (tcgetattr(fd, &tio) < 0) return -1;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  cfsetispeed(&tio, speedOf(rate));
+  cfsetospeed(&tio, speedOf(rate));
+  return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void send(int fd, const char *s)
+{
+  if (write(fd, s, strlen(s)) < 0) perror("write");
+}
+
+/**
+ * Read for ms milliseconds or until needle has come, from the start
+ * of the buffer on. Returns the position after needle or -1
+ */
+static int readUntil(int fd, const char *needle, int ms)
+{
+  double end = now() + ms / 1000.0;
+  while (now() < end)
+  {
+    struct pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, 10) > 0)
+    {
+      int n = read(fd, buf + len, BUF_SIZE - 1 - len);
+      if (n > 0) len += n;
+      buf[len] = 0;
+    }
+    if (needle)
+    {
+      char *found = memmem(buf, len, needle, strlen(needle));
+      if (found) return found - buf + strlen(needle);
+    }
+  }
+  return -1;
+}
+
+/**
+ * Switch the generator and the port to rate, see uart.cpp
+ */
+static int negotiate(int fd, long rate)
+{
+  char cmd[32], ok[48];
+
+  len = 0;
+  snprintf(cmd, sizeof(cmd), "u%ld", rate);
+  send(fd, cmd);
+  if (readUntil(fd, "within", 5000) < 0) return -1;
+  tcdrain(fd);
+  usleep(20000);                          // rest of the announcement at the old rate
+  setRate(fd, rate);
+  tcflush(fd, TCIFLUSH);
+  len = 0;
+  send(fd, "U");
+  snprintf(ok, sizeof(ok), "BAUD: %ld, UBRR0", rate);
+  if (readUntil(fd, ok, 3000) < 0)
+  {
+    setRate(fd, current);                 // the generator falls back as well
+    return -1;
+  }
+  current = rate;
+  return 0;
+}
+
+/**
+ * Round trips of [h] by name, returns the time in s
+ */
+static double commands(int fd, int n)
+{
+  double start = now();
+  for (int i = 0; i < n; i++)
+  {
+    len = 0;
+    send(fd, "heartbeat\n");
+    if (readUntil(fd, i % 2 ? "Heartbeat on " : "Heartbeat off ", 2000) < 0) return -1;
+  }
+  return now() - start;
+}
+
+static uint16_t crc16(const uint8_t *p, int n)
+{
+  uint16_t crc = 0;
+  while (n--)
+  {
+    crc ^= (uint16_t)*p++ << 8;
+    for (int i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+/**
+ * Stream at 100 Hz in format 1 (binary) or 2 (JSON) for secs seconds.
+ * Counts the frames, the CRC errors and the frames dropped by the generator
+ */
+static int stream(int fd, int format, int secs, int *frames, int *errors, int *drops)
+{
+  char cmd[16];
+
+  *frames = *errors = *drops = 0;
+  len = 0;
+  snprintf(cmd, sizeof(cmd), "v100 %d", format);
+  send(fd, cmd);
+  if (readUntil(fd, "dropped: 0 ", 5000) < 0) return -1;
+  len = 0;
+  readUntil(fd, NULL, secs * 1000);
+
+  for (int i = 0; i < len; i++)
+  {
+    if (format == 1)
+    {
+      const uint8_t *f = (const uint8_t *)buf + i;
+      if (i + 39 > len || f[0] != 0xA5 || f[1] != 0x5A || f[2] != 34) continue;
+      if (crc16(f + 3, 34) != (f[37] | f[38] << 8)) { (*errors)++; continue; }
+      (*frames)++;
+      *drops = f[3 + 32] | f[3 + 33] << 8;
+      i += 38;
+    }
+    else
+    {
+      char *end = memchr(buf + i, '\n', len - i);
+      if (strncmp(buf + i, "{\"ms\":", 6) || !end) continue;
+      char *drop = strstr(buf + i, "\"drop\":");
+      if (end[-2] == '}' && drop && drop < end)
+      {
+        (*frames)++;
+        *drops = atoi(drop + 7);
+      }
+      else
+        (*errors)++;
+      i = end - buf;
+    }
+  }
+
+  len = 0;
+  send(fd, "v0 1");
+  readUntil(fd, "STREAM: off", 5000);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *rates = "115200,500000,1000000,2000000";
+  int         n     = 200;
+  int         secs  = 5;
+  int         opt;
+
+  while ((opt = getopt(argc, argv, "r:n:t:")) != -1)
+  {
+    if (opt == 'r') rates = optarg;
+    else if (opt == 'n') n = atoi(optarg) & ~1;
+    else if (opt == 't') secs = atoi(optarg);
+    else
+    {
+      fprintf(stderr, "usage: uartbench [-r rate,rate,..] [-n commands] [-t seconds] port\n");
+      return 2;
+    }
+  }
+  if (optind >= argc)
+  {
+    fprintf(stderr, "usage: uartbench [-r rate,rate,..] [-n commands] [-t seconds] port\n");
+    return 2;
+  }
+
+  int fd = open(argv[optind], O_RDWR | O_NOCTTY);
+  if (fd < 0 || setRate(fd, 115200) < 0)
+  {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  printf("%9s %8s %7s | %-23s | %-23s\n", "", "", "", "binary 100 Hz", "JSON 100 Hz");
+  printf("%9s %8s %7s | %8s %6s %7s | %8s %6s %7s\n",
+         "baud", "cmd/s", "ms/cmd", "frames/s", "crc", "dropped", "frames/s", "broken", "dropped");
+
+  char *list = strdup(rates);
+  for (char *r = strtok(list, ","); r; r = strtok(NULL, ","))
+  {
+    long rate = atol(r);
+    int  frames, errors, drops;
+
+    if (!speedOf(rate))
+    {
+      printf("%9ld  not supported here\n", rate);
+      continue;
+    }
+    if (negotiate(fd, rate) < 0)
+    {
+      printf("%9ld  no answer, back to %ld\n", rate, current);
+      continue;
+    }
+    double t = commands(fd, n);
+    printf("%9ld %8.0f %7.2f |", rate, t > 0 ? n / t : 0, t > 0 ? t * 1000 / n : 0);
+    fflush(stdout);
+    for (int format = 1; format <= 2; format++)
+    {
+      if (stream(fd, format, secs, &frames, &errors, &drops) < 0)
+        printf(" %8s %6s %7s |", "-", "-", "-");
+      else
+        printf(" %8.1f %6d %7d |", (double)frames / secs, errors, drops);
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+  free(list);
+
+  negotiate(fd, 115200);
+  close(fd);
+  return 0;
+}